@@ -0,0 +1,99 @@
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <omp.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// ==============================
+// Benchmark utility functions
+// ==============================
+
+/*
+ * Returns the wall clock time in seconds.
+ */
+inline double bench_now() {
+  return omp_get_wtime();
+}
+
+/*
+ * Returns the thread counts to sweep over: powers of two from 1 up to and including max_threads.
+ */
+inline std::vector<int> bench_thread_counts(int max_threads = 64) {
+  std::vector<int> counts;
+  for (int t = 1; t <= max_threads; t *= 2) {
+    counts.push_back(t);
+  }
+
+  return counts;
+}
+
+/*
+ * Keeps the compiler from optimizing away a computed value.
+ */
+template <typename T>
+inline void bench_keep(const T& value) {
+  asm volatile("" : : "g"(&value) : "memory");
+}
+
+// ==============================
+// BenchResult class
+// ==============================
+
+/*
+ * Timing of one microbenchmarked kernel.
+ */
+class BenchResult {
+  public:
+    std::string name;         // name of the kernel
+    uint64_t iterations = 0;  // calls of the kernel per timed run
+    double seconds = 0;       // time of the fastest timed run
+
+    /*
+     * Returns the time of one call of the kernel in nanoseconds.
+     */
+    double ns_per_op() const {
+      return seconds * 1e9 / iterations;
+    }
+
+    /*
+     * Returns the number of calls of the kernel per second.
+     */
+    double ops_per_second() const {
+      return iterations / seconds;
+    }
+};
+
+/*
+ * Times kernel(i), called for i = 0, 1, 2, ... The number of calls is doubled until a run takes
+ * min_seconds, and the fastest of repeats runs of that many calls is kept, which filters out
+ * noise from the rest of the system. Whatever the kernel returns is kept from being optimized away.
+ */
+template <typename Kernel>
+BenchResult bench_kernel(const std::string& name, Kernel kernel, double min_seconds = 0.05, int repeats = 5) {
+  auto run = [&](uint64_t iterations) {
+    const double start = bench_now();
+    for (uint64_t i = 0; i < iterations; i++) {
+      bench_keep(kernel(i));
+    }
+    return bench_now() - start;
+  };
+
+  BenchResult result;
+  result.name = name;
+  result.iterations = 1;
+  while (run(result.iterations) < min_seconds) {
+    result.iterations *= 2;
+  }
+
+  result.seconds = run(result.iterations);
+  for (int r = 1; r < repeats; r++) {
+    result.seconds = std::min(result.seconds, run(result.iterations));
+  }
+
+  return result;
+}
+
+#endif //!BENCH_H_
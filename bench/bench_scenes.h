@@ -0,0 +1,189 @@
+#ifndef BENCH_SCENES_H_
+#define BENCH_SCENES_H_
+
+#include "raymond.h"
+#include "camera.h"
+#include "entity_list.h"
+#include "material.h"
+#include "sphere.h"
+#include "quad.h"
+#include "box.h"
+
+// ==============================
+// Benchmark scenes
+// ==============================
+
+/*
+ * Builds a cornell box like room with large walls around many small spheres and boxes, the case
+ * where median splits produce poor trees.
+ */
+inline EntityList make_cluttered_room(Camera& camera) {
+  EntityList world;
+  shared_ptr<Material> white = make_shared<Lambertian>(Color(0.73, 0.73, 0.73));
+
+  world.add(make_shared<Quad>(Point3(-200, 0, 0), Vector3(0, 0, 400), Vector3(0, 400, 0), white));
+  world.add(make_shared<Quad>(Point3(200, 0, 0), Vector3(0, 0, 400), Vector3(0, 400, 0), white));
+  world.add(make_shared<Quad>(Point3(0, 0, -200), Vector3(400, 0, 0), Vector3(0, 400, 0), white));
+  world.add(make_shared<Quad>(Point3(0, -200, 0), Vector3(400, 0, 0), Vector3(0, 0, 400), white));
+  world.add(make_shared<Quad>(Point3(0, 200, 0), Vector3(400, 0, 0), Vector3(0, 0, 400), white));
+
+  Rng rng(3, 0);
+  for (int i = 0; i < 4000; i++) {
+    Point3 center(random_double(rng, -180, 180), random_double(rng, -195, -120), random_double(rng, -180, 180));
+    world.add(make_shared<Sphere>(center, random_double(rng, 1, 4), white));
+  }
+  for (int i = 0; i < 200; i++) {
+    Point3 center(random_double(rng, -180, 180), random_double(rng, -190, -150), random_double(rng, -180, 180));
+    world.add(make_shared<Box>(center, Vector3(10, 10, 10), Vector3(0, random_double(rng, 0, pi), 0), white));
+  }
+
+  camera.image_width = 400;
+  camera.aspect_ratio = 1;
+  camera.vfov = 40;
+  camera.lookfrom = Point3(0, 0, 700);
+  camera.lookat = Point3(0, 0, 0);
+  camera.vup = Vector3(0, 1, 0);
+
+  return world;
+}
+
+/*
+ * Builds a long hall lit by count small emissive quads and spheres of random colors and
+ * brightness scattered under its ceiling, the case where picking lights uniformly wastes most
+ * shadow rays on lights too far away or too dim to matter. The lights are added to lights.
+ */
+inline EntityList make_light_field(Camera& camera, EntityList& lights, int count = 1000) {
+  EntityList world;
+  shared_ptr<Material> white = make_shared<Lambertian>(Color(0.73, 0.73, 0.73));
+  shared_ptr<Material> red = make_shared<Lambertian>(Color(0.65, 0.05, 0.05));
+  shared_ptr<Material> metal = make_shared<Metal>(Color(0.8, 0.8, 0.8), 0.2);
+
+  // floor, back wall and side walls of a hall 2000 units deep
+  world.add(make_shared<Quad>(Point3(0, 0, -1000), Vector3(400, 0, 0), Vector3(0, 0, 2000), white));
+  world.add(make_shared<Quad>(Point3(0, 100, -2000), Vector3(400, 0, 0), Vector3(0, 200, 0), white));
+  world.add(make_shared<Quad>(Point3(-200, 100, -1000), Vector3(0, 0, 2000), Vector3(0, 200, 0), red));
+  world.add(make_shared<Quad>(Point3(200, 100, -1000), Vector3(0, 0, 2000), Vector3(0, 200, 0), white));
+
+  Rng rng(5, 0);
+  for (int i = 0; i < 60; i++) {
+    Point3 center(random_double(rng, -180, 180), 15, random_double(rng, -1900, -50));
+    world.add(make_shared<Sphere>(center, 15, (i % 3 == 0) ? metal : white));
+  }
+
+  for (int i = 0; i < count; i++) {
+    Color emit(random_double(rng, 0.2, 1), random_double(rng, 0.2, 1), random_double(rng, 0.2, 1));
+    emit = emit * (random_double(rng) < 0.1 ? 200.0 : 20.0);
+    shared_ptr<Material> light = make_shared<DiffuseLight>(emit);
+    Point3 center(random_double(rng, -190, 190), random_double(rng, 120, 195), random_double(rng, -1990, -10));
+
+    shared_ptr<Entity> entity;
+    if (i % 2 == 0) {
+      entity = make_shared<Quad>(center, Vector3(4, 0, 0), Vector3(0, 0, 4), light);
+    }
+    else {
+      entity = make_shared<Sphere>(center, 2, light);
+    }
+    world.add(entity);
+    lights.add(entity);
+  }
+
+  camera.image_width = 160;
+  camera.aspect_ratio = 16.0 / 9.0;
+  camera.vfov = 50;
+  camera.lookfrom = Point3(0, 80, 150);
+  camera.lookat = Point3(0, 60, -600);
+  camera.vup = Vector3(0, 1, 0);
+  camera.max_depth = 5;
+
+  return world;
+}
+
+/*
+ * Builds a room lit by one large ceiling light, with diffuse and fuzzy metal spheres that cast soft
+ * shadows, seen through a lens with depth of field. Every sample has to cover the pixel, the lens,
+ * the light and the bounces, the dimensions that well spread samples converge faster on.
+ * The light is added to lights.
+ */
+inline EntityList make_soft_shadow_room(Camera& camera, EntityList& lights) {
+  EntityList world;
+  shared_ptr<Material> white = make_shared<Lambertian>(Color(0.73, 0.73, 0.73));
+  shared_ptr<Material> green = make_shared<Lambertian>(Color(0.12, 0.45, 0.15));
+  shared_ptr<Material> metal = make_shared<Metal>(Color(0.8, 0.85, 0.9), 0.3);
+  shared_ptr<Material> light = make_shared<DiffuseLight>(Color(6, 6, 6));
+
+  world.add(make_shared<Quad>(Point3(0, 0, -200), Vector3(600, 0, 0), Vector3(0, 0, 600), white));
+  world.add(make_shared<Quad>(Point3(0, 150, -500), Vector3(600, 0, 0), Vector3(0, 300, 0), green));
+  world.add(make_shared<Sphere>(Point3(-90, 40, -220), 40, white));
+  world.add(make_shared<Sphere>(Point3(10, 40, -160), 40, metal));
+  world.add(make_shared<Sphere>(Point3(110, 40, -300), 40, white));
+
+  shared_ptr<Entity> ceiling_light = make_shared<Quad>(Point3(0, 250, -220), Vector3(160, 0, 0),
+      Vector3(0, 0, 160), light);
+  world.add(ceiling_light);
+  lights.add(ceiling_light);
+
+  camera.image_width = 160;
+  camera.aspect_ratio = 16.0 / 9.0;
+  camera.vfov = 50;
+  camera.lookfrom = Point3(0, 120, 150);
+  camera.lookat = Point3(0, 40, -200);
+  camera.vup = Vector3(0, 1, 0);
+  camera.defocus_angle = 1.5;
+  camera.focus_dist = 370;
+  camera.max_depth = 4;
+
+  return world;
+}
+
+/*
+ * Builds a ground plane covered by count spheres of random diffuse, metal and glass materials in a
+ * square that grows with count, lit by a large quad light, for measuring how rendering scales with
+ * the number of entities. The light is added to lights.
+ */
+inline EntityList make_sphere_field(Camera& camera, EntityList& lights, int count) {
+  EntityList world;
+  shared_ptr<Material> ground = make_shared<Lambertian>(Color(0.5, 0.5, 0.5));
+  shared_ptr<Material> glass = make_shared<Dielectric>(1.5);
+  shared_ptr<Material> light = make_shared<DiffuseLight>(Color(4, 4, 4));
+
+  const double extent = 2 * std::sqrt(double(count));
+  world.add(make_shared<Quad>(Point3(0, 0, 0), Vector3(4 * extent, 0, 0), Vector3(0, 0, 4 * extent), ground));
+
+  Rng rng(5, 0);
+  for (int i = 0; i < count; i++) {
+    const double radius = random_double(rng, 0.2, 0.6);
+    const Point3 center(random_double(rng, -extent, extent), radius, random_double(rng, -extent, extent));
+    const double choice = random_double(rng);
+
+    shared_ptr<Material> material;
+    if (choice < 0.7) {
+      material = make_shared<Lambertian>(Color(random_double(rng, 0.1, 0.9), random_double(rng, 0.1, 0.9), random_double(rng, 0.1, 0.9)));
+    }
+    else if (choice < 0.9) {
+      material = make_shared<Metal>(Color(random_double(rng, 0.5, 1), random_double(rng, 0.5, 1), random_double(rng, 0.5, 1)),
+          random_double(rng, 0, 0.5));
+    }
+    else {
+      material = glass;
+    }
+    world.add(make_shared<Sphere>(center, radius, material));
+  }
+
+  shared_ptr<Entity> sky_light = make_shared<Quad>(Point3(0, 2 * extent, 0), Vector3(extent, 0, 0),
+      Vector3(0, 0, extent), light);
+  world.add(sky_light);
+  lights.add(sky_light);
+
+  camera.image_width = 320;
+  camera.aspect_ratio = 16.0 / 9.0;
+  camera.vfov = 40;
+  camera.lookfrom = Point3(0, 0.6 * extent, 1.4 * extent);
+  camera.lookat = Point3(0, 0, 0);
+  camera.vup = Vector3(0, 1, 0);
+  camera.background = Color(0.5, 0.6, 0.8);
+  camera.max_depth = 8;
+
+  return world;
+}
+
+#endif //!BENCH_SCENES_H_
@@ -0,0 +1,81 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <omp.h>
+
+#include "raymond.h"
+#include "aabb.h"
+#include "linear_bvh.h"
+#include "bench.h"
+
+// ==============================
+// BVH build benchmark
+// Builds trees over synthetic sphere lists of 10K, 100K and 1M primitives with every split method
+// and reports the build time for each thread count.
+// ==============================
+
+/*
+ * Generates the bounding boxes of count random spheres, half spread uniformly through a cube and
+ * half packed into a few dense clusters.
+ */
+static std::vector<BVHPrimitive> make_spheres(size_t count) {
+  Rng rng(7, count);
+  const double extent = 10 * std::cbrt(double(count));
+
+  Point3 clusters[8];
+  for (Point3& c : clusters) {
+    c = Vector3::random(rng, -extent, extent);
+  }
+
+  std::vector<BVHPrimitive> primitives;
+  primitives.reserve(count);
+  for (size_t i = 0; i < count; i++) {
+    Point3 center = (i % 2 == 0)
+      ? Vector3::random(rng, -extent, extent)
+      : clusters[i % 8] + Vector3::random(rng, -extent / 20, extent / 20);
+    double radius = random_double(rng, 0.1, 2);
+    Vector3 rvec(radius, radius, radius);
+    primitives.emplace_back(Aabb(center - rvec, center + rvec), uint32_t(i));
+  }
+
+  return primitives;
+}
+
+int main(int argc, char* argv[]) {
+  // an optional argument caps the number of threads in the sweep
+  int max_threads = (argc > 1) ? std::atoi(argv[1]) : 64;
+
+  const size_t sizes[] = { 10000, 100000, 1000000 };
+  const std::pair<const char*, BVHSplitMethod> methods[] = {
+    { "median", BVHSplitMethod::Median },
+    { "sah", BVHSplitMethod::SAH },
+    { "lbvh", BVHSplitMethod::LBVH },
+  };
+
+  std::printf("%10s %8s %8s %12s %10s %10s\n", "prims", "method", "threads", "build ms", "SAH cost", "depth");
+
+  for (size_t size : sizes) {
+    const std::vector<BVHPrimitive> primitives = make_spheres(size);
+
+    for (const auto& [name, method] : methods) {
+      for (int threads : bench_thread_counts(max_threads)) {
+        omp_set_num_threads(threads);
+
+        LinearBVHTree tree;
+        tree.options.split = method;
+        tree.options.parallel = threads > 1;
+
+        std::vector<BVHPrimitive> work = primitives;
+        double start = bench_now();
+        tree.build(work);
+        double elapsed = bench_now() - start;
+
+        BVHStats stats = tree.compute_stats();
+        std::printf("%10zu %8s %8d %12.2f %10.2f %10d\n", size, name, threads, elapsed * 1e3,
+            stats.sah_cost, stats.max_depth);
+      }
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,167 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "scene.h"
+#include "bvh.h"
+#include "linear_bvh.h"
+#include "bench.h"
+#include "bench_scenes.h"
+
+// ==============================
+// BVH traversal benchmark
+// Traces the same camera and bounce rays through the recursive BVH_Node tree and the LinearBVH
+// built with median and SAH splits, at widths 2, 4 and 8, and reports build time, tree quality and
+// MRays/s for each.
+// ==============================
+
+static const int RAY_COUNT = 1 << 20;  // number of rays traced per structure
+
+/*
+ * Generates pinhole camera rays through random pixels of the given camera, followed by rays leaving
+ * the first hit point in random directions to stand in for bounces.
+ */
+static std::vector<Ray> make_rays(const Camera& camera, const Entity& world) {
+  const int image_height = std::max(1, int(camera.image_width / camera.aspect_ratio));
+  const double h = std::tan(degrees_to_radians(camera.vfov) / 2);
+  const double viewport_height = 2 * h;
+  const double viewport_width = viewport_height * (double(camera.image_width) / image_height);
+
+  const Vector3 w = unit_vector(camera.lookfrom - camera.lookat);
+  const Vector3 u = unit_vector(cross(camera.vup, w));
+  const Vector3 v = cross(w, u);
+
+  Rng rng(1, 0);
+  std::vector<Ray> rays;
+  rays.reserve(RAY_COUNT);
+
+  while (int(rays.size()) < RAY_COUNT) {
+    double s = random_double(rng) - 0.5;
+    double t = random_double(rng) - 0.5;
+    Ray primary(camera.lookfrom, s * viewport_width * u - t * viewport_height * v - w);
+    rays.push_back(primary);
+
+    HitRecord rec;
+    if (world.hit(primary, Interval(0.001, infinity), rec)) {
+      rays.push_back(Ray(rec.p, rec.normal + random_unit_vector(rng)));
+    }
+  }
+
+  rays.resize(RAY_COUNT);
+  return rays;
+}
+
+/*
+ * Traces all rays through the given structure and returns MRays/s. Stores the number of hits.
+ */
+static double trace(const Entity& structure, const std::vector<Ray>& rays, int& hits) {
+  hits = 0;
+  double start = bench_now();
+
+  #pragma omp parallel for schedule(dynamic, 1024) reduction(+:hits)
+  for (int i = 0; i < int(rays.size()); i++) {
+    HitRecord rec;
+    if (structure.hit(rays[i], Interval(0.001, infinity), rec)) {
+      hits++;
+    }
+  }
+
+  return rays.size() / (bench_now() - start) / 1e6;
+}
+
+/*
+ * Builds every structure over the given world, traces the same rays through each of them and
+ * prints one row per structure.
+ */
+static void run_scene(const std::string& name, const EntityList& world, const Camera& camera) {
+  double start = bench_now();
+  BVH_Node tree(world);
+  double tree_build = bench_now() - start;
+
+  BVHBuildOptions median_options;
+  median_options.split = BVHSplitMethod::Median;
+  median_options.max_leaf_size = 2;
+  LinearBVH median(world, median_options);
+  LinearBVH sah(world);
+
+  BVHBuildOptions lbvh_options;
+  lbvh_options.split = BVHSplitMethod::LBVH;
+  LinearBVH lbvh(world, lbvh_options);
+
+  BVHBuildOptions wide4_options;
+  wide4_options.width = 4;
+  LinearBVH sah4(world, wide4_options);
+
+  BVHBuildOptions wide8_options;
+  wide8_options.width = 8;
+  LinearBVH sah8(world, wide8_options);
+
+  std::vector<Ray> rays = make_rays(camera, sah);
+
+  int tree_hits = 0;
+  double tree_mrays = trace(tree, rays, tree_hits);
+  std::printf("%-52s %-18s %10.3f %8s %6s %8s %10s %10.2f\n", name.c_str(), "BVH_Node",
+      tree_build * 1e3, "-", "-", "-", "-", tree_mrays);
+
+  const std::pair<const char*, const LinearBVH*> structures[] = {
+    { "LinearBVH median", &median },
+    { "LinearBVH SAH", &sah },
+    { "LinearBVH LBVH", &lbvh },
+    { "LinearBVH SAH x4", &sah4 },
+    { "LinearBVH SAH x8", &sah8 },
+  };
+
+  for (const auto& [label, bvh] : structures) {
+    int hits = 0;
+    double mrays = trace(*bvh, rays, hits);
+    if (hits != tree_hits) {
+      std::fprintf(stderr, "%s: %s hit count mismatch (%d vs %d)\n", name.c_str(), label, hits, tree_hits);
+    }
+
+    const BVHStats& stats = bvh->stats();
+    std::printf("%-52s %-18s %10.3f %8zu %6d %8.2f %10.2f %10.2f\n", name.c_str(), label,
+        stats.build_seconds * 1e3, stats.width > 2 ? stats.wide_node_count : stats.node_count,
+        stats.max_depth, stats.average_leaf_size,
+        stats.sah_cost, mrays);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  std::vector<std::string> scenes;
+  for (int i = 1; i < argc; i++) {
+    scenes.push_back(argv[i]);
+  }
+
+  if (scenes.empty()) {
+    scenes = {
+      "example_scenes/cornell_box/cornell_box_scene.json",
+      "example_scenes/earth/earth_scene.json",
+      "example_scenes/perlin/perlin_scene.json",
+    };
+  }
+
+  std::vector<std::pair<std::string, std::unique_ptr<Scene>>> loaded;
+  for (const std::string& path : scenes) {
+    try {
+      loaded.push_back({ path, std::make_unique<Scene>(path) });
+    }
+    catch (const std::runtime_error& e) {
+      std::fprintf(stderr, "[ERROR]: %s\n", e.what());
+      return 2;
+    }
+  }
+
+  std::printf("%-52s %-18s %10s %8s %6s %8s %10s %10s\n",
+      "scene", "structure", "build ms", "nodes", "depth", "avg leaf", "SAH cost", "MRays/s");
+
+  for (auto& [path, scene] : loaded) {
+    run_scene(path, scene->get_world(), scene->get_camera());
+  }
+
+  Camera room_camera;
+  EntityList room = make_cluttered_room(room_camera);
+  run_scene("synthetic cluttered room", room, room_camera);
+
+  return 0;
+}
@@ -0,0 +1,309 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+#include "raymond.h"
+#include "vector3.h"
+#include "color.h"
+
+// ==============================
+// Scene generator
+// Writes a scene file in the format read by Parser with count spheres, quads, boxes and instances
+// of a tree prototype placed at random, in clusters or on a grid inside a cube whose volume grows
+// with count, so that every primitive keeps the same amount of space. The primitives use many
+// materials, some of them textured with checker and noise textures, and the scene is lit by quad
+// lights above the cube and a sky colored background. The same options and seed always produce
+// the same file.
+// Usage: generate_scene [--count 1000] [--types sphere,quad,box,instance]
+//                       [--distribution random|clustered|grid] [--materials 32] [--textures 8]
+//                       [--lights 4] [--seed 0] [--width 640] [--spp 16] output.json
+// ==============================
+
+static const double SPACING = 4;  // side of the cube of space every primitive gets
+
+/*
+ * Settings of the generated scene, see the usage above.
+ */
+class GeneratorOptions {
+  public:
+    long count = 1000;
+    std::vector<std::string> types = { "sphere", "quad", "box" };
+    std::string distribution = "random";
+    int materials = 32;
+    int textures = 8;
+    int lights = 4;
+    uint64_t seed = 0;
+    int width = 640;
+    int samples_per_pixel = 16;
+    std::string output;
+};
+
+/*
+ * Parses the command line into options. Throws on unknown or invalid options.
+ */
+static GeneratorOptions parse_options(int argc, char* argv[]) {
+  GeneratorOptions options;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg.rfind("--", 0) != 0) {
+      options.output = arg;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      throw std::runtime_error("Expected a value after " + arg);
+    }
+    const std::string value = argv[++i];
+
+    if (arg == "--count") {
+      options.count = std::max(1L, std::atol(value.c_str()));
+    }
+    else if (arg == "--types") {
+      options.types.clear();
+      std::stringstream stream(value);
+      std::string type;
+      while (std::getline(stream, type, ',')) {
+        if (type != "sphere" && type != "quad" && type != "box" && type != "instance") {
+          throw std::runtime_error("Unknown primitive type " + type + ", expected sphere, quad, box or instance");
+        }
+        options.types.push_back(type);
+      }
+    }
+    else if (arg == "--distribution") {
+      if (value != "random" && value != "clustered" && value != "grid") {
+        throw std::runtime_error("Unknown distribution " + value + ", expected random, clustered or grid");
+      }
+      options.distribution = value;
+    }
+    else if (arg == "--materials") {
+      options.materials = std::max(1, std::atoi(value.c_str()));
+    }
+    else if (arg == "--textures") {
+      options.textures = std::max(0, std::atoi(value.c_str()));
+    }
+    else if (arg == "--lights") {
+      options.lights = std::max(0, std::atoi(value.c_str()));
+    }
+    else if (arg == "--seed") {
+      options.seed = std::strtoull(value.c_str(), nullptr, 10);
+    }
+    else if (arg == "--width") {
+      options.width = std::max(1, std::atoi(value.c_str()));
+    }
+    else if (arg == "--spp") {
+      options.samples_per_pixel = std::max(1, std::atoi(value.c_str()));
+    }
+    else {
+      throw std::runtime_error("Unknown option " + arg);
+    }
+  }
+
+  if (options.output.empty() || options.types.empty()) {
+    throw std::runtime_error("Expected an output file and at least one primitive type");
+  }
+  return options;
+}
+
+/*
+ * Returns a normally distributed random number with mean 0 and standard deviation 1.
+ */
+static double random_normal(Rng& rng) {
+  const double u = 1 - random_double(rng);
+  return std::sqrt(-2 * std::log(u)) * std::cos(2 * pi * random_double(rng));
+}
+
+/*
+ * Places the primitives inside the cube [-half_side, half_side]^3.
+ */
+class Placer {
+  public:
+    /*
+     * Constructs the placer of count primitives with the given distribution.
+     */
+    Placer(const std::string& distribution, long count, double half_side, Rng& rng) :
+      distribution(distribution),
+      half_side(half_side) {
+        // grid cells per axis, and one cluster per thousand primitives
+        cells = std::max(1L, long(std::ceil(std::cbrt(double(count)))));
+        const long cluster_count = std::max(1L, count / 1000);
+        cluster_spread = half_side / std::cbrt(double(cluster_count));
+        for (long i = 0; i < cluster_count; i++) {
+          clusters.push_back(Vector3::random(rng, -half_side, half_side));
+        }
+      }
+
+    /*
+     * Returns the center of the primitive with the given index.
+     */
+    Point3 place(long index, Rng& rng) const {
+      if (distribution == "grid") {
+        const double cell = 2 * half_side / cells;
+        return Point3(-half_side + cell * (index % cells + 0.5), -half_side + cell * ((index / cells) % cells + 0.5),
+            -half_side + cell * (index / (cells * cells) + 0.5));
+      }
+
+      if (distribution == "clustered") {
+        const Point3& center = clusters[std::min(long(random_double(rng) * clusters.size()), long(clusters.size()) - 1)];
+        const double x = random_normal(rng), y = random_normal(rng), z = random_normal(rng);
+        return center + 0.25 * cluster_spread * Vector3(x, y, z);
+      }
+
+      return Vector3::random(rng, -half_side, half_side);
+    }
+
+  private:
+    std::string distribution;      // random, clustered or grid
+    double half_side;              // half the side of the cube the primitives are placed in
+    long cells;                    // grid cells per axis
+    double cluster_spread;         // distance between clusters
+    std::vector<Point3> clusters;  // centers of the clusters
+};
+
+/*
+ * Writes the given vector as a JSON array.
+ */
+static void write_vector(std::FILE* file, const Vector3& v) {
+  std::fprintf(file, "[%.4f, %.4f, %.4f]", v.x(), v.y(), v.z());
+}
+
+int main(int argc, char* argv[]) {
+  GeneratorOptions options;
+  try {
+    options = parse_options(argc, argv);
+  }
+  catch (const std::runtime_error& e) {
+    std::fprintf(stderr, "[ERROR]: %s\n", e.what());
+    return 1;
+  }
+
+  std::FILE* file = std::fopen(options.output.c_str(), "w");
+  if (!file) {
+    std::fprintf(stderr, "[ERROR]: Failed to open %s\n", options.output.c_str());
+    return 2;
+  }
+
+  Rng rng(options.seed, 0);
+  const double half_side = 0.5 * SPACING * std::cbrt(double(options.count));
+
+  // camera outside a corner of the cube, looking at its center
+  std::fprintf(file, "{\n  \"camera\": {\n");
+  std::fprintf(file, "    \"aspect_ratio\": 1.77778,\n    \"image_width\": %d,\n    \"samples_per_pixel\": %d,\n",
+      options.width, options.samples_per_pixel);
+  std::fprintf(file, "    \"max_depth\": 8,\n    \"background\": [0.5, 0.6, 0.8],\n    \"vfov\": 40,\n    \"lookfrom\": ");
+  write_vector(file, Vector3(1.6, 1.2, 2.2) * half_side);
+  std::fprintf(file, ",\n    \"lookat\": [0, 0, 0],\n    \"vup\": [0, 1, 0],\n    \"defocus_angle\": 0,\n    \"seed\": %llu\n  },\n",
+      (unsigned long long) options.seed);
+
+  // checker textures of two solid colors and noise textures of random scales
+  std::fprintf(file, "  \"textures\": {\n");
+  std::fprintf(file, "    \"dark\": { \"type\": \"SolidColor\", \"albedo\": [0.1, 0.1, 0.12] }");
+  for (int t = 0; t < options.textures; t++) {
+    if (t % 2 == 0) {
+      std::fprintf(file, ",\n    \"light_%d\": { \"type\": \"SolidColor\", \"albedo\": ", t);
+      write_vector(file, Vector3::random(rng, 0.4, 0.95));
+      std::fprintf(file, " },\n    \"texture_%d\": { \"type\": \"CheckerTexture\", \"scale\": %.3f, \"odd\": \"light_%d\", \"even\": \"dark\" }",
+          t, random_double(rng, 0.2, 2), t);
+    }
+    else {
+      std::fprintf(file, ",\n    \"texture_%d\": { \"type\": \"NoiseTexture\", \"scale\": %.3f }", t, random_double(rng, 0.5, 8));
+    }
+  }
+  std::fprintf(file, "\n  },\n");
+
+  // diffuse materials of random colors or textures, fuzzy metals and glass
+  std::fprintf(file, "  \"materials\": {\n    \"light\": { \"type\": \"DiffuseLight\", \"color\": [6, 6, 6] }");
+  for (int m = 0; m < options.materials; m++) {
+    const double choice = random_double(rng);
+    std::fprintf(file, ",\n    \"material_%d\": ", m);
+    if (choice < 0.3 && options.textures > 0) {
+      std::fprintf(file, "{ \"type\": \"Lambertian\", \"texture\": \"texture_%d\" }", random_int(rng, 0, options.textures - 1));
+    }
+    else if (choice < 0.7) {
+      std::fprintf(file, "{ \"type\": \"Lambertian\", \"albedo\": ");
+      write_vector(file, Vector3::random(rng, 0.05, 0.95));
+      std::fprintf(file, " }");
+    }
+    else if (choice < 0.9) {
+      std::fprintf(file, "{ \"type\": \"Metal\", \"albedo\": ");
+      write_vector(file, Vector3::random(rng, 0.5, 1));
+      std::fprintf(file, ", \"fuzz\": %.3f }", random_double(rng, 0, 0.5));
+    }
+    else {
+      std::fprintf(file, "{ \"type\": \"Dielectric\", \"refractive_index\": %.3f }", random_double(rng, 1.3, 1.8));
+    }
+  }
+  std::fprintf(file, "\n  },\n");
+
+  // a tree of unit height standing on its origin, made of a trunk and a crown of three spheres
+  if (std::find(options.types.begin(), options.types.end(), "instance") != options.types.end()) {
+    std::fprintf(file, "  \"prototypes\": {\n    \"tree\": {\n");
+    std::fprintf(file, "      \"trunk\": { \"type\": \"Box\", \"material\": \"material_0\", \"center\": [0, 0.25, 0], "
+        "\"dimensions\": [0.08, 0.08, 0.5], \"rotations\": [0, 0, 0] },\n");
+    std::fprintf(file, "      \"crown_0\": { \"type\": \"Sphere\", \"material\": \"material_%d\", \"center\": [0, 0.7, 0], "
+        "\"radius\": 0.25 },\n", 1 % options.materials);
+    std::fprintf(file, "      \"crown_1\": { \"type\": \"Sphere\", \"material\": \"material_%d\", \"center\": [0.15, 0.55, 0], "
+        "\"radius\": 0.18 },\n", 1 % options.materials);
+    std::fprintf(file, "      \"crown_2\": { \"type\": \"Sphere\", \"material\": \"material_%d\", \"center\": [-0.12, 0.58, 0.1], "
+        "\"radius\": 0.18 }\n    }\n  },\n", 1 % options.materials);
+  }
+
+  // lights above the cube, then the primitives
+  std::fprintf(file, "  \"entities\": {\n");
+  bool first = true;
+  for (int l = 0; l < options.lights; l++) {
+    std::fprintf(file, "%s    \"light_%d\": { \"type\": \"Quad\", \"material\": \"light\", \"center\": ", first ? "" : ",\n", l);
+    write_vector(file, Point3(random_double(rng, -half_side, half_side), 2 * half_side, random_double(rng, -half_side, half_side)));
+    std::fprintf(file, ", \"horizontal\": ");
+    write_vector(file, Vector3(0.4 * half_side, 0, 0));
+    std::fprintf(file, ", \"vertical\": ");
+    write_vector(file, Vector3(0, 0, 0.4 * half_side));
+    std::fprintf(file, " }");
+    first = false;
+  }
+
+  const Placer placer(options.distribution, options.count, half_side, rng);
+  for (long i = 0; i < options.count; i++) {
+    const Point3 center = placer.place(i, rng);
+    const std::string& type = options.types[std::min(size_t(random_double(rng) * options.types.size()), options.types.size() - 1)];
+    const int material = random_int(rng, 0, options.materials - 1);
+    const double size = random_double(rng, 0.2, 0.5) * SPACING;
+
+    std::fprintf(file, "%s    \"e%ld\": { \"material\": \"material_%d\", \"center\": ", first ? "" : ",\n", i, material);
+    write_vector(file, center);
+    if (type == "sphere") {
+      std::fprintf(file, ", \"type\": \"Sphere\", \"radius\": %.4f }", 0.5 * size);
+    }
+    else if (type == "quad") {
+      // a random orientation made of two perpendicular edges
+      const Vector3 normal = random_unit_vector(rng);
+      const Vector3 edge = unit_vector(cross(normal, std::fabs(normal.x()) > 0.9 ? Vector3(0, 1, 0) : Vector3(1, 0, 0)));
+      std::fprintf(file, ", \"type\": \"Quad\", \"horizontal\": ");
+      write_vector(file, size * edge);
+      std::fprintf(file, ", \"vertical\": ");
+      write_vector(file, size * cross(normal, edge));
+      std::fprintf(file, " }");
+    }
+    else if (type == "instance") {
+      std::fprintf(file, ", \"type\": \"Instance\", \"prototype\": \"tree\", \"scale\": %.4f, \"rotations\": [0, %.4f, 0] }",
+          size, random_double(rng, 0, 2 * pi));
+    }
+    else {
+      std::fprintf(file, ", \"type\": \"Box\", \"dimensions\": ");
+      write_vector(file, Vector3::random(rng, 0.5, 1) * size);
+      std::fprintf(file, ", \"rotations\": ");
+      write_vector(file, Vector3::random(rng, 0, 90));
+      std::fprintf(file, " }");
+    }
+    first = false;
+  }
+  std::fprintf(file, "\n  }\n}\n");
+  std::fclose(file);
+
+  std::fprintf(stderr, "[INFO]: Wrote %ld %s primitives to %s\n", options.count, options.distribution.c_str(),
+      options.output.c_str());
+  return 0;
+}
@@ -0,0 +1,174 @@
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "scene.h"
+#include "bvh.h"
+#include "perlin.h"
+#include "sampler.h"
+#include "bench.h"
+#include "bench_scenes.h"
+
+// ==============================
+// Kernel microbenchmark
+// Times the intersection, traversal, texture, color and random number kernels one call at a
+// time on fixed inputs drawn with fixed seeds, and reports ns/op and calls per second of each as
+// JSON, so that their performance can be compared between commits.
+// Usage: bench_kernels [output.json], the JSON is written to stdout without a path.
+// ==============================
+
+static const int INPUT_COUNT = 1 << 12;           // inputs cycled through by every kernel
+static const uint64_t INPUT_MASK = INPUT_COUNT - 1;
+static const char* TEXTURE_PATH = "bench_kernels_texture.png";  // texture written for ImageTexture
+
+/*
+ * Returns rays starting at random points of the cube [-extent, extent]^3 towards random points of
+ * the cube [-target, target]^3.
+ */
+static std::vector<Ray> make_rays(Rng& rng, double extent, double target) {
+  std::vector<Ray> rays;
+  for (int i = 0; i < INPUT_COUNT; i++) {
+    const Point3 origin = Vector3::random(rng, -extent, extent);
+    rays.push_back(Ray(origin, Vector3::random(rng, -target, target) - origin));
+  }
+  return rays;
+}
+
+/*
+ * Writes a 512x256 checker image to TEXTURE_PATH for the ImageTexture kernel.
+ */
+static void write_texture() {
+  ImageBuffer image_buffer(512, 256);
+  for (int row = 0; row < 256; row++) {
+    for (int col = 0; col < 512; col++) {
+      image_buffer.get(row, col) = ((row / 16 + col / 16) % 2) ? Color(0.8, 0.3, 0.1) : Color(0.1, 0.2, 0.7);
+    }
+  }
+  image_buffer.write_to_file(TEXTURE_PATH, ".png");
+}
+
+int main(int argc, char* argv[]) {
+  Rng rng(42, 0);
+  const shared_ptr<Material> material = make_shared<Lambertian>(Color(0.5, 0.5, 0.5));
+
+  // inputs
+  const std::vector<Ray> rays = make_rays(rng, 3, 1);
+  std::vector<Point3> points;
+  std::vector<Color> colors;
+  std::vector<double> uvs;
+  for (int i = 0; i < INPUT_COUNT; i++) {
+    points.push_back(Vector3::random(rng, -4, 4));
+    colors.push_back(Color(random_double(rng, 0, 1.2), random_double(rng, 0, 1.2), random_double(rng, 0, 1.2)));
+    uvs.push_back(random_double(rng));
+  }
+
+  // entities
+  const Aabb box(Point3(-1, -1, -1), Point3(1, 1, 1));
+  const Sphere sphere(Point3(0, 0, 0), 1, material);
+  const Quad quad(Point3(0, 0, 0), Vector3(2, 0, 0), Vector3(0, 2, 0), material);
+
+  Camera camera;
+  EntityList room = make_cluttered_room(camera);
+  const BVH_Node bvh_node(room);
+  const LinearBVH linear_bvh(room);
+  const Aabb room_box = room.bounding_box();
+  const Point3 room_center = 0.5 * Point3(room_box.x.min + room_box.x.max, room_box.y.min + room_box.y.max,
+      room_box.z.min + room_box.z.max);
+  std::vector<Ray> room_rays;
+  for (int i = 0; i < INPUT_COUNT; i++) {
+    room_rays.push_back(Ray(room_center + Vector3::random(rng, -50, 50), random_unit_vector(rng)));
+  }
+
+  const Perlin perlin;
+  write_texture();
+  const ImageTexture image_texture(TEXTURE_PATH);
+  std::remove(TEXTURE_PATH);
+
+  Rng kernel_rng(7, 0);
+  Sampler sobol(SamplerType::Sobol, 7, 1 << 20, 0);
+  Sampler stratified(SamplerType::Stratified, 7, 1 << 20, 0);
+
+  // kernels
+  std::vector<BenchResult> results;
+  auto bench = [&](const std::string& name, auto kernel) {
+    results.push_back(bench_kernel(name, kernel));
+    const BenchResult& result = results.back();
+    std::fprintf(stderr, "%-28s %10.2f ns/op %12.2f Mops/s\n", name.c_str(), result.ns_per_op(),
+        result.ops_per_second() / 1e6);
+  };
+
+  bench("Aabb::hit", [&](uint64_t i) {
+    return box.hit(rays[i & INPUT_MASK], Interval(0.001, infinity));
+  });
+  bench("Sphere::hit", [&](uint64_t i) {
+    HitRecord rec;
+    return sphere.hit(rays[i & INPUT_MASK], Interval(0.001, infinity), rec);
+  });
+  bench("Quad::hit", [&](uint64_t i) {
+    HitRecord rec;
+    return quad.hit(rays[i & INPUT_MASK], Interval(0.001, infinity), rec);
+  });
+  bench("BVH_Node::hit", [&](uint64_t i) {
+    HitRecord rec;
+    return bvh_node.hit(room_rays[i & INPUT_MASK], Interval(0.001, infinity), rec);
+  });
+  bench("LinearBVH::hit", [&](uint64_t i) {
+    HitRecord rec;
+    return linear_bvh.hit(room_rays[i & INPUT_MASK], Interval(0.001, infinity), rec);
+  });
+  bench("Perlin::turb", [&](uint64_t i) {
+    return perlin.turb(points[i & INPUT_MASK], 7);
+  });
+  bench("ImageTexture::value", [&](uint64_t i) {
+    return image_texture.value(uvs[i & INPUT_MASK], uvs[(i + 1) & INPUT_MASK], points[i & INPUT_MASK]);
+  });
+  bench("color_to_pixel", [&](uint64_t i) {
+    return color_to_pixel(colors[i & INPUT_MASK]);
+  });
+  bench("random_double", [&](uint64_t) {
+    return random_double(kernel_rng);
+  });
+  bench("random_int", [&](uint64_t) {
+    return random_int(kernel_rng, 0, 100);
+  });
+  bench("random_unit_vector", [&](uint64_t) {
+    return random_unit_vector(kernel_rng);
+  });
+  bench("random_in_unit_disk", [&](uint64_t) {
+    return random_in_unit_disk(kernel_rng);
+  });
+  bench("Sampler::get_2d (stratified)", [&](uint64_t i) {
+    stratified.start_sample(int(i & 0xfffff));
+    return stratified.get_2d();
+  });
+  bench("Sampler::get_2d (sobol)", [&](uint64_t i) {
+    sobol.start_sample(int(i & 0xfffff));
+    return sobol.get_2d();
+  });
+
+  // report
+  nlohmann::json report;
+  report["benchmark"] = "kernels";
+  report["compiler"] = __VERSION__;
+  report["results"] = nlohmann::json::array();
+  for (const BenchResult& result : results) {
+    report["results"].push_back({
+      {"name", result.name},
+      {"ns_per_op", result.ns_per_op()},
+      {"ops_per_second", result.ops_per_second()},
+      {"iterations", result.iterations},
+    });
+  }
+
+  if (argc > 1) {
+    std::ofstream file(argv[1]);
+    file << report.dump(2) << "\n";
+  }
+  else {
+    std::cout << report.dump(2) << "\n";
+  }
+
+  return 0;
+}
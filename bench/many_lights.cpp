@@ -0,0 +1,103 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#include "camera.h"
+#include "linear_bvh.h"
+#include "light_sampler.h"
+#include "light_bvh.h"
+#include "image_buffer.h"
+#include "bench.h"
+#include "bench_scenes.h"
+
+// ==============================
+// Many lights benchmark
+// Renders a hall lit by 1000 small emitters with lights picked uniformly and by the LightBVH,
+// giving both samplers the same render time, and reports the RMSE of each image against a
+// reference rendered with many samples.
+// Usage: bench_many_lights [seconds per render] [reference samples per pixel]
+// ==============================
+
+/*
+ * Renders the world with the given number of samples per pixel and light sampler.
+ * Stores the pixels, clamped to [0, 1] like the written images, and returns the render time.
+ */
+static double render(Camera camera, const Entity& world, const LightSampler& lights, int samples,
+    std::vector<Color>& pixels) {
+  camera.samples_per_pixel = samples;
+  const int height = camera.output_height();
+  ImageBuffer image_buffer(camera.image_width, height);
+
+  double start = bench_now();
+  camera.render(world, image_buffer, &lights);
+  double seconds = bench_now() - start;
+
+  pixels.clear();
+  const Interval intensity(0, 1);
+  for (int row = 0; row < height; row++) {
+    for (int col = 0; col < camera.image_width; col++) {
+      const Color& c = image_buffer.get(row, col);
+      pixels.push_back(Color(intensity.clamp(c.e[0]), intensity.clamp(c.e[1]), intensity.clamp(c.e[2])));
+    }
+  }
+
+  return seconds;
+}
+
+/*
+ * Returns the root mean square error of every channel of the image against the reference.
+ */
+static double rmse(const std::vector<Color>& image, const std::vector<Color>& reference) {
+  double sum = 0;
+  for (size_t i = 0; i < image.size(); i++) {
+    for (int c = 0; c < 3; c++) {
+      const double d = image[i].e[c] - reference[i].e[c];
+      sum += d * d;
+    }
+  }
+
+  return std::sqrt(sum / (3 * image.size()));
+}
+
+int main(int argc, char* argv[]) {
+  const double budget = (argc > 1) ? std::atof(argv[1]) : 2.0;
+  const int reference_samples = (argc > 2) ? std::atoi(argv[2]) : 512;
+
+  Camera camera;
+  EntityList lights;
+  EntityList scene = make_light_field(camera, lights);
+  camera.seed = 1;
+
+  LinearBVH bvh(scene);
+  UniformLightSampler uniform(lights.list);
+  LightBVH light_bvh(lights.list);
+
+  std::vector<Color> reference;
+  std::fprintf(stderr, "rendering the reference with %d samples per pixel\n", reference_samples);
+  render(camera, bvh, light_bvh, reference_samples, reference);
+
+  std::printf("%d lights, %.1f seconds per render\n", int(lights.list.size()), budget);
+  std::printf("%-10s %12s %10s %10s %10s\n", "sampler", "s/sample", "samples", "seconds", "rmse");
+
+  const std::pair<const char*, const LightSampler*> samplers[] = {
+    { "uniform", &uniform },
+    { "bvh", &light_bvh },
+  };
+
+  for (const auto& [name, sampler] : samplers) {
+    // time a few samples to find how many fit in the budget
+    std::vector<Color> pixels;
+    camera.seed = 2;
+    const int probe_samples = 4;
+    const double per_sample = render(camera, bvh, *sampler, probe_samples, pixels) / probe_samples;
+    const int samples = std::max(1, int(budget / per_sample));
+
+    const double seconds = render(camera, bvh, *sampler, samples, pixels);
+    std::printf("%-10s %12.4f %10d %10.2f %10.4f\n", name, per_sample, samples, seconds, rmse(pixels, reference));
+  }
+
+  return 0;
+}
@@ -0,0 +1,166 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "scene.h"
+#include "linear_bvh.h"
+#include "ray_packet.h"
+#include "bench.h"
+#include "bench_scenes.h"
+
+// ==============================
+// Packet tracing benchmark
+// Traces the primary rays of a pinhole camera through the SAH LinearBVH one at a time and as
+// packets of 4, 8 and 16 rays covering 2x2, 4x2 and 4x4 pixel tiles, and reports MRays/s for each.
+// ==============================
+
+static const int SAMPLES_PER_PIXEL = 4;  // jittered primary rays per pixel
+
+/*
+ * Generates jittered primary rays of the given camera ordered by tiles of tile_width x tile_height
+ * pixels, one sample of every pixel of a tile after the other. Stores the number of rays in each
+ * tile in counts.
+ */
+static std::vector<Ray> make_primary_rays(const Camera& camera, int tile_width, int tile_height,
+    std::vector<int>& counts) {
+  const int image_width = camera.image_width;
+  const int image_height = std::max(1, int(image_width / camera.aspect_ratio));
+  const double h = std::tan(degrees_to_radians(camera.vfov) / 2);
+  const double viewport_height = 2 * h;
+  const double viewport_width = viewport_height * (double(image_width) / image_height);
+
+  const Vector3 w = unit_vector(camera.lookfrom - camera.lookat);
+  const Vector3 u = unit_vector(cross(camera.vup, w));
+  const Vector3 v = cross(w, u);
+  const Vector3 pixel_u = viewport_width / image_width * u;
+  const Vector3 pixel_v = -viewport_height / image_height * v;
+  const Point3 upper_left = camera.lookfrom - w - image_width / 2.0 * pixel_u - image_height / 2.0 * pixel_v;
+
+  std::vector<Ray> rays;
+  counts.clear();
+
+  for (int row = 0; row < image_height; row += tile_height) {
+    for (int col = 0; col < image_width; col += tile_width) {
+      for (int sample = 0; sample < SAMPLES_PER_PIXEL; sample++) {
+        int count = 0;
+        for (int j = row; j < std::min(row + tile_height, image_height); j++) {
+          for (int i = col; i < std::min(col + tile_width, image_width); i++) {
+            // the jitter only depends on the pixel and sample so every tiling traces the same rays
+            Rng rng(uint64_t(j) * image_width + i, sample);
+            Point3 target = upper_left + (i + random_double(rng)) * pixel_u + (j + random_double(rng)) * pixel_v;
+            rays.push_back(Ray(camera.lookfrom, target - camera.lookfrom));
+            count++;
+          }
+        }
+        counts.push_back(count);
+      }
+    }
+  }
+
+  return rays;
+}
+
+/*
+ * Traces the rays in groups of the given sizes, as packets when packets is true and one by one
+ * otherwise. Returns MRays/s and stores the number of hits.
+ */
+static double trace(const LinearBVH& bvh, const std::vector<Ray>& rays, const std::vector<int>& counts,
+    bool packets, int& hits) {
+  std::vector<size_t> firsts(counts.size());
+  for (size_t g = 1; g < counts.size(); g++) {
+    firsts[g] = firsts[g - 1] + counts[g - 1];
+  }
+
+  hits = 0;
+  double start = bench_now();
+
+  #pragma omp parallel for schedule(dynamic, 64) reduction(+:hits)
+  for (int g = 0; g < int(counts.size()); g++) {
+    const Ray* group = &rays[firsts[g]];
+    const int count = counts[g];
+
+    Interval ray_t[MAX_PACKET_SIZE];
+    HitRecord records[MAX_PACKET_SIZE];
+    for (int i = 0; i < count; i++) {
+      ray_t[i] = Interval(0.001, infinity);
+    }
+
+    if (packets) {
+      hits += __builtin_popcount(bvh.hit_packet(group, ray_t, records, count));
+    }
+    else {
+      for (int i = 0; i < count; i++) {
+        hits += bvh.hit(group[i], ray_t[i], records[i]);
+      }
+    }
+  }
+
+  return rays.size() / (bench_now() - start) / 1e6;
+}
+
+/*
+ * Prints the single ray row and one row per packet size for the given world.
+ */
+static void run_scene(const std::string& name, const EntityList& world, const Camera& camera) {
+  LinearBVH bvh(world);
+
+  const std::pair<int, int> tiles[] = { {1, 1}, {2, 2}, {4, 2}, {4, 4} };
+  int single_hits = -1;
+
+  for (const auto& [tile_width, tile_height] : tiles) {
+    std::vector<int> counts;
+    std::vector<Ray> rays = make_primary_rays(camera, tile_width, tile_height, counts);
+    const bool packets = tile_width * tile_height > 1;
+
+    int hits = 0;
+    double mrays = trace(bvh, rays, counts, packets, hits);
+    if (single_hits >= 0 && hits != single_hits) {
+      std::fprintf(stderr, "%s: packet of %d hit count mismatch (%d vs %d)\n", name.c_str(),
+          tile_width * tile_height, hits, single_hits);
+    }
+    if (!packets) {
+      single_hits = hits;
+    }
+
+    std::printf("%-52s %8d %10.2f %10d\n", name.c_str(), tile_width * tile_height, mrays, hits);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  std::vector<std::string> scenes;
+  for (int i = 1; i < argc; i++) {
+    scenes.push_back(argv[i]);
+  }
+
+  if (scenes.empty()) {
+    scenes = {
+      "example_scenes/cornell_box/cornell_box_scene.json",
+      "example_scenes/earth/earth_scene.json",
+      "example_scenes/perlin/perlin_scene.json",
+    };
+  }
+
+  std::vector<std::pair<std::string, std::unique_ptr<Scene>>> loaded;
+  for (const std::string& path : scenes) {
+    try {
+      loaded.push_back({ path, std::make_unique<Scene>(path) });
+    }
+    catch (const std::runtime_error& e) {
+      std::fprintf(stderr, "[ERROR]: %s\n", e.what());
+      return 2;
+    }
+  }
+
+  std::printf("%-52s %8s %10s %10s\n", "scene", "packet", "MRays/s", "hits");
+
+  for (auto& [path, scene] : loaded) {
+    run_scene(path, scene->get_world(), scene->get_camera());
+  }
+
+  Camera room_camera;
+  EntityList room = make_cluttered_room(room_camera);
+  run_scene("synthetic cluttered room", room, room_camera);
+
+  return 0;
+}
@@ -0,0 +1,375 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <filesystem>
+#include <stdexcept>
+
+#include "scene.h"
+#include "bench.h"
+#include "bench_scenes.h"
+
+// ==============================
+// End to end scene benchmark
+// Renders the example scenes and sphere fields of growing size at a fixed seed and sample budget,
+// with every requested integrator and thread count. The parse, BVH build, render and encode phases
+// are timed separately, and every render is compared against a high sample count reference by
+// RMSE. With --time-budget every render gets as many samples as fit in the budget instead, which
+// compares the integrators at equal time.
+// Usage: raymond-bench [--scenes cornell_box,earth,perlin,field_1000,...] [--integrators path,wavefront,restir]
+//                      [--threads 1,2,4,...] [--width 320] [--spp 16] [--time-budget seconds]
+//                      [--reference-spp 256] [--references out/bench_references]
+//                      [--renders out/bench_renders] [--json results.json]
+// Run it from the root of the repository so that the example scenes are found.
+// ==============================
+
+static const uint64_t RENDER_SEED = 1;           // seed of the benchmarked renders
+static const uint64_t REFERENCE_SEED = 1000003;  // seed of the references, independent of the renders
+
+/*
+ * Settings of a benchmark run, see the usage above.
+ */
+class BenchOptions {
+  public:
+    std::vector<std::string> scenes = { "cornell_box", "earth", "perlin", "field_1000", "field_10000", "field_100000" };
+    std::vector<std::string> integrators = { "path" };
+    std::vector<int> threads = bench_thread_counts(omp_get_max_threads());
+    int width = 320;
+    int samples_per_pixel = 16;
+    double time_budget = 0;
+    int reference_samples_per_pixel = 256;
+    std::string references = "out/bench_references";
+    std::string renders = "out/bench_renders";
+    std::string json;
+};
+
+/*
+ * Scene ready to be rendered, with the time it took to parse or generate and to build.
+ */
+class BenchScene {
+  public:
+    std::string name;
+    Camera camera;
+    EntityList world;                              // entities of the scene under their BVH
+    const LightSampler* lights = nullptr;          // lights sampled at diffuse bounces
+    double parse_seconds = 0;                      // time spent parsing or generating the scene
+    double build_seconds = 0;                      // time spent building the BVH and light sampler
+    std::unique_ptr<Scene> scene;                  // parsed scene that owns the lights
+    std::unique_ptr<LightSampler> light_sampler;   // light sampler of generated scenes
+};
+
+/*
+ * Returns the comma separated items of the given text.
+ */
+static std::vector<std::string> split_list(const std::string& text) {
+  std::vector<std::string> items;
+  std::stringstream stream(text);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    if (!item.empty()) {
+      items.push_back(item);
+    }
+  }
+  return items;
+}
+
+/*
+ * Parses the command line into options. Throws on unknown or incomplete options.
+ */
+static BenchOptions parse_options(int argc, char* argv[]) {
+  BenchOptions options;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      throw std::runtime_error("Expected a value after " + arg);
+    }
+    const std::string value = argv[++i];
+
+    if (arg == "--scenes") {
+      options.scenes = split_list(value);
+    }
+    else if (arg == "--integrators") {
+      options.integrators = split_list(value);
+    }
+    else if (arg == "--threads") {
+      options.threads.clear();
+      for (const std::string& count : split_list(value)) {
+        options.threads.push_back(std::max(1, std::atoi(count.c_str())));
+      }
+    }
+    else if (arg == "--width") {
+      options.width = std::max(1, std::atoi(value.c_str()));
+    }
+    else if (arg == "--spp") {
+      options.samples_per_pixel = std::max(1, std::atoi(value.c_str()));
+    }
+    else if (arg == "--time-budget") {
+      options.time_budget = std::atof(value.c_str());
+    }
+    else if (arg == "--reference-spp") {
+      options.reference_samples_per_pixel = std::max(1, std::atoi(value.c_str()));
+    }
+    else if (arg == "--references") {
+      options.references = value;
+    }
+    else if (arg == "--renders") {
+      options.renders = value;
+    }
+    else if (arg == "--json") {
+      options.json = value;
+    }
+    else {
+      throw std::runtime_error("Unknown option " + arg);
+    }
+  }
+  return options;
+}
+
+/*
+ * Loads the example scene or generates the sphere field with the given name, and builds it.
+ */
+static BenchScene load_scene(const std::string& name) {
+  BenchScene result;
+  result.name = name;
+
+  if (name.rfind("field_", 0) == 0) {
+    double start = bench_now();
+    EntityList lights;
+    EntityList entities = make_sphere_field(result.camera, lights, std::atoi(name.c_str() + 6));
+    result.parse_seconds = bench_now() - start;
+
+    start = bench_now();
+    result.world = EntityList(make_shared<LinearBVH>(entities));
+    result.light_sampler = std::make_unique<LightBVH>(lights.list);
+    result.lights = result.light_sampler.get();
+    result.build_seconds = bench_now() - start;
+    return result;
+  }
+
+  // the texture paths of the example scenes are relative to their directory
+  const std::filesystem::path directory = std::filesystem::path("example_scenes") / name;
+  const std::filesystem::path file = directory / (name + "_scene.json");
+  if (!std::filesystem::exists(file)) {
+    throw std::runtime_error("Scene " + file.string() + " not found, run from the root of the repository");
+  }
+
+  const std::filesystem::path cwd = std::filesystem::current_path();
+  const std::string scene_path = std::filesystem::absolute(file).string();
+  std::filesystem::current_path(directory);
+
+  double start = bench_now();
+  result.scene = std::make_unique<Scene>(scene_path);
+  result.parse_seconds = bench_now() - start;
+
+  start = bench_now();
+  result.scene->build();
+  result.build_seconds = bench_now() - start;
+  std::filesystem::current_path(cwd);
+
+  result.camera = result.scene->get_camera();
+  result.world = result.scene->get_world();
+  result.lights = result.scene->get_light_sampler();
+  return result;
+}
+
+/*
+ * Writes the pixels of the image buffer to a portable float map.
+ */
+static void write_pfm(const std::string& file_path, const ImageBuffer& image_buffer) {
+  std::ofstream file(file_path, std::ios::binary);
+  file << "PF\n" << image_buffer.get_width() << " " << image_buffer.get_height() << "\n-1\n";
+
+  // rows are stored from the bottom up, in little endian
+  for (int row = image_buffer.get_height() - 1; row >= 0; row--) {
+    for (int col = 0; col < image_buffer.get_width(); col++) {
+      const Color& c = image_buffer.get(row, col);
+      const float values[3] = { float(c.r()), float(c.g()), float(c.b()) };
+      file.write(reinterpret_cast<const char*>(values), sizeof(values));
+    }
+  }
+}
+
+/*
+ * Reads the portable float map written by write_pfm into the image buffer, which must have its
+ * size. Returns false if the file does not exist or has another size.
+ */
+static bool read_pfm(const std::string& file_path, ImageBuffer& image_buffer) {
+  std::ifstream file(file_path, std::ios::binary);
+  std::string magic;
+  int width, height;
+  double scale;
+  if (!(file >> magic >> width >> height >> scale) || magic != "PF" || width != image_buffer.get_width() || height != image_buffer.get_height()) {
+    return false;
+  }
+  file.get();
+
+  for (int row = height - 1; row >= 0; row--) {
+    for (int col = 0; col < width; col++) {
+      float values[3];
+      if (!file.read(reinterpret_cast<char*>(values), sizeof(values))) {
+        return false;
+      }
+      image_buffer.get(row, col) = Color(values[0], values[1], values[2]);
+    }
+  }
+  return true;
+}
+
+/*
+ * Returns the root mean square error of every channel of the image against the reference, with
+ * both clamped to [0, 1] like the written images.
+ */
+static double rmse(const ImageBuffer& image, const ImageBuffer& reference) {
+  const Interval intensity(0, 1);
+  double sum = 0;
+  for (int row = 0; row < image.get_height(); row++) {
+    for (int col = 0; col < image.get_width(); col++) {
+      for (int c = 0; c < 3; c++) {
+        const double d = intensity.clamp(image.get(row, col).e[c]) - intensity.clamp(reference.get(row, col).e[c]);
+        sum += d * d;
+      }
+    }
+  }
+  return std::sqrt(sum / (3.0 * image.get_width() * image.get_height()));
+}
+
+/*
+ * Returns the integrator with the given name. Throws if there is none.
+ */
+static CameraIntegrator parse_integrator(const std::string& name) {
+  if (name == "path") {
+    return CameraIntegrator::Path;
+  }
+  else if (name == "wavefront") {
+    return CameraIntegrator::Wavefront;
+  }
+  else if (name == "restir") {
+    return CameraIntegrator::ReSTIR;
+  }
+  throw std::runtime_error("Unknown integrator " + name);
+}
+
+/*
+ * Renders the scene with its camera into the image buffer and returns the render time.
+ */
+static double render(BenchScene& scene, ImageBuffer& image_buffer) {
+  const double start = bench_now();
+  scene.camera.render(scene.world, image_buffer, scene.lights);
+  return bench_now() - start;
+}
+
+int main(int argc, char* argv[]) {
+  BenchOptions options;
+  try {
+    options = parse_options(argc, argv);
+  }
+  catch (const std::runtime_error& e) {
+    std::fprintf(stderr, "[ERROR]: %s\n", e.what());
+    return 1;
+  }
+
+  std::filesystem::create_directories(options.references);
+  std::filesystem::create_directories(options.renders);
+
+  nlohmann::json report;
+  report["benchmark"] = "scenes";
+  report["width"] = options.width;
+  report["samples_per_pixel"] = options.samples_per_pixel;
+  report["time_budget"] = options.time_budget;
+  report["reference_samples_per_pixel"] = options.reference_samples_per_pixel;
+  report["results"] = nlohmann::json::array();
+
+  std::printf("%-14s %-10s %7s %5s %9s %9s %9s %9s %9s %8s %10s\n", "scene", "integrator", "threads", "spp",
+      "parse s", "build s", "render s", "encode s", "MRays/s", "scaling", "RMSE");
+
+  try {
+    for (const std::string& name : options.scenes) {
+      BenchScene scene = load_scene(name);
+      scene.camera.image_width = options.width;
+      const int height = scene.camera.output_height();
+
+      // reference, rendered once with all threads and cached between runs
+      ImageBuffer reference(options.width, height);
+      const std::string reference_path = options.references + "/" + name + "_" + std::to_string(options.width)
+        + "_" + std::to_string(options.reference_samples_per_pixel) + ".pfm";
+      if (!read_pfm(reference_path, reference)) {
+        omp_set_num_threads(omp_get_num_procs());
+        scene.camera.integrator = CameraIntegrator::Path;
+        scene.camera.samples_per_pixel = options.reference_samples_per_pixel;
+        scene.camera.seed = REFERENCE_SEED;
+        render(scene, reference);
+        write_pfm(reference_path, reference);
+      }
+
+      for (const std::string& integrator : options.integrators) {
+        scene.camera.integrator = parse_integrator(integrator);
+        scene.camera.seed = RENDER_SEED;
+        double first_cost = 0;  // thread seconds of the render with the fewest threads
+
+        for (int threads : options.threads) {
+          omp_set_num_threads(threads);
+          ImageBuffer image_buffer(options.width, height);
+
+          // at equal time, a one sample render estimates how many samples fit in the budget
+          scene.camera.samples_per_pixel = options.samples_per_pixel;
+          if (options.time_budget > 0) {
+            scene.camera.samples_per_pixel = 1;
+            const double probe_seconds = render(scene, image_buffer);
+            scene.camera.samples_per_pixel = std::max(1, int(options.time_budget / probe_seconds));
+          }
+
+          const double render_seconds = render(scene, image_buffer);
+          const nlohmann::json& stats = scene.camera.stats();
+          const double mrays = stats["rays"].get<double>() / render_seconds / 1e6;
+
+          double start = bench_now();
+          image_buffer.write_to_file(options.renders + "/" + name + "_" + integrator + "_" + std::to_string(threads) + ".png", ".png");
+          const double encode_seconds = bench_now() - start;
+
+          // strong scaling efficiency against the render with the fewest threads
+          if (first_cost == 0) {
+            first_cost = render_seconds * threads;
+          }
+          const double scaling = first_cost / (render_seconds * threads);
+          const double error = rmse(image_buffer, reference);
+
+          std::printf("%-14s %-10s %7d %5d %9.4f %9.4f %9.3f %9.4f %9.3f %8.2f %10.6f\n", name.c_str(),
+              integrator.c_str(), threads, scene.camera.samples_per_pixel, scene.parse_seconds, scene.build_seconds,
+              render_seconds, encode_seconds, mrays, scaling, error);
+          std::fflush(stdout);
+
+          report["results"].push_back({
+            {"scene", name},
+            {"integrator", integrator},
+            {"threads", threads},
+            {"samples_per_pixel", scene.camera.samples_per_pixel},
+            {"parse_seconds", scene.parse_seconds},
+            {"build_seconds", scene.build_seconds},
+            {"render_seconds", render_seconds},
+            {"encode_seconds", encode_seconds},
+            {"rays", stats["rays"]},
+            {"mrays_per_second", mrays},
+            {"scaling_efficiency", scaling},
+            {"rmse", error},
+          });
+        }
+      }
+    }
+  }
+  catch (const std::runtime_error& e) {
+    std::fprintf(stderr, "[ERROR]: %s\n", e.what());
+    return 2;
+  }
+
+  if (!options.json.empty()) {
+    std::ofstream file(options.json);
+    file << report.dump(2) << "\n";
+  }
+
+  return 0;
+}
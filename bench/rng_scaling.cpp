@@ -0,0 +1,121 @@
+#include <cstdlib>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <omp.h>
+
+#include "raymond.h"
+#include "vector3.h"
+#include "bench.h"
+
+// ==============================
+// RNG scaling benchmark
+// Compares the old std::rand based helpers with the per pixel Rng over a range of thread counts.
+// ==============================
+
+static const int PIXELS = 1 << 15;        // number of simulated pixels
+static const int SAMPLES_PER_PIXEL = 16;  // samples taken per pixel
+static const int BOUNCES = 8;             // simulated bounces per sample
+
+/*
+ * The random_double used before the Rng class, backed by the locked global std::rand.
+ */
+static double legacy_random_double() {
+  return std::rand() / (RAND_MAX + 1.0);
+}
+
+/*
+ * The random_unit_vector used before the Rng class.
+ */
+static Vector3 legacy_random_unit_vector() {
+  while (true) {
+    Vector3 p(legacy_random_double() * 2 - 1, legacy_random_double() * 2 - 1, legacy_random_double() * 2 - 1);
+    double lensq = p.length_squared();
+    if (1e-160 < lensq && lensq <= 1) {
+      return p / std::sqrt(lensq);
+    }
+  }
+}
+
+/*
+ * Draws the random numbers of one path the way the camera and materials do: pixel jitter, time,
+ * and a scatter direction plus a dielectric decision per bounce.
+ */
+static double legacy_path() {
+  double sum = legacy_random_double() + legacy_random_double() + legacy_random_double();
+  for (int b = 0; b < BOUNCES; b++) {
+    sum += legacy_random_unit_vector().x() + legacy_random_double();
+  }
+
+  return sum;
+}
+
+/*
+ * Same as legacy_path but drawing from the given generator.
+ */
+static double rng_path(Rng& rng) {
+  double sum = random_double(rng) + random_double(rng) + random_double(rng);
+  for (int b = 0; b < BOUNCES; b++) {
+    sum += random_unit_vector(rng).x() + random_double(rng);
+  }
+
+  return sum;
+}
+
+/*
+ * Runs the given path kernel over all pixels with the given number of threads.
+ * Returns the elapsed seconds and stores an order independent checksum of the per pixel results.
+ */
+template <typename Kernel>
+static double run(int threads, uint64_t& checksum, Kernel kernel) {
+  omp_set_num_threads(threads);
+  uint64_t total = 0;
+  double start = bench_now();
+
+  #pragma omp parallel for schedule(dynamic) reduction(^:total)
+  for (int pixel = 0; pixel < PIXELS; pixel++) {
+    double value = kernel(pixel);
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    total ^= Rng::mix(bits + pixel);
+  }
+
+  double elapsed = bench_now() - start;
+  checksum = total;
+  return elapsed;
+}
+
+int main() {
+  const double paths = double(PIXELS) * SAMPLES_PER_PIXEL;
+
+  std::printf("%8s %16s %16s %10s %18s\n", "threads", "std::rand Mp/s", "Rng Mp/s", "speedup", "Rng checksum");
+
+  for (int threads : bench_thread_counts()) {
+    uint64_t legacy_sum = 0;
+    double legacy_time = run(threads, legacy_sum, [](int) {
+      double sum = 0;
+      for (int s = 0; s < SAMPLES_PER_PIXEL; s++) {
+        sum += legacy_path();
+      }
+      return sum;
+    });
+
+    uint64_t rng_sum = 0;
+    double rng_time = run(threads, rng_sum, [](int pixel) {
+      Rng rng(0, pixel);
+      double sum = 0;
+      for (int s = 0; s < SAMPLES_PER_PIXEL; s++) {
+        sum += rng_path(rng);
+      }
+      return sum;
+    });
+
+    bench_keep(legacy_sum);
+
+    // the Rng checksum must not change with the thread count
+    std::printf("%8d %16.2f %16.2f %9.2fx %18llx\n", threads,
+        paths / legacy_time / 1e6, paths / rng_time / 1e6, legacy_time / rng_time, (unsigned long long) rng_sum);
+  }
+
+  return 0;
+}
@@ -0,0 +1,104 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "camera.h"
+#include "linear_bvh.h"
+#include "light_sampler.h"
+#include "light_bvh.h"
+#include "sampler.h"
+#include "image_buffer.h"
+#include "bench.h"
+#include "bench_scenes.h"
+
+// ==============================
+// Sampler convergence benchmark
+// Renders a room with soft shadows, a glossy sphere and depth of field with the independent,
+// stratified and Sobol samplers at a range of samples per pixel, and reports the RMSE of each
+// image against a reference rendered with many samples.
+// Usage: bench_sampler_convergence [reference samples per pixel]
+// ==============================
+
+/*
+ * Renders the world with the given sampler and number of samples per pixel.
+ * Stores the pixels, clamped to [0, 1] like the written images, and returns the render time.
+ */
+static double render(Camera camera, const Entity& world, const LightSampler& lights, SamplerType sampler,
+    int samples, std::vector<Color>& pixels) {
+  camera.sampler_type = sampler;
+  camera.samples_per_pixel = samples;
+  const int height = camera.output_height();
+  ImageBuffer image_buffer(camera.image_width, height);
+
+  double start = bench_now();
+  camera.render(world, image_buffer, &lights);
+  double seconds = bench_now() - start;
+
+  pixels.clear();
+  const Interval intensity(0, 1);
+  for (int row = 0; row < height; row++) {
+    for (int col = 0; col < camera.image_width; col++) {
+      const Color& c = image_buffer.get(row, col);
+      pixels.push_back(Color(intensity.clamp(c.e[0]), intensity.clamp(c.e[1]), intensity.clamp(c.e[2])));
+    }
+  }
+
+  return seconds;
+}
+
+/*
+ * Returns the root mean square error of every channel of the image against the reference.
+ */
+static double rmse(const std::vector<Color>& image, const std::vector<Color>& reference) {
+  double sum = 0;
+  for (size_t i = 0; i < image.size(); i++) {
+    for (int c = 0; c < 3; c++) {
+      const double d = image[i].e[c] - reference[i].e[c];
+      sum += d * d;
+    }
+  }
+
+  return std::sqrt(sum / (3 * image.size()));
+}
+
+int main(int argc, char* argv[]) {
+  const int reference_samples = (argc > 1) ? std::atoi(argv[1]) : 2048;
+
+  Camera camera;
+  EntityList lights;
+  EntityList scene = make_soft_shadow_room(camera, lights);
+
+  LinearBVH bvh(scene);
+  LightBVH light_bvh(lights.list);
+
+  // the reference uses its own seed so that its noise does not line up with the images
+  std::vector<Color> reference;
+  std::fprintf(stderr, "rendering the reference with %d samples per pixel\n", reference_samples);
+  camera.seed = 1;
+  render(camera, bvh, light_bvh, SamplerType::Independent, reference_samples, reference);
+  camera.seed = 2;
+
+  const std::pair<const char*, SamplerType> samplers[] = {
+    { "independent", SamplerType::Independent },
+    { "stratified", SamplerType::Stratified },
+    { "sobol", SamplerType::Sobol },
+  };
+
+  std::printf("%-8s", "spp");
+  for (const auto& [name, sampler] : samplers) {
+    std::printf(" %12s %8s", name, "seconds");
+  }
+  std::printf("\n");
+
+  for (int samples = 1; samples <= 256; samples *= 4) {
+    std::printf("%-8d", samples);
+    for (const auto& [name, sampler] : samplers) {
+      std::vector<Color> pixels;
+      const double seconds = render(camera, bvh, light_bvh, sampler, samples, pixels);
+      std::printf(" %12.4f %8.2f", rmse(pixels, reference), seconds);
+    }
+    std::printf("\n");
+  }
+
+  return 0;
+}
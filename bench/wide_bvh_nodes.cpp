@@ -0,0 +1,111 @@
+#include <cstdio>
+#include <vector>
+
+#include "raymond.h"
+#include "aabb.h"
+#include "bvh_builder.h"
+#include "wide_bvh.h"
+#include "bench.h"
+
+// ==============================
+// Wide BVH node benchmark
+// Measures how many ray box slab tests per second each node layout sustains: the double precision
+// Aabb::hit, the 32 byte binary LinearBVHNode and the SIMD tests of 4 and 8 wide nodes.
+// ==============================
+
+static const int BOX_COUNT = 1 << 12;  // boxes tested by every ray
+static const int RAY_COUNT = 1 << 12;  // rays tested against every box
+
+/*
+ * Generates random boxes in a cube of side 100 and rays from random points towards the cube.
+ */
+static void make_inputs(std::vector<Aabb>& boxes, std::vector<Ray>& rays) {
+  Rng rng(11, 0);
+  for (int i = 0; i < BOX_COUNT; i++) {
+    Point3 a = Vector3::random(rng, -50, 50);
+    boxes.push_back(Aabb(a, a + Vector3::random(rng, 1, 10)));
+  }
+
+  for (int i = 0; i < RAY_COUNT; i++) {
+    Point3 origin = 100 * random_unit_vector(rng);
+    rays.push_back(Ray(origin, Vector3::random(rng, -30, 30) - origin));
+  }
+}
+
+/*
+ * Packs the given boxes into wide nodes of width N.
+ */
+template <int N>
+static std::vector<WideBVHNode<N>> make_wide_nodes(const std::vector<LinearBVHNode>& binary) {
+  std::vector<WideBVHNode<N>> nodes(binary.size() / N);
+  for (size_t i = 0; i < nodes.size(); i++) {
+    nodes[i].clear();
+    for (int j = 0; j < N; j++) {
+      nodes[i].set_bounds(j, binary[i * N + j]);
+    }
+  }
+  return nodes;
+}
+
+/*
+ * Prints one row with the given throughput and hit count.
+ */
+static void report(const char* label, double seconds, long hits) {
+  double tests = double(BOX_COUNT) * RAY_COUNT;
+  std::printf("%-24s %12.1f %12ld\n", label, tests / seconds / 1e6, hits);
+}
+
+/*
+ * Tests every ray against all nodes of width N.
+ */
+template <int N>
+static void run_wide(const char* label, const std::vector<WideBVHNode<N>>& nodes, const std::vector<Ray>& rays) {
+  long hits = 0;
+  double start = bench_now();
+  for (const Ray& r : rays) {
+    const WideRay ray(r);
+    for (const WideBVHNode<N>& node : nodes) {
+      float t_near[N];
+      hits += __builtin_popcount(node.intersect(ray, 0.001f, float(infinity), t_near));
+    }
+  }
+  report(label, bench_now() - start, hits);
+}
+
+int main() {
+  std::vector<Aabb> boxes;
+  std::vector<Ray> rays;
+  make_inputs(boxes, rays);
+
+  std::vector<LinearBVHNode> binary(BOX_COUNT);
+  for (int i = 0; i < BOX_COUNT; i++) {
+    binary[i].set_bounds(boxes[i]);
+  }
+
+  std::printf("%-24s %12s %12s\n", "node", "Mtests/s", "hits");
+
+  long hits = 0;
+  double start = bench_now();
+  for (const Ray& r : rays) {
+    for (const Aabb& box : boxes) {
+      hits += box.hit(r, Interval(0.001, infinity));
+    }
+  }
+  report("Aabb (double)", bench_now() - start, hits);
+
+  hits = 0;
+  start = bench_now();
+  for (const Ray& r : rays) {
+    const double origin[3] = { r.origin().e[0], r.origin().e[1], r.origin().e[2] };
+    const double inv_dir[3] = { 1 / r.direction().e[0], 1 / r.direction().e[1], 1 / r.direction().e[2] };
+    for (const LinearBVHNode& node : binary) {
+      hits += node.hit(origin, inv_dir, Interval(0.001, infinity));
+    }
+  }
+  report("LinearBVHNode (float)", bench_now() - start, hits);
+
+  run_wide<4>("WideBVHNode<4>", make_wide_nodes<4>(binary), rays);
+  run_wide<8>("WideBVHNode<8>", make_wide_nodes<8>(binary), rays);
+
+  return 0;
+}
@@ -6,6 +6,7 @@
 #include "vector3.h"
 #include "ray.h"
 #include "interval.h"
+#include "trace_stats.h"
 
 // ==============================
 // Aabb class
@@ -71,6 +72,7 @@ class Aabb {
      * Returns true if it hits, else returns false.
      */
     bool hit(const Ray& r, Interval ray_t) const {
+      RAYMOND_STAT(box_tests++);
       const Point3& ray_orig = r.origin();
       const Vector3& ray_dir = r.direction();
 
@@ -114,6 +116,16 @@ class Aabb {
       }
     }
 
+    /*
+     * Returns the surface area of the bounding box.
+     */
+    double surface_area() const {
+      double dx = x.size();
+      double dy = y.size();
+      double dz = z.size();
+      return 2 * (dx * dy + dy * dz + dz * dx);
+    }
+
     /*
      * Make sure no side of AABB is narrower than some delta.
      */
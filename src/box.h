@@ -0,0 +1,247 @@
+#ifndef BOX_H_
+#define BOX_H_
+
+#include <cmath>
+#include <algorithm>
+
+#include "raymond.h"
+#include "aabb.h"
+#include "vector3.h"
+#include "ray.h"
+#include "interval.h"
+#include "entity.h"
+#include "material.h"
+#include "color.h"
+#include "trace_stats.h"
+
+// ==============================
+// Box class
+// (derived from Entity class)
+// ==============================
+
+/*
+ * Box rotated around the x, y and z axes in that order. Rays are tested against its three pairs of
+ * faces at once in the space of the box, so that a box is a single primitive. Every face is
+ * textured from the corner at the lowest coordinates of the box along its two edges.
+ */
+class Box : public Entity {
+  public:
+    /*
+     * Constructs the box with the given center, the given dimensions along its z, x and y axes,
+     * rotated by the given angles in radians, and the given surface material.
+     */
+    Box(const Point3& center, const Vector3& dimensions, const Vector3& rotations, shared_ptr<Material> mat) :
+      center(center),
+      mat(mat) {
+        half[0] = std::fabs(dimensions[1]) / 2;
+        half[1] = std::fabs(dimensions[2]) / 2;
+        half[2] = std::fabs(dimensions[0]) / 2;
+
+        Vector3 extent(0, 0, 0);
+        for (int axis = 0; axis < 3; axis++) {
+          Vector3 e(0, 0, 0);
+          e[axis] = 1;
+          axes[axis] = e.rotate(rotations[0], 0).rotate(rotations[1], 1).rotate(rotations[2], 2);
+          for (int i = 0; i < 3; i++) {
+            extent[i] += std::fabs(axes[axis][i]) * half[axis];
+          }
+        }
+        bound_box = Aabb(center - extent, center + extent);
+      }
+
+    /*
+     * Returns the bounding box of the box
+     */
+    Aabb bounding_box() const override {
+      return bound_box;
+    }
+
+    /*
+     * Checks if the given ray hits the box in the given interval of time and records the hit on
+     * the nearest face in the HitRecord. Rays starting inside the box hit the face they leave by.
+     * Returns true if the ray hits, else returns false.
+     */
+    bool hit(const Ray& r, Interval ray_t, HitRecord& rec) const override {
+      RAYMOND_STAT(obb_tests++);
+      const Vector3 offset = r.origin() - center;
+
+      double origin[3], direction[3];
+      double t_near = -infinity, t_far = infinity;
+      int near_axis = -1, far_axis = -1;
+      for (int axis = 0; axis < 3; axis++) {
+        origin[axis] = dot(axes[axis], offset);
+        direction[axis] = dot(axes[axis], r.direction());
+
+        // Ray is parallel to the faces
+        if (direction[axis] == 0) {
+          if (std::fabs(origin[axis]) > half[axis]) {
+            return false;
+          }
+          continue;
+        }
+
+        const double inverse = 1 / direction[axis];
+        double t0 = (-half[axis] - origin[axis]) * inverse;
+        double t1 = (half[axis] - origin[axis]) * inverse;
+        if (t0 > t1) {
+          std::swap(t0, t1);
+        }
+        if (t0 > t_near) {
+          t_near = t0;
+          near_axis = axis;
+        }
+        if (t1 < t_far) {
+          t_far = t1;
+          far_axis = axis;
+        }
+      }
+
+      if (near_axis < 0 || t_near > t_far) {
+        return false;
+      }
+
+      // the face the ray enters by, or the one it leaves by from inside the box
+      double t;
+      int axis;
+      double side;
+      if (ray_t.contains(t_near)) {
+        t = t_near;
+        axis = near_axis;
+        side = direction[axis] > 0 ? -1 : 1;
+      }
+      else if (ray_t.contains(t_far)) {
+        t = t_far;
+        axis = far_axis;
+        side = direction[axis] > 0 ? 1 : -1;
+      }
+      else {
+        return false;
+      }
+
+      const int a = FACE_U_AXIS[axis];
+      const int b = FACE_V_AXIS[axis];
+      rec.u = face_coordinate(origin[a] + t * direction[a], a);
+      rec.v = face_coordinate(origin[b] + t * direction[b], b);
+      rec.t = t;
+      rec.p = r.at(t);
+      rec.mat = mat;
+      rec.entity = this;
+      rec.set_face_normal(r, side * axes[axis]);
+
+      return true;
+    }
+
+    /*
+     * Returns the density of sampling the given direction by picking a uniform point on the faces
+     * of the box seen from the given origin, converted from area to solid angle.
+     */
+    double pdf_value(const Point3& origin, const Vector3& direction) const override {
+      HitRecord rec;
+      if (!hit(Ray(origin, direction), Interval(0.001, infinity), rec)) {
+        return 0;
+      }
+
+      int visible;
+      const double area = visible_area(origin, visible);
+      double distance_squared = rec.t * rec.t * direction.length_squared();
+      double cosine = std::fabs(dot(direction, rec.normal) / direction.length());
+
+      return distance_squared / (cosine * area);
+    }
+
+    /*
+     * Returns the direction from the given origin to a uniformly chosen point on the faces of the
+     * box seen from it. A face is picked by its area, then a point on it.
+     */
+    Vector3 random(const Point3& origin, Sampler& sampler) const override {
+      int visible;
+      double pick = sampler.get_1d() * visible_area(origin, visible);
+
+      int face = 0;
+      for (int f = 0; f < 6; f++) {
+        if (!(visible & (1 << f))) {
+          continue;
+        }
+        face = f;
+        if (pick < face_area(f / 2)) {
+          break;
+        }
+        pick -= face_area(f / 2);
+      }
+
+      const int axis = face / 2;
+      const Vector3 uv = sampler.get_2d();
+      Point3 p = center + (face % 2 ? half[axis] : -half[axis]) * axes[axis];
+      p += (2 * uv.x() - 1) * half[FACE_U_AXIS[axis]] * axes[FACE_U_AXIS[axis]];
+      p += (2 * uv.y() - 1) * half[FACE_V_AXIS[axis]] * axes[FACE_V_AXIS[axis]];
+      return p - origin;
+    }
+
+    /*
+     * Bounds of the light of the box, which emits outwards from all of its faces. Textured
+     * emission is estimated by its value at the center.
+     */
+    LightBounds light_bounds() const override {
+      const Color emission = mat->emitted(0.5, 0.5, center);
+      const double area = 2 * (face_area(0) + face_area(1) + face_area(2));
+      const double power = pi * area * luminance(emission);
+      return LightBounds(bound_box, power, DirectionCone::entire_sphere(), 0, false);
+    }
+
+  private:
+    // axes along the u and v texture coordinates of the faces across the x, y and z axes
+    static constexpr int FACE_U_AXIS[3] = { 2, 0, 0 };
+    static constexpr int FACE_V_AXIS[3] = { 1, 2, 1 };
+
+    Point3 center;             // center of the box
+    Vector3 axes[3];           // x, y and z axes of the box
+    double half[3];            // half the size of the box along each of its axes
+    shared_ptr<Material> mat;  // material of the box
+    Aabb bound_box;            // bounding box of the box
+
+    /*
+     * Returns the texture coordinate of the given coordinate along the given axis of the box.
+     */
+    double face_coordinate(double x, int axis) const {
+      return half[axis] > 0 ? std::clamp((x + half[axis]) / (2 * half[axis]), 0.0, 1.0) : 0;
+    }
+
+    /*
+     * Returns the area of each of the two faces across the given axis.
+     */
+    double face_area(int axis) const {
+      return 4 * half[FACE_U_AXIS[axis]] * half[FACE_V_AXIS[axis]];
+    }
+
+    /*
+     * Returns the area of the faces seen from the given point and stores them in visible, as the
+     * bit 2 * axis + 1 for the face on the positive side of the axis and 2 * axis for the other.
+     * Every face is seen from inside the box.
+     */
+    double visible_area(const Point3& p, int& visible) const {
+      const Vector3 offset = p - center;
+      visible = 0;
+      for (int axis = 0; axis < 3; axis++) {
+        const double x = dot(axes[axis], offset);
+        if (x > half[axis]) {
+          visible |= 1 << (2 * axis + 1);
+        }
+        else if (x < -half[axis]) {
+          visible |= 1 << (2 * axis);
+        }
+      }
+      if (!visible) {
+        visible = 63;
+      }
+
+      double area = 0;
+      for (int f = 0; f < 6; f++) {
+        if (visible & (1 << f)) {
+          area += face_area(f / 2);
+        }
+      }
+      return area;
+    }
+};
+
+#endif //!BOX_H_
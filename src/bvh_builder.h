@@ -0,0 +1,698 @@
+#ifndef BVH_BUILDER_H_
+#define BVH_BUILDER_H_
+
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <iostream>
+#include <omp.h>
+
+#include "raymond.h"
+#include "vector3.h"
+#include "interval.h"
+#include "aabb.h"
+
+// default number of children per node used for traversal, override with -DRAYMOND_BVH_WIDTH=4 or 8
+#ifndef RAYMOND_BVH_WIDTH
+#define RAYMOND_BVH_WIDTH 2
+#endif
+
+// ==============================
+// BVHPrimitive class
+// ==============================
+
+/*
+ * Bounding box, centroid and index of one primitive as seen by the BVH builder.
+ */
+class BVHPrimitive {
+  public:
+    Aabb bounds;      // bounding box of the primitive
+    Point3 centroid;  // center of the bounding box of the primitive
+    uint32_t index;   // index of the primitive in the list it was built from
+
+    /*
+     * Constructs an empty build primitive.
+     */
+    BVHPrimitive() :
+      index(0) {
+      }
+
+    /*
+     * Constructs the build primitive from the given bounding box and index.
+     */
+    BVHPrimitive(const Aabb& bounds, uint32_t index) :
+      bounds(bounds),
+      centroid(0.5 * (bounds.x.min + bounds.x.max),
+               0.5 * (bounds.y.min + bounds.y.max),
+               0.5 * (bounds.z.min + bounds.z.max)),
+      index(index) {
+      }
+};
+
+// ==============================
+// LinearBVHNode class
+// ==============================
+
+/*
+ * One 32 byte node of a flattened BVH.
+ * Interior nodes store their first child right after themselves and the second child at offset.
+ * Leaf nodes store primitive_count primitives starting at offset.
+ */
+class alignas(32) LinearBVHNode {
+  public:
+    float bounds_min[3];       // lower corner of the bounding box, rounded down
+    float bounds_max[3];       // upper corner of the bounding box, rounded up
+    uint32_t offset;           // first primitive for leaves, second child for interior nodes
+    uint16_t primitive_count;  // number of primitives in a leaf, 0 for interior nodes
+    uint8_t axis;              // axis the interior node was split along
+    uint8_t pad;               // padding to 32 bytes
+
+    /*
+     * Stores the given bounding box, rounding it outwards to float precision.
+     */
+    void set_bounds(const Aabb& box) {
+      for (int axis = 0; axis < 3; axis++) {
+        const Interval& interval = box.axis_interval(axis);
+        bounds_min[axis] = round_down(interval.min);
+        bounds_max[axis] = round_up(interval.max);
+      }
+    }
+
+    /*
+     * Returns the stored bounding box.
+     */
+    Aabb get_bounds() const {
+      return Aabb(Interval(bounds_min[0], bounds_max[0]),
+                  Interval(bounds_min[1], bounds_max[1]),
+                  Interval(bounds_min[2], bounds_max[2]));
+    }
+
+    /*
+     * Returns true if this node is a leaf.
+     */
+    bool is_leaf() const {
+      return primitive_count > 0;
+    }
+
+    /*
+     * Slab test of the ray with the given origin and inverse direction against the node bounds.
+     * Returns true if the ray enters the box inside the given interval.
+     */
+    bool hit(const double origin[3], const double inv_dir[3], const Interval& ray_t) const {
+      double t_min = ray_t.min;
+      double t_max = ray_t.max;
+
+      for (int axis = 0; axis < 3; axis++) {
+        double t0 = (bounds_min[axis] - origin[axis]) * inv_dir[axis];
+        double t1 = (bounds_max[axis] - origin[axis]) * inv_dir[axis];
+
+        if (t1 < t0) {
+          std::swap(t0, t1);
+        }
+
+        // comparisons are written so that a NaN from 0 * inf leaves the interval untouched
+        t_min = t0 > t_min ? t0 : t_min;
+        t_max = t1 < t_max ? t1 : t_max;
+      }
+
+      return t_min <= t_max;
+    }
+
+  private:
+    /*
+     * Converts the value to the largest float not greater than it.
+     */
+    static float round_down(double value) {
+      float f = float(value);
+      return (double(f) > value) ? std::nextafter(f, -std::numeric_limits<float>::infinity()) : f;
+    }
+
+    /*
+     * Converts the value to the smallest float not less than it.
+     */
+    static float round_up(double value) {
+      float f = float(value);
+      return (double(f) < value) ? std::nextafter(f, std::numeric_limits<float>::infinity()) : f;
+    }
+};
+
+static_assert(sizeof(LinearBVHNode) == 32, "LinearBVHNode must be 32 bytes");
+
+// ==============================
+// BVHBuildOptions class
+// ==============================
+
+/*
+ * Strategy used to split a node in two.
+ */
+enum class BVHSplitMethod {
+  Median,  // split at the median centroid of the longest axis
+  SAH,     // binned surface area heuristic
+  LBVH,    // split at the highest differing bit of sorted Morton codes
+};
+
+/*
+ * Settings of the BVH builder and of its cost model.
+ */
+class BVHBuildOptions {
+  public:
+    BVHSplitMethod split = BVHSplitMethod::SAH;  // how interior nodes are split
+    int bins = 16;                               // number of centroid bins for the SAH split
+    int max_leaf_size = 4;                       // largest leaf the builder may create
+    double traversal_cost = 1.0;                 // cost of visiting an interior node
+    double intersection_cost = 1.0;              // cost of intersecting a single primitive
+    bool parallel = true;                        // build large trees with all OpenMP threads
+    int width = RAYMOND_BVH_WIDTH;               // children per node used for traversal, 2, 4 or 8
+};
+
+// ==============================
+// BVHStats class
+// ==============================
+
+/*
+ * Quality and build statistics of a built BVH.
+ */
+class BVHStats {
+  public:
+    size_t node_count = 0;           // total number of nodes
+    size_t leaf_count = 0;           // number of leaf nodes
+    size_t min_leaf_size = 0;        // fewest primitives in a leaf
+    size_t max_leaf_size = 0;        // most primitives in a leaf
+    double average_leaf_size = 0;    // average number of primitives per leaf
+    int max_depth = 0;               // depth of the deepest leaf, the root has depth 1
+    double sah_cost = 0;             // SAH cost of the tree relative to the area of the root
+    double build_seconds = 0;        // wall clock time spent building the tree
+    int width = 2;                   // children per node used for traversal
+    size_t wide_node_count = 0;      // number of nodes after collapsing to width, 0 for width 2
+};
+
+/*
+ * Prints the given BVH statistics as a single info line.
+ */
+inline void log_bvh_stats(const BVHStats& stats) {
+  std::clog << "[INFO]: Built BVH in " << stats.build_seconds << " seconds: "
+    << stats.node_count << " nodes, " << stats.leaf_count << " leaves ("
+    << stats.min_leaf_size << "-" << stats.max_leaf_size << ", avg " << stats.average_leaf_size
+    << " primitives), depth " << stats.max_depth << ", SAH cost " << stats.sah_cost << "\n";
+
+  if (stats.width > 2) {
+    std::clog << "[INFO]: Collapsed BVH to " << stats.wide_node_count << " nodes of width "
+      << stats.width << "\n";
+  }
+}
+
+// ==============================
+// BVHRangeBounds class
+// ==============================
+
+/*
+ * Bounding box of a range of build primitives together with the bounds of their centroids.
+ */
+class BVHRangeBounds {
+  public:
+    Aabb bounds = Aabb::empty;                                     // union of the primitive bounds
+    double centroid_min[3] = { infinity, infinity, infinity };     // lower corner of the centroids
+    double centroid_max[3] = { -infinity, -infinity, -infinity };  // upper corner of the centroids
+
+    /*
+     * Grows the bounds to include the given primitive.
+     */
+    void add(const BVHPrimitive& p) {
+      bounds = Aabb(bounds, p.bounds);
+      for (int a = 0; a < 3; a++) {
+        centroid_min[a] = std::fmin(centroid_min[a], p.centroid.e[a]);
+        centroid_max[a] = std::fmax(centroid_max[a], p.centroid.e[a]);
+      }
+    }
+
+    /*
+     * Grows the bounds to include the given bounds.
+     */
+    void merge(const BVHRangeBounds& other) {
+      bounds = Aabb(bounds, other.bounds);
+      for (int a = 0; a < 3; a++) {
+        centroid_min[a] = std::fmin(centroid_min[a], other.centroid_min[a]);
+        centroid_max[a] = std::fmax(centroid_max[a], other.centroid_max[a]);
+      }
+    }
+
+    /*
+     * Returns the axis along which the centroids are spread the widest.
+     */
+    int widest_axis() const {
+      int axis = 0;
+      for (int a = 1; a < 3; a++) {
+        if (centroid_max[a] - centroid_min[a] > centroid_max[axis] - centroid_min[axis]) {
+          axis = a;
+        }
+      }
+
+      return axis;
+    }
+};
+
+// ==============================
+// BVHBuilder class
+// ==============================
+
+/*
+ * Builds the depth first node array of a LinearBVH from a list of build primitives.
+ * Large trees are built with OpenMP tasks: the two halves of every big node are built as separate
+ * tasks into their own node arrays that are spliced together afterwards, and the bounds and SAH
+ * bins of the largest nodes are gathered by several tasks at once.
+ */
+class BVHBuilder {
+  public:
+    static constexpr size_t MAX_LEAF_PRIMITIVES = 255;     // leaves are never grown past this size
+    static constexpr int MAX_SAH_DEPTH = 32;               // deeper nodes fall back to median splits
+                                                           // to keep the tree shallow
+    static constexpr size_t PARALLEL_TASK_SIZE = 4096;     // nodes this large build their halves as tasks
+    static constexpr size_t PARALLEL_SCAN_SIZE = 1 << 16;  // nodes this large are scanned by several tasks
+
+    /*
+     * Constructs the builder with the given options.
+     */
+    BVHBuilder(const BVHBuildOptions& options) :
+      options(options) {
+      }
+
+    /*
+     * Builds the nodes over the given primitives.
+     * The primitives are reordered so that every leaf refers to a contiguous range of them.
+     */
+    std::vector<LinearBVHNode> build(std::vector<BVHPrimitive>& primitives) const {
+      std::vector<LinearBVHNode> nodes;
+      if (primitives.empty()) {
+        return nodes;
+      }
+
+      const bool parallel = options.parallel
+        && primitives.size() >= PARALLEL_TASK_SIZE
+        && omp_get_max_threads() > 1;
+
+      nodes.reserve(2 * primitives.size());
+
+      #pragma omp parallel if (parallel)
+      #pragma omp single
+      {
+        if (options.split == BVHSplitMethod::LBVH) {
+          build_lbvh(primitives, nodes, parallel);
+        }
+        else {
+          build_recursive(primitives, 0, primitives.size(), 1, nodes, parallel);
+        }
+      }
+
+      return nodes;
+    }
+
+  private:
+    BVHBuildOptions options;  // settings of the build
+
+    /*
+     * Computes the bounds of primitives [start, end), splitting the work into tasks for big ranges.
+     */
+    static BVHRangeBounds range_bounds(
+        const std::vector<BVHPrimitive>& primitives, size_t start, size_t end, bool parallel) {
+      BVHRangeBounds result;
+      const size_t span = end - start;
+
+      if (!parallel || span < PARALLEL_SCAN_SIZE) {
+        for (size_t i = start; i < end; i++) {
+          result.add(primitives[i]);
+        }
+        return result;
+      }
+
+      const size_t chunk_count = std::min<size_t>(64, span / (PARALLEL_SCAN_SIZE / 4));
+      std::vector<BVHRangeBounds> partial(chunk_count);
+
+      for (size_t c = 0; c < chunk_count; c++) {
+        #pragma omp task shared(partial, primitives) firstprivate(c)
+        {
+          size_t chunk_start = start + span * c / chunk_count;
+          size_t chunk_end = start + span * (c + 1) / chunk_count;
+          for (size_t i = chunk_start; i < chunk_end; i++) {
+            partial[c].add(primitives[i]);
+          }
+        }
+      }
+      #pragma omp taskwait
+
+      for (const BVHRangeBounds& p : partial) {
+        result.merge(p);
+      }
+
+      return result;
+    }
+
+    /*
+     * Writes a leaf over primitives [start, end) with the given bounds at node_index.
+     */
+    static uint32_t make_leaf(std::vector<LinearBVHNode>& nodes, uint32_t node_index,
+        const Aabb& bounds, size_t start, size_t end) {
+      LinearBVHNode& leaf = nodes[node_index];
+      leaf.set_bounds(bounds);
+      leaf.offset = uint32_t(start);
+      leaf.primitive_count = uint16_t(end - start);
+      leaf.axis = 0;
+      leaf.pad = 0;
+      return node_index;
+    }
+
+    /*
+     * Writes an interior node with the given bounds, second child and split axis at node_index.
+     */
+    static uint32_t make_interior(std::vector<LinearBVHNode>& nodes, uint32_t node_index,
+        const Aabb& bounds, uint32_t second_child, int axis) {
+      LinearBVHNode& interior = nodes[node_index];
+      interior.set_bounds(bounds);
+      interior.offset = second_child;
+      interior.primitive_count = 0;
+      interior.axis = uint8_t(axis);
+      interior.pad = 0;
+      return node_index;
+    }
+
+    /*
+     * Appends the nodes of a subtree that was built into its own array, moving its child offsets.
+     * Returns the index of the subtree root in nodes.
+     */
+    static uint32_t splice(std::vector<LinearBVHNode>& nodes, const std::vector<LinearBVHNode>& subtree) {
+      uint32_t base = uint32_t(nodes.size());
+      for (LinearBVHNode node : subtree) {
+        if (!node.is_leaf()) {
+          node.offset += base;
+        }
+        nodes.push_back(node);
+      }
+
+      return base;
+    }
+
+    /*
+     * Builds the two children [start, mid) and [mid, end) of a node, as tasks for big ranges,
+     * and appends them to nodes. build_child(start, end, out) must append one subtree to out.
+     * Returns the index of the second child.
+     */
+    template <typename BuildChild>
+    static uint32_t build_children(std::vector<LinearBVHNode>& nodes,
+        size_t start, size_t mid, size_t end, bool parallel, BuildChild build_child) {
+      if (!parallel || end - start < PARALLEL_TASK_SIZE) {
+        build_child(start, mid, nodes);
+        uint32_t second_child = uint32_t(nodes.size());
+        build_child(mid, end, nodes);
+        return second_child;
+      }
+
+      std::vector<LinearBVHNode> left;
+      std::vector<LinearBVHNode> right;
+
+      #pragma omp task shared(left, build_child) firstprivate(start, mid)
+      build_child(start, mid, left);
+
+      build_child(mid, end, right);
+      #pragma omp taskwait
+
+      splice(nodes, left);
+      return splice(nodes, right);
+    }
+
+    /*
+     * Partitions primitives [start, end) around the median centroid along the given axis.
+     * Returns the index of the first primitive of the second half.
+     */
+    static size_t split_median(std::vector<BVHPrimitive>& primitives, size_t start, size_t end, int axis) {
+      size_t mid = start + (end - start) / 2;
+      std::nth_element(primitives.begin() + start, primitives.begin() + mid, primitives.begin() + end,
+          [axis](const BVHPrimitive& a, const BVHPrimitive& b) {
+            return a.centroid.e[axis] < b.centroid.e[axis];
+          });
+      return mid;
+    }
+
+    /*
+     * Bins the centroids of primitives [start, end) along the given axis and evaluates the SAH cost
+     * of splitting between every pair of neighbouring bins. Big ranges are binned by several tasks.
+     * Returns the index of the first primitive of the second half, or start if a leaf is cheaper.
+     */
+    size_t split_sah(std::vector<BVHPrimitive>& primitives, size_t start, size_t end, int axis,
+        const BVHRangeBounds& range, bool parallel) const {
+      const int bin_count = std::clamp(options.bins, 2, 256);
+      const double centroid_min = range.centroid_min[axis];
+      const double scale = bin_count / (range.centroid_max[axis] - centroid_min);
+      const size_t span = end - start;
+
+      auto bin_of = [&](const BVHPrimitive& p) {
+        int b = int((p.centroid.e[axis] - centroid_min) * scale);
+        return std::clamp(b, 0, bin_count - 1);
+      };
+
+      // bin the range, in chunks of tasks when it is big
+      const size_t chunk_count = (parallel && span >= PARALLEL_SCAN_SIZE)
+        ? std::min<size_t>(64, span / (PARALLEL_SCAN_SIZE / 4)) : 1;
+      std::vector<size_t> counts(chunk_count * bin_count, 0);
+      std::vector<Aabb> bin_bounds(chunk_count * bin_count, Aabb::empty);
+
+      for (size_t c = 0; c < chunk_count; c++) {
+        #pragma omp task if (chunk_count > 1) shared(counts, bin_bounds, primitives, bin_of) firstprivate(c)
+        {
+          size_t chunk_start = start + span * c / chunk_count;
+          size_t chunk_end = start + span * (c + 1) / chunk_count;
+          for (size_t i = chunk_start; i < chunk_end; i++) {
+            size_t b = c * bin_count + bin_of(primitives[i]);
+            counts[b]++;
+            bin_bounds[b] = Aabb(bin_bounds[b], primitives[i].bounds);
+          }
+        }
+      }
+      #pragma omp taskwait
+
+      for (size_t c = 1; c < chunk_count; c++) {
+        for (int b = 0; b < bin_count; b++) {
+          counts[b] += counts[c * bin_count + b];
+          bin_bounds[b] = Aabb(bin_bounds[b], bin_bounds[c * bin_count + b]);
+        }
+      }
+
+      // sweep from the right to get the area and count of every suffix of bins
+      std::vector<double> right_cost(bin_count, 0);
+      Aabb right_box = Aabb::empty;
+      size_t right_count = 0;
+      for (int b = bin_count - 1; b > 0; b--) {
+        right_box = Aabb(right_box, bin_bounds[b]);
+        right_count += counts[b];
+        right_cost[b] = right_count ? right_count * right_box.surface_area() : 0;
+      }
+
+      // sweep from the left and keep the cheapest split, which lies after bin best_bin
+      int best_bin = -1;
+      double best_cost = infinity;
+      Aabb left_box = Aabb::empty;
+      size_t left_count = 0;
+      for (int b = 0; b < bin_count - 1; b++) {
+        left_box = Aabb(left_box, bin_bounds[b]);
+        left_count += counts[b];
+        if (left_count == 0 || left_count == span) {
+          continue;
+        }
+
+        double cost = left_count * left_box.surface_area() + right_cost[b + 1];
+        if (cost < best_cost) {
+          best_cost = cost;
+          best_bin = b;
+        }
+      }
+
+      if (best_bin < 0) {
+        return split_median(primitives, start, end, axis);
+      }
+
+      // compare the split against intersecting everything in one leaf
+      double split_cost = options.traversal_cost
+        + options.intersection_cost * best_cost / range.bounds.surface_area();
+      double leaf_cost = options.intersection_cost * span;
+      if (span <= size_t(options.max_leaf_size) && leaf_cost <= split_cost) {
+        return start;
+      }
+
+      auto middle = std::partition(primitives.begin() + start, primitives.begin() + end,
+          [&](const BVHPrimitive& p) { return bin_of(p) <= best_bin; });
+      return size_t(middle - primitives.begin());
+    }
+
+    /*
+     * Builds the subtree over primitives [start, end) at the given depth with median or SAH splits
+     * and appends it to nodes. Returns the index of the subtree root.
+     */
+    uint32_t build_recursive(std::vector<BVHPrimitive>& primitives, size_t start, size_t end,
+        int depth, std::vector<LinearBVHNode>& nodes, bool parallel) const {
+      uint32_t node_index = uint32_t(nodes.size());
+      nodes.emplace_back();
+
+      const BVHRangeBounds range = range_bounds(primitives, start, end, parallel);
+      const size_t span = end - start;
+      if (span == 1) {
+        return make_leaf(nodes, node_index, range.bounds, start, end);
+      }
+
+      int axis = range.widest_axis();
+      size_t mid;
+      if (range.centroid_max[axis] <= range.centroid_min[axis]) {
+        // all centroids coincide so no split can separate them
+        if (span <= MAX_LEAF_PRIMITIVES) {
+          return make_leaf(nodes, node_index, range.bounds, start, end);
+        }
+        mid = start + span / 2;
+      }
+      else if (options.split == BVHSplitMethod::Median || depth >= MAX_SAH_DEPTH) {
+        if (span <= size_t(options.max_leaf_size)) {
+          return make_leaf(nodes, node_index, range.bounds, start, end);
+        }
+        mid = split_median(primitives, start, end, axis);
+      }
+      else {
+        mid = split_sah(primitives, start, end, axis, range, parallel);
+        if (mid == start) {
+          return make_leaf(nodes, node_index, range.bounds, start, end);
+        }
+      }
+
+      uint32_t second_child = build_children(nodes, start, mid, end, parallel,
+          [&](size_t child_start, size_t child_end, std::vector<LinearBVHNode>& out) {
+            build_recursive(primitives, child_start, child_end, depth + 1, out, parallel);
+          });
+
+      return make_interior(nodes, node_index, range.bounds, second_child, axis);
+    }
+
+    // ==============================
+    // Morton code LBVH
+    // ==============================
+
+    /*
+     * Spreads the lower 21 bits of v so that there are two zero bits between each of them.
+     */
+    static uint64_t expand_bits(uint64_t v) {
+      v &= 0x1fffff;
+      v = (v | v << 32) & 0x1f00000000ffffull;
+      v = (v | v << 16) & 0x1f0000ff0000ffull;
+      v = (v | v << 8) & 0x100f00f00f00f00full;
+      v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+      v = (v | v << 2) & 0x1249249249249249ull;
+      return v;
+    }
+
+    /*
+     * Sorts codes [start, end) with a task parallel merge sort.
+     */
+    static void sort_codes(std::vector<std::pair<uint64_t, uint32_t>>& codes, size_t start, size_t end, bool parallel) {
+      if (!parallel || end - start < PARALLEL_SCAN_SIZE) {
+        std::sort(codes.begin() + start, codes.begin() + end);
+        return;
+      }
+
+      size_t mid = start + (end - start) / 2;
+      #pragma omp task shared(codes) firstprivate(start, mid)
+      sort_codes(codes, start, mid, parallel);
+
+      sort_codes(codes, mid, end, parallel);
+      #pragma omp taskwait
+
+      std::inplace_merge(codes.begin() + start, codes.begin() + mid, codes.begin() + end);
+    }
+
+    /*
+     * Sorts the primitives along a 63 bit Morton curve through their centroids and builds the
+     * hierarchy by splitting every range where the highest bit of the codes changes.
+     */
+    void build_lbvh(std::vector<BVHPrimitive>& primitives, std::vector<LinearBVHNode>& nodes, bool parallel) const {
+      const size_t count = primitives.size();
+      const BVHRangeBounds range = range_bounds(primitives, 0, count, parallel);
+
+      double scale[3];
+      for (int a = 0; a < 3; a++) {
+        double extent = range.centroid_max[a] - range.centroid_min[a];
+        scale[a] = extent > 0 ? double((1 << 21) - 1) / extent : 0;
+      }
+
+      std::vector<std::pair<uint64_t, uint32_t>> codes(count);
+
+      #pragma omp taskloop if (parallel) grainsize(PARALLEL_TASK_SIZE) shared(codes, primitives, range, scale)
+      for (size_t i = 0; i < count; i++) {
+        const Point3& c = primitives[i].centroid;
+        uint64_t x = uint64_t((c.e[0] - range.centroid_min[0]) * scale[0]);
+        uint64_t y = uint64_t((c.e[1] - range.centroid_min[1]) * scale[1]);
+        uint64_t z = uint64_t((c.e[2] - range.centroid_min[2]) * scale[2]);
+        codes[i] = { (expand_bits(x) << 2) | (expand_bits(y) << 1) | expand_bits(z), uint32_t(i) };
+      }
+
+      sort_codes(codes, 0, count, parallel);
+
+      // put the primitives in Morton order
+      std::vector<BVHPrimitive> sorted(count);
+      #pragma omp taskloop if (parallel) grainsize(PARALLEL_TASK_SIZE) shared(codes, primitives, sorted)
+      for (size_t i = 0; i < count; i++) {
+        sorted[i] = primitives[codes[i].second];
+      }
+      primitives.swap(sorted);
+
+      Aabb bounds;
+      build_lbvh_recursive(primitives, codes, 0, count, nodes, bounds, parallel);
+    }
+
+    /*
+     * Builds the subtree over the Morton sorted primitives [start, end), appends it to nodes and
+     * stores its bounding box in bounds. Returns the index of the subtree root.
+     */
+    uint32_t build_lbvh_recursive(const std::vector<BVHPrimitive>& primitives,
+        const std::vector<std::pair<uint64_t, uint32_t>>& codes, size_t start, size_t end,
+        std::vector<LinearBVHNode>& nodes, Aabb& bounds, bool parallel) const {
+      uint32_t node_index = uint32_t(nodes.size());
+      nodes.emplace_back();
+
+      const size_t span = end - start;
+      const uint64_t first_code = codes[start].first;
+      const uint64_t last_code = codes[end - 1].first;
+
+      if (span <= size_t(options.max_leaf_size) || (first_code == last_code && span <= MAX_LEAF_PRIMITIVES)) {
+        bounds = Aabb::empty;
+        for (size_t i = start; i < end; i++) {
+          bounds = Aabb(bounds, primitives[i].bounds);
+        }
+        return make_leaf(nodes, node_index, bounds, start, end);
+      }
+
+      size_t mid;
+      int axis = 0;
+      if (first_code == last_code) {
+        mid = start + span / 2;
+      }
+      else {
+        // the codes are sorted so the ones with the highest differing bit set form the upper part
+        int bit = 63 - __builtin_clzll(first_code ^ last_code);
+        uint64_t mask = uint64_t(1) << bit;
+        mid = size_t(std::partition_point(codes.begin() + start, codes.begin() + end,
+              [mask](const std::pair<uint64_t, uint32_t>& code) { return (code.first & mask) == 0; })
+            - codes.begin());
+
+        // bits are interleaved as ...xyz, so bit % 3 tells the axis
+        axis = 2 - bit % 3;
+      }
+
+      Aabb left_bounds;
+      Aabb right_bounds;
+      uint32_t second_child = build_children(nodes, start, mid, end, parallel,
+          [&](size_t child_start, size_t child_end, std::vector<LinearBVHNode>& out) {
+            Aabb& child_bounds = (child_start == start) ? left_bounds : right_bounds;
+            build_lbvh_recursive(primitives, codes, child_start, child_end, out, child_bounds, parallel);
+          });
+
+      bounds = Aabb(left_bounds, right_bounds);
+      return make_interior(nodes, node_index, bounds, second_child, axis);
+    }
+};
+
+#endif //!BVH_BUILDER_H_
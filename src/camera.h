@@ -6,7 +6,10 @@
 #include <fstream>
 #include <string>
 #include <iostream>
+#include <iomanip>
 #include <cmath>
+#include <algorithm>
+#include <vector>
 
 #include "raymond.h"
 #include "vector3.h"
@@ -15,7 +18,31 @@
 #include "interval.h"
 #include "entity.h"
 #include "image_buffer.h"
+#include "heatmap.h"
+#include "pixel_statistics.h"
+#include "sampler.h"
 #include "material.h"
+#include "ray_packet.h"
+#include "wavefront.h"
+#include "restir.h"
+#include "tile_scheduler.h"
+#include "render_telemetry.h"
+#include "trace_stats.h"
+#include "light_sampling.h"
+#include "light_sampler.h"
+
+// ==============================
+// CameraIntegrator enum
+// ==============================
+
+/*
+ * Algorithm used by the camera to estimate the color of each pixel.
+ */
+enum class CameraIntegrator {
+  Path,       // follows each path to its end before starting the next one
+  Wavefront,  // advances batches of paths one stage at a time, see WavefrontIntegrator
+  ReSTIR,     // direct light only preview that reuses light samples, see ReSTIRIntegrator
+};
 
 // ==============================
 // Camera class
@@ -25,7 +52,7 @@ class Camera {
   public:
     double aspect_ratio = 1.0;          // aspect ratio of the image produced by the camera
     int image_width = 100;              // width of the image produced by the camera in pixels
-    int samples_per_pixel = 10;         // number of samples to calculate per pixel
+    int samples_per_pixel = 10;         // number of samples to calculate per pixel, the most a pixel takes when adaptive
     int max_depth = 10;                 // maximum number of ray bounces to calculate
     double vfov = 90;                   // vertical field of view
     Point3 lookfrom = Point3(0, 0, 0);  // location of the camera
@@ -36,96 +63,192 @@ class Camera {
     double defocus_angle = 0;           // angle of defocus
     double focus_dist = 10;             // distance of focus from camera
 
+    uint64_t seed = 0;                  // seed of the per pixel random number generators
+    SamplerType sampler_type = SamplerType::Sobol;  // how the samples of a pixel are placed
+    int packet_size = 1;                // primary rays traced together for pinhole cameras (1, 4, 8 or 16)
+    int roulette_depth = 0;             // bounces after which Russian roulette may end paths, 0 disables it
+    bool light_sampling = true;         // cast shadow rays towards the lights at diffuse bounces
+    MISHeuristic mis_heuristic = MISHeuristic::Power;  // weights of light and material samples
+    LightSamplerType light_sampler = LightSamplerType::BVH;  // how the light of a shadow ray is picked
+    int restir_candidates = 4;          // lights streamed through each reservoir per pass of ReSTIR
+    int restir_neighbors = 5;           // nearby reservoirs merged into each pixel per pass of ReSTIR
+    int restir_history = 0;             // passes worth of candidates ReSTIR carries over, 0 disables it
+    CameraIntegrator integrator = CameraIntegrator::Path;  // algorithm used to render the image
+    double adaptive_threshold = 0;      // error at which a block of pixels stops taking samples, 0 disables adaptive sampling
+    int min_samples_per_pixel = 16;     // samples every pixel takes before adaptive sampling may stop it
+    std::string spp_heatmap;            // path of an image of the samples taken by every pixel, empty for none
+    int tile_size = 16;                 // width and height of the tiles threads render, a multiple of 8
+    std::string stats_json;             // path of a JSON summary of the render, empty for none
+
     /*
      * Renders the given list of entities to a P3 file at given file path
+     * The lights are sampled directly when light_sampling is enabled
+     * A heatmap of the samples taken by every pixel is written to spp_heatmap if it is set
+     * A summary of the render is written to stats_json if it is set
+     * Builds with RAYMOND_STATS also write heatmaps of the time, BVH nodes and primitive tests of
+     * every pixel next to the image, named after it with _time, _nodes and _tests appended
      */
-    void render(const Entity& world, const std::string& file_path) {
+    void render(const Entity& world, const std::string& file_path, const LightSampler* lights = nullptr) {
       const std::string extension = file_path.substr(file_path.size() - 4, 4);
 
+      ImageBuffer image_buffer(image_width, output_height());
+      render(world, image_buffer, lights);
+
+      image_buffer.write_to_file(file_path, extension);
+
+      if (!spp_heatmap.empty()) {
+        write_heatmap(spp_heatmap, sample_counts, image_width, image_height);
+        std::clog << "[INFO]: Wrote samples per pixel heatmap " << spp_heatmap << "\n";
+      }
+
+#ifdef RAYMOND_STATS
+      if (integrator == CameraIntegrator::Path) {
+        const std::string base = file_path.substr(0, file_path.size() - 4);
+        write_heatmap(base + "_time" + extension, pixel_seconds, image_width, image_height);
+        write_heatmap(base + "_nodes" + extension, pixel_nodes, image_width, image_height);
+        write_heatmap(base + "_tests" + extension, pixel_tests, image_width, image_height);
+        std::clog << "[INFO]: Wrote time, BVH node and primitive test heatmaps " << base << "_{time,nodes,tests}" << extension << "\n";
+      }
+#endif
+
+      if (!stats_json.empty()) {
+        std::ofstream file(stats_json);
+        if (!file) {
+          throw std::runtime_error("Failed to open stats file " + stats_json);
+        }
+        file << render_stats.dump(2) << "\n";
+        std::clog << "[INFO]: Wrote render stats " << stats_json << "\n";
+      }
+    }
+
+    /*
+     * Renders the given list of entities into the given image buffer of image_width by
+     * output_height() pixels
+     */
+    void render(const Entity& world, ImageBuffer& image_buffer, const LightSampler* lights = nullptr) {
       // Initialize private camera attributes based on values of public camera attributes
       initialize();
-      ImageBuffer image_buffer(image_width, image_height);
-      std::atomic<int> lines_done = 0;
+      scene_lights = (light_sampling && lights && !lights->lights.empty()) ? lights : nullptr;
 
       // setup openmp
       double start = omp_get_wtime();
       omp_set_num_threads(omp_get_max_threads());
 
-      // Trace rays for each pixel
-      #pragma omp parallel for schedule(dynamic)
-      for (int row = 0; row < image_height; row++) {
-
-        for (int col = 0; col < image_width; col++) {
-
-          Color pixel_color(0, 0, 0);
-          for (int sample = 0; sample < samples_per_pixel; sample++) {
-            Ray r = get_ray(col, row);
-            pixel_color += ray_color(r, max_depth, world);
-          }
-
-          image_buffer.get(row, col) = pixel_color * pixel_samples_scale;
-        }
-
-        int done = ++lines_done;
-        if (done % 1 == 0) {
-#pragma omp critical
-          {
-            std::cerr << "\rProgress: " << done << "/" << image_height
-              << " (" << (100 * done / image_height) << "%)" << std::flush;
-          }
-        }
+      // only the path integrator stops sampling pixels early, the others take every sample
+      sample_counts.assign(size_t(image_width) * image_height, samples_per_pixel);
+
+      // progress is counted in pixels, and in pixel passes for ReSTIR
+      const uint64_t pixel_count = uint64_t(image_width) * image_height;
+      const uint64_t total_work = (integrator == CameraIntegrator::ReSTIR) ? pixel_count * samples_per_pixel : pixel_count;
+      RenderTelemetry telemetry(omp_get_max_threads(), total_work);
+      tile_stats.clear();
+#ifdef RAYMOND_STATS
+      reset_trace_counters();
+      pixel_seconds.assign(pixel_count, 0);
+      pixel_nodes.assign(pixel_count, 0);
+      pixel_tests.assign(pixel_count, 0);
+#endif
+      telemetry.start();
+
+      uint64_t segments = 0;
+      if (integrator == CameraIntegrator::Wavefront) {
+        segments = render_wavefront(world, image_buffer, telemetry);
+      }
+      else if (integrator == CameraIntegrator::ReSTIR) {
+        segments = render_restir(world, image_buffer, telemetry);
+      }
+      else {
+        segments = render_paths(world, image_buffer, telemetry);
       }
 
+      telemetry.stop();
+
       // calculate render time
       double end = omp_get_wtime();
       std::clog << "\r[INFO]: Render completed in " << (end - start) << " seconds.\n";
 
-      if (extension == ".ppm") {
-        // Open the output file
-        std::ofstream image_file(file_path);
-        if (!image_file) {
-          std::cerr << "Failed to open output image file " << file_path << "\n";
-          return;
-        }
+      double path_count = 0;
+      for (int count : sample_counts) {
+        path_count += count;
+      }
 
-        // write the image file header
-        image_file << "P3\n" << image_width << ' ' << image_height << "\n255\n";
+      if (adaptive_threshold > 0 && integrator == CameraIntegrator::Path) {
+        const auto [fewest, most] = std::minmax_element(sample_counts.begin(), sample_counts.end());
+        std::clog << "[INFO]: Adaptive sampling took " << path_count / sample_counts.size()
+          << " samples per pixel on average, " << *fewest << " to " << *most << "\n";
+      }
 
-        // write image pixel values
-        for (int row = 0; row < image_height; row++) {
-          for (int col = 0; col < image_width; col++) {
-            write_color(image_file, image_buffer.get(row, col));
-          }
-        }
+      std::clog << "[INFO]: Average path length " << (path_count > 0 ? segments / path_count : 0)
+        << " rays\n";
 
-        // Close the image file
-        image_file.close();
+      for (size_t t = 0; t < tile_stats.size(); t++) {
+        std::clog << "[INFO]: Thread " << t << " rendered " << tile_stats[t].tiles << " tiles ("
+          << tile_stats[t].stolen << " stolen), busy " << tile_stats[t].busy_seconds << " seconds, idle "
+          << tile_stats[t].idle_seconds << " seconds\n";
       }
-      else {
-        image_buffer.write_to_file(file_path, extension);
+
+      render_stats = telemetry.summary();
+      render_stats["integrator"] = integrator_name();
+      render_stats["image_width"] = image_width;
+      render_stats["image_height"] = image_height;
+      render_stats["samples_per_pixel"] = samples_per_pixel;
+      render_stats["average_samples_per_pixel"] = path_count / sample_counts.size();
+      render_stats["average_path_length"] = path_count > 0 ? segments / path_count : 0;
+      for (size_t t = 0; t < tile_stats.size(); t++) {
+        render_stats["threads"][t]["tiles"] = tile_stats[t].tiles;
+        render_stats["threads"][t]["stolen"] = tile_stats[t].stolen;
+        render_stats["threads"][t]["idle_seconds"] = tile_stats[t].idle_seconds;
       }
+
+#ifdef RAYMOND_STATS
+      log_trace_stats(segments);
+#endif
+    }
+
+    /*
+     * Returns the summary of the last render: its time, rays and samples traced, throughput and
+     * the work done by every thread.
+     */
+    const nlohmann::json& stats() const {
+      return render_stats;
+    }
+
+    /*
+     * Returns the height of the rendered image in pixels
+     */
+    int output_height() const {
+      return std::max(1, int(image_width / aspect_ratio));
     }
 
   private:
+    static constexpr int ADAPTIVE_BLOCK_SIZE = 8;  // width and height of the blocks of adaptive sampling
+    static const int MAX_BLOCK_PIXELS = ADAPTIVE_BLOCK_SIZE * ADAPTIVE_BLOCK_SIZE;  // most pixels of a block
+
     int image_height;              // height of the image produced by the camera
     Point3 center;                 // location of camera center
     Point3 pixel00_loc;            // location of first pixel of the viewport
-    double pixel_samples_scale;    // sampling scale factor
     Vector3 pixel_delta_u;         // vector that represents the horizontal change between center of 2 pixels
     Vector3 pixel_delta_v;         // vector that represents the vertical change between center of 2 pixels/ v
     Vector3 u, v, w;               // u and v are unit vectors at center of camera that represents the plane of camera
                                    // w is a unit vector perpendicula to u and v that represents the direction the camera is facing
     Vector3 defocus_disk_u;        // horizontal defocus disk
     Vector3 defocus_disk_v;        // vertical defocus disk
+    const LightSampler* scene_lights = nullptr;  // lights sampled at diffuse bounces, null if disabled
+    std::vector<int> sample_counts;  // samples taken by every pixel of the last render in row order
+    std::vector<ThreadTileStats> tile_stats;  // tiles rendered by every thread in the last render, path only
+    nlohmann::json render_stats;     // summary of the last render
+#ifdef RAYMOND_STATS
+    std::vector<double> pixel_seconds;    // time spent on every pixel of the last render, path only
+    std::vector<uint64_t> pixel_nodes;    // BVH nodes visited for every pixel of the last render, path only
+    std::vector<uint64_t> pixel_tests;    // primitive tests for every pixel of the last render, path only
+#endif
 
     /*
      * Initialize private camera attributes based on values of public camera attributes before rendering
      */
     void initialize() {
       // Image attributes
-      image_height = int(image_width / aspect_ratio);
-      image_height = (image_height < 1) ? 1 : image_height;
-      pixel_samples_scale = 1.0 / samples_per_pixel;
+      image_height = output_height();
 
       // Camera vectors
 
@@ -159,18 +282,320 @@ class Camera {
       defocus_disk_v = v * defocus_radius;
     }
 
+    /*
+     * Renders the image by following one path at a time. The image is split into tiles that the
+     * threads take from a TileScheduler, and every finished tile is recorded in the telemetry.
+     * Returns the number of rays traced.
+     */
+    uint64_t render_paths(const Entity& world, ImageBuffer& image_buffer, RenderTelemetry& telemetry) {
+      // neighbouring pixels of pinhole cameras are traced together as packets of primary rays
+      const bool use_packets = packet_size > 1 && defocus_angle <= 0;
+
+      // tiles are made of whole adaptive sampling blocks and packet tiles, so that the image does not
+      // depend on the tile size
+      const int size = std::max(ADAPTIVE_BLOCK_SIZE, tile_size / ADAPTIVE_BLOCK_SIZE * ADAPTIVE_BLOCK_SIZE);
+      const int thread_count = omp_get_max_threads();
+      TileScheduler scheduler(image_width, image_height, size, thread_count);
+
+      uint64_t segments = 0;
+      const double start = omp_get_wtime();
+
+      #pragma omp parallel num_threads(thread_count) reduction(+:segments)
+      {
+        const int thread = omp_get_thread_num();
+        ThreadTileStats& stats = scheduler.stats[thread];
+        Tile tile;
+
+        while (scheduler.next(thread, tile)) {
+          const double tile_start = omp_get_wtime();
+          const uint64_t tile_segments = render_tile(tile, use_packets, world, image_buffer);
+          const double busy = omp_get_wtime() - tile_start;
+
+          uint64_t tile_samples = 0;
+          for (int row = tile.first_row; row < tile.last_row; row++) {
+            for (int col = tile.first_col; col < tile.last_col; col++) {
+              tile_samples += sample_counts[size_t(row) * image_width + col];
+            }
+          }
+
+          telemetry.record(thread, tile.pixel_count(), tile_segments, tile_samples, busy);
+          segments += tile_segments;
+          stats.busy_seconds += busy;
+          stats.tiles++;
+        }
+      }
+
+      const double elapsed = omp_get_wtime() - start;
+      for (ThreadTileStats& stats : scheduler.stats) {
+        stats.idle_seconds = std::max(0.0, elapsed - stats.busy_seconds);
+      }
+      tile_stats = scheduler.stats;
+
+      return segments;
+    }
+
+    /*
+     * Renders the image with the wavefront integrator. Returns the number of rays traced.
+     */
+    uint64_t render_wavefront(const Entity& world, ImageBuffer& image_buffer, RenderTelemetry& telemetry) const {
+      WavefrontIntegrator wavefront;
+      wavefront.image_width = image_width;
+      wavefront.image_height = image_height;
+      wavefront.samples_per_pixel = samples_per_pixel;
+      wavefront.max_depth = max_depth;
+      wavefront.background = background;
+      wavefront.seed = seed;
+      wavefront.sampler_type = sampler_type;
+      wavefront.roulette_depth = roulette_depth;
+      wavefront.lights = scene_lights;
+      wavefront.mis_heuristic = mis_heuristic;
+      wavefront.telemetry = &telemetry;
+
+      return wavefront.render(world, image_buffer, [this](int col, int row, Sampler& sampler) {
+        return get_ray(col, row, sampler);
+      });
+    }
+
+    /*
+     * Renders the image with the ReSTIR integrator, one pass per sample. Returns the number of
+     * rays traced.
+     */
+    uint64_t render_restir(const Entity& world, ImageBuffer& image_buffer, RenderTelemetry& telemetry) const {
+      ReSTIRIntegrator restir;
+      restir.image_width = image_width;
+      restir.image_height = image_height;
+      restir.passes = samples_per_pixel;
+      restir.max_depth = max_depth;
+      restir.background = background;
+      restir.seed = seed;
+      restir.sampler_type = sampler_type;
+      restir.candidates = restir_candidates;
+      restir.neighbors = restir_neighbors;
+      restir.history = restir_history;
+      restir.lights = scene_lights;
+      restir.telemetry = &telemetry;
+
+      return restir.render(world, image_buffer, [this](int col, int row, Sampler& sampler) {
+        return get_ray(col, row, sampler);
+      });
+    }
+
+    /*
+     * Returns true if the pixels of a block, which have all taken the same number of samples, need
+     * another sample each. Every pixel takes samples_per_pixel samples, unless adaptive sampling
+     * stops the block once it has taken min_samples_per_pixel and its estimated error has dropped to
+     * adaptive_threshold.
+     */
+    bool needs_samples(const PixelStatistics pixels[], int count) const {
+      const int taken = pixels[0].count;
+      if (taken >= samples_per_pixel) {
+        return false;
+      }
+
+      if (adaptive_threshold <= 0 || taken < min_samples_per_pixel) {
+        return true;
+      }
+
+      return block_error(pixels, count) > adaptive_threshold;
+    }
+
+#ifdef RAYMOND_STATS
+    /*
+     * Logs a table of the work done while tracing the last render, given the number of path rays
+     * it traced, and adds it to render_stats.
+     */
+    void log_trace_stats(uint64_t segments) {
+      const TraceCounters total = total_trace_counters();
+      const double rays = std::max<double>(1, segments + total.shadow_rays);
+
+      std::clog << "[INFO]: Trace statistics        total      per ray\n";
+      auto row = [&](const char* name, uint64_t value) {
+        std::clog << "[INFO]:   " << std::left << std::setw(20) << name << std::right << std::setw(12) << value
+          << std::setw(12) << std::fixed << std::setprecision(2) << value / rays << std::defaultfloat << "\n";
+      };
+      row("path rays", segments);
+      row("shadow rays", total.shadow_rays);
+      row("BVH nodes", total.bvh_nodes);
+      row("box tests", total.box_tests);
+      row("Sphere::hit", total.sphere_tests);
+      row("Quad::hit", total.quad_tests);
+      row("Box::hit", total.obb_tests);
+      row("triangle tests", total.triangle_tests);
+
+      nlohmann::json& trace = render_stats["trace"];
+      trace["path_rays"] = segments;
+      trace["shadow_rays"] = total.shadow_rays;
+      trace["bvh_nodes"] = total.bvh_nodes;
+      trace["box_tests"] = total.box_tests;
+      trace["sphere_tests"] = total.sphere_tests;
+      trace["quad_tests"] = total.quad_tests;
+      trace["obb_tests"] = total.obb_tests;
+      trace["triangle_tests"] = total.triangle_tests;
+      trace["rays_per_depth"] = nlohmann::json::array();
+
+      std::clog << "[INFO]:   path rays per depth:";
+      for (int depth = 0; depth < TraceCounters::MAX_DEPTH; depth++) {
+        if (total.rays_per_depth[depth] > 0) {
+          std::clog << " " << (depth + 1) << (depth + 1 == TraceCounters::MAX_DEPTH ? "+" : "") << ": "
+            << total.rays_per_depth[depth];
+        }
+        trace["rays_per_depth"].push_back(total.rays_per_depth[depth]);
+      }
+      std::clog << "\n";
+    }
+#endif
+
+    /*
+     * Returns the name of the integrator as it is written in scene files.
+     */
+    std::string integrator_name() const {
+      if (integrator == CameraIntegrator::Wavefront) {
+        return "wavefront";
+      }
+      else if (integrator == CameraIntegrator::ReSTIR) {
+        return "restir";
+      }
+      return "path";
+    }
+
+    /*
+     * Returns the width in pixels of the tile of pixels whose primary rays form one packet.
+     * Packets of 4, 8 and 16 rays cover tiles of 2x2, 4x2 and 4x4 pixels.
+     */
+    int packet_tile_width() const {
+      return (packet_size >= 8) ? 4 : 2;
+    }
+
+    /*
+     * Renders the given tile one block of pixels at a time, 8x8 pixels with adaptive sampling,
+     * otherwise a single pixel or a packet tile with packets. Returns the number of rays traced.
+     */
+    uint64_t render_tile(const Tile& tile, bool use_packets, const Entity& world, ImageBuffer& image_buffer) {
+      const int group_width = use_packets ? packet_tile_width() : 1;
+      const int group_height = use_packets ? packet_size / group_width : 1;
+      const int block_width = (adaptive_threshold > 0) ? ADAPTIVE_BLOCK_SIZE : group_width;
+      const int block_height = (adaptive_threshold > 0) ? ADAPTIVE_BLOCK_SIZE : group_height;
+      uint64_t segments = 0;
+
+      for (int first_row = tile.first_row; first_row < tile.last_row; first_row += block_height) {
+        for (int first_col = tile.first_col; first_col < tile.last_col; first_col += block_width) {
+          Tile block;
+          block.first_row = first_row;
+          block.last_row = std::min(first_row + block_height, tile.last_row);
+          block.first_col = first_col;
+          block.last_col = std::min(first_col + block_width, tile.last_col);
+
+          segments += render_block(block, use_packets, world, image_buffer);
+        }
+      }
+
+      return segments;
+    }
+
+    /*
+     * Renders the given block of pixels. The pixels of a block take their samples in rounds of one
+     * sample each until the block needs no more. With packets the primary rays of a round are
+     * traced as one packet per packet tile, the bounces continue one ray at a time.
+     * Each pixel draws from its own sampler in the same order whether packets are used or not,
+     * so the image does not depend on either them, the tiles or the thread count.
+     * Returns the number of rays traced.
+     */
+    uint64_t render_block(const Tile& block, bool use_packets, const Entity& world, ImageBuffer& image_buffer) {
+      const int group_width = use_packets ? packet_tile_width() : 1;
+      const int group_height = use_packets ? packet_size / group_width : 1;
+      uint64_t segments = 0;
+
+      int rows[MAX_BLOCK_PIXELS];
+      int cols[MAX_BLOCK_PIXELS];
+      Sampler samplers[MAX_BLOCK_PIXELS];
+      PixelStatistics pixels[MAX_BLOCK_PIXELS];
+      int group_ends[MAX_BLOCK_PIXELS];  // end of the pixels of every packet tile
+      int groups = 0;
+      int count = 0;
+
+      for (int group_row = block.first_row; group_row < block.last_row; group_row += group_height) {
+        for (int group_col = block.first_col; group_col < block.last_col; group_col += group_width) {
+          for (int row = group_row; row < std::min(group_row + group_height, block.last_row); row++) {
+            for (int col = group_col; col < std::min(group_col + group_width, block.last_col); col++) {
+              rows[count] = row;
+              cols[count] = col;
+              samplers[count] = Sampler(sampler_type, seed, samples_per_pixel, uint64_t(row) * image_width + col);
+              count++;
+            }
+          }
+          group_ends[groups++] = count;
+        }
+      }
+
+      while (max_depth > 0 && needs_samples(pixels, count)) {
+        for (int g = 0, start = 0; g < groups; start = group_ends[g++]) {
+          for (int i = start; i < group_ends[g]; i++) {
+            samplers[i].start_sample(pixels[i].count);
+          }
+
+#ifdef RAYMOND_STATS
+          const double cost_start = omp_get_wtime();
+          const TraceCounters counters_start = trace_counters();
+#endif
+
+          if (!use_packets) {
+            Ray r = get_ray(cols[start], rows[start], samplers[start]);
+            pixels[start].add(ray_color(r, world, samplers[start], segments));
+          }
+          else {
+            const int packet_count = group_ends[g] - start;
+            Ray rays[MAX_PACKET_SIZE];
+            Interval ray_t[MAX_PACKET_SIZE];
+            HitRecord records[MAX_PACKET_SIZE];
+
+            for (int k = 0; k < packet_count; k++) {
+              rays[k] = get_ray(cols[start + k], rows[start + k], samplers[start + k]);
+              ray_t[k] = Interval(0.001, infinity);
+            }
+
+            const uint32_t hits = world.hit_packet(rays, ray_t, records, packet_count);
+
+            for (int k = 0; k < packet_count; k++) {
+              const int i = start + k;
+              pixels[i].add(path_color(rays[k], hits & (1u << k), records[k], world, samplers[i], segments));
+            }
+          }
+
+#ifdef RAYMOND_STATS
+          // the pixels of a packet share its cost evenly
+          const double seconds = omp_get_wtime() - cost_start;
+          const TraceCounters& counters = trace_counters();
+          const int group_size = group_ends[g] - start;
+          for (int i = start; i < group_ends[g]; i++) {
+            const size_t pixel = size_t(rows[i]) * image_width + cols[i];
+            pixel_seconds[pixel] += seconds / group_size;
+            pixel_nodes[pixel] += (counters.bvh_nodes - counters_start.bvh_nodes) / group_size;
+            pixel_tests[pixel] += (counters.primitive_tests() - counters_start.primitive_tests()) / group_size;
+          }
+#endif
+        }
+      }
+
+      for (int i = 0; i < count; i++) {
+        image_buffer.get(rows[i], cols[i]) = pixels[i].mean();
+        sample_counts[size_t(rows[i]) * image_width + cols[i]] = pixels[i].count;
+      }
+
+      return segments;
+    }
+
     /*
      * Gets a random ray for sampling based in given pixel index i and j
      */
-    Ray get_ray(int i, int j) const {
-      const Vector3 offset = sample_square();
+    Ray get_ray(int i, int j, Sampler& sampler) const {
+      const Vector3 offset = sample_square(sampler);
       const Vector3 pixel_sample = pixel00_loc
         + ((i + offset.x()) * pixel_delta_u)
         + ((j + offset.y()) * pixel_delta_v);
 
-      const Point3 ray_origin = (defocus_angle <= 0) ? center : defocus_disk_sample();
+      const Point3 ray_origin = (defocus_angle <= 0) ? center : defocus_disk_sample(sampler);
       const Vector3 ray_direction = pixel_sample - ray_origin;
-      const double ray_time = random_double();
+      const double ray_time = random_double(sampler);
 
       return Ray(ray_origin, ray_direction, ray_time);
     }
@@ -178,15 +603,15 @@ class Camera {
     /*
      * Generates and retruns a random ray offset within the square of -0.5 to 0.5
      */
-    Vector3 sample_square() const {
-      return Vector3(random_double() - 0.5, random_double() - 0.5, 0);
+    Vector3 sample_square(Sampler& sampler) const {
+      return sampler.get_2d() - Vector3(0.5, 0.5, 0);
     }
 
     /*
      * Generates and returns a random ray for defocusing sample
      */
-    Point3 defocus_disk_sample() const {
-      Point3 p = random_in_unit_disk();
+    Point3 defocus_disk_sample(Sampler& sampler) const {
+      Point3 p = random_in_unit_disk(sampler);
       return center + (p[0] * defocus_disk_u) + (p[1] * defocus_disk_v);
     }
 
@@ -198,40 +623,81 @@ class Camera {
     }
 
     /*
-     * Calculates the color of the ray for a pixel
+     * Calculates the color of the ray for a pixel. Adds the number of rays traced to segments.
      */
-    Color ray_color(const Ray& r, int depth, const Entity &world) const {
-      // If max depth is reached return black color
-      if (depth <= 0) {
+    Color ray_color(const Ray& r, const Entity& world, Sampler& sampler, uint64_t& segments) const {
+      // A path without any bounce left is black
+      if (max_depth <= 0) {
         return Color(0, 0, 0);
       }
 
       HitRecord rec;
+      bool hit = world.hit(r, Interval(0.001, infinity), rec);
+      return path_color(r, hit, rec, world, sampler, segments);
+    }
 
-      // Check if ray hits any entity in the given world
-      if (world.hit(r, Interval(0.001, infinity), rec)) {
-        Ray scattered;
-        Color attenuation;
-        Color color_from_emission = rec.mat->emitted(rec.u, rec.v, rec.p);
-
-        // Calculate the scattered ray based on the material of the entity that has been hit by the ray
-        if (rec.mat->scatter(r, rec, attenuation, scattered)) {
-          // Recursive call the scattered ray
-          Color color_from_scatter = attenuation * ray_color(scattered, depth-1, world);
-          return color_from_scatter + color_from_emission;
+    /*
+     * Follows the path that starts with the given ray, whose first intersection has already been
+     * found, and returns the light it gathers. The path carries the product of the attenuations
+     * of its bounces instead of recursing, and once it has bounced roulette_depth times Russian
+     * roulette ends it with a probability that grows as its throughput drops.
+     * At diffuse and glossy bounces the lights are sampled with a shadow ray, and both that light
+     * and the emission found by the next bounce are weighted by multiple importance sampling.
+     * Adds the number of rays traced to segments.
+     */
+    Color path_color(Ray r, bool hit, HitRecord& rec, const Entity& world, Sampler& sampler, uint64_t& segments) const {
+      Color radiance(0, 0, 0);
+      Color throughput(1, 1, 1);
+      double bsdf_pdf = 0;  // density the lights compete with for the emission along r, 0 if they do not
+      Vector3 bsdf_normal;  // normal at the origin of r
+
+      for (int depth = 1; ; depth++) {
+        segments++;
+        RAYMOND_STAT(add_ray(depth));
+
+        // If nothing is hit, calculate the gradient value for the background
+        // Vector3 unit_direction = unit_vector(r.direction());
+        // const double a = 0.5 * (unit_direction.y() + 1.0);
+        // return gradient(COLOR_DARK_BLUE, COLOR_BLUE, a);
+
+        // Add the background color
+        if (!hit) {
+          radiance += throughput * background;
+          break;
         }
 
-        // If ray is not scattered, return emission color
-        return color_from_emission;
-      }
+        if (bsdf_pdf == 0) {
+          radiance += throughput * rec.mat->emitted(rec.u, rec.v, rec.p);
+        }
+        else if (rec.mat->is_emissive()) {
+          const double weight = emission_weight(r, bsdf_normal, bsdf_pdf, rec, *scene_lights, mis_heuristic);
+          radiance += throughput * rec.mat->emitted(rec.u, rec.v, rec.p) * weight;
+        }
+
+        // Sample the light arriving directly from the lights, as long as the path could still reach them
+        const bool sample_lights = scene_lights && depth < max_depth && !rec.mat->is_specular();
+        if (sample_lights) {
+          radiance += throughput * sample_direct_light(r, rec, world, *scene_lights, mis_heuristic, sampler);
+        }
+
+        // Sample the scattered ray based on the material of the entity that has been hit by the ray
+        ScatterRecord srec;
+        if (!rec.mat->sample(r, rec, srec, sampler) || depth >= max_depth) {
+          break;
+        }
+        bsdf_pdf = sample_lights ? srec.pdf : 0;
+        bsdf_normal = rec.normal;
+
+        throughput = throughput * srec.attenuation;
+        if (roulette_depth > 0 && depth >= roulette_depth && !survive_russian_roulette(throughput, sampler)) {
+          break;
+        }
 
-      // If nothing is hit, calculate the gradient value for the background
-      // Vector3 unit_direction = unit_vector(r.direction());
-      // const double a = 0.5 * (unit_direction.y() + 1.0);
-      // return gradient(COLOR_DARK_BLUE, COLOR_BLUE, a);
+        r = srec.scattered;
+        hit = world.hit(r, Interval(0.001, infinity), rec);
+      }
 
-      // Return the background color
-      return background;
+      return radiance;
     }
 };
 
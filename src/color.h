@@ -7,6 +7,7 @@
 
 #include "interval.h"
 #include "vector3.h"
+#include "sampler.h"
 
 // ==============================
 // Color class
@@ -160,6 +161,13 @@ inline Color operator/(const Color& v, double t) {
   return (1/t) * v;
 }
 
+/*
+ * Returns the perceived brightness of the given linear color.
+ */
+inline double luminance(const Color& c) {
+  return 0.2126 * c.e[0] + 0.7152 * c.e[1] + 0.0722 * c.e[2];
+}
+
 /*
  * Converts the component of color in linear space to gamma space.
  */
@@ -199,6 +207,21 @@ inline void write_color(std::ostream& out, const Color& color) {
   out << int(pixel[0]) << ' ' << int(pixel[1]) << ' ' << int(pixel[2]) << '\n';
 }
 
+/*
+ * Plays Russian roulette with a path of the given throughput. The path survives with a probability
+ * equal to its largest throughput component, capped at 1. Returns false if the path should end,
+ * otherwise divides the throughput by the survival probability so that the estimate stays unbiased.
+ */
+inline bool survive_russian_roulette(Color& throughput, Sampler& sampler) {
+  const double survival = std::fmin(1.0, std::fmax(throughput.e[0], std::fmax(throughput.e[1], throughput.e[2])));
+  if (random_double(sampler) >= survival) {
+    return false;
+  }
+
+  throughput /= survival;
+  return true;
+}
+
 // ==============================
 // Colors
 // ==============================
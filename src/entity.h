@@ -1,13 +1,18 @@
 #ifndef ENTITY_H
 #define ENTITY_H
 
+#include <cstdint>
+
 #include "raymond.h"
 #include "vector3.h"
 #include "ray.h"
 #include "interval.h"
 #include "aabb.h"
+#include "light_bounds.h"
+#include "sampler.h"
 
 class Material;
+class Entity;
 
 // ==============================
 // HitRecord class
@@ -22,6 +27,7 @@ class HitRecord {
     double u;                   // x coordinate of the hit on entity for texturing
     double v;                   // y coordinate of the hit on entity for texturing
     bool front_face;            // Did the ray hit the front face or the back face of the surface
+    const Entity* entity;       // Primitive that got hit, used to tell lights apart
 
     /*
      * Sets the value of front_face and normal based on the result of dot product of the ray and the
@@ -48,10 +54,53 @@ class Entity {
      */
     virtual bool hit(const Ray& r, Interval ray_t, HitRecord &rec) const = 0;
 
+    /*
+     * Tests count rays at once, each against its own interval. For every ray that hits, the hit is
+     * recorded in the matching HitRecord and the end of its interval is moved to the hit.
+     * Returns a bit mask of the rays that hit. Entities that can share work between coherent rays
+     * override this, the default traces the rays one by one.
+     */
+    virtual uint32_t hit_packet(const Ray rays[], Interval ray_t[], HitRecord recs[], int count) const {
+      uint32_t mask = 0;
+      for (int i = 0; i < count; i++) {
+        if (hit(rays[i], ray_t[i], recs[i])) {
+          ray_t[i].max = recs[i].t;
+          mask |= 1u << i;
+        }
+      }
+      return mask;
+    }
+
     /*
      * Returns the bounding box of the entity
      */
     virtual Aabb bounding_box() const = 0;
+
+    /*
+     * Returns the probability density, with respect to solid angle, of random(origin) choosing the
+     * given direction. Entities that can not be sampled return 0.
+     */
+    virtual double pdf_value(const Point3& origin, const Vector3& direction) const {
+      (void) origin, (void) direction;
+      return 0;
+    }
+
+    /*
+     * Returns a direction from the given origin towards a random point of the entity, used to
+     * sample light arriving from emissive entities.
+     */
+    virtual Vector3 random(const Point3& origin, Sampler& sampler) const {
+      (void) origin, (void) sampler;
+      return Vector3(1, 0, 0);
+    }
+
+    /*
+     * Returns the bounds of the light the entity emits, used to pick lights by their estimated
+     * contribution. Entities that do not emit return bounds with no power.
+     */
+    virtual LightBounds light_bounds() const {
+      return LightBounds();
+    }
 };
 
 #endif //!ENTITY_H
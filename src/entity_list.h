@@ -2,12 +2,14 @@
 #define ENTITY_LIST_H_
 
 #include <vector>
+#include <algorithm>
 
 #include "raymond.h"
 #include "ray.h"
 #include "interval.h"
 #include "aabb.h"
 #include "entity.h"
+#include "ray_packet.h"
 
 // ==============================
 // Entity class
@@ -66,6 +68,26 @@ class EntityList: public Entity {
       return hit_anything;
     }
 
+    /*
+     * Passes the packet to every entity in the list, keeping the nearest hit of each ray.
+     */
+    uint32_t hit_packet(const Ray rays[], Interval ray_t[], HitRecord recs[], int count) const override {
+      HitRecord temp_records[MAX_PACKET_SIZE];
+      uint32_t mask = 0;
+
+      for (const auto& e : list) {
+        uint32_t hits = e->hit_packet(rays, ray_t, temp_records, count);
+        mask |= hits;
+
+        for (; hits; hits &= hits - 1) {
+          int i = __builtin_ctz(hits);
+          recs[i] = temp_records[i];
+        }
+      }
+
+      return mask;
+    }
+
     /*
      * Returns the bounding box of the list of entities.
      */
@@ -73,6 +95,35 @@ class EntityList: public Entity {
       return bound_box;
     }
 
+    /*
+     * Returns the average of the densities of the entities in the list, matching random picking
+     * one of them uniformly.
+     */
+    double pdf_value(const Point3& origin, const Vector3& direction) const override {
+      if (list.empty()) {
+        return 0;
+      }
+
+      double sum = 0;
+      for (const auto& e : list) {
+        sum += e->pdf_value(origin, direction);
+      }
+
+      return sum / list.size();
+    }
+
+    /*
+     * Returns a direction towards a random point of a uniformly chosen entity in the list.
+     */
+    Vector3 random(const Point3& origin, Sampler& sampler) const override {
+      if (list.empty()) {
+        return Vector3(1, 0, 0);
+      }
+
+      int i = std::min(int(random_double(sampler) * list.size()), int(list.size()) - 1);
+      return list[i]->random(origin, sampler);
+    }
+
   private:
     Aabb bound_box;  // bounding box of the list of entities
 };
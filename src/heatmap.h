@@ -0,0 +1,58 @@
+#ifndef HEATMAP_H_
+#define HEATMAP_H_
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "color.h"
+#include "image_buffer.h"
+
+// ==============================
+// Heatmap functions
+// ==============================
+
+/*
+ * Returns the color of the heat ramp at t in [0, 1], going from black through blue, red and
+ * yellow to white.
+ */
+inline Color heat_color(double t) {
+  static const Color ramp[] = {
+    Color(0, 0, 0), Color(0.1, 0.1, 0.8), Color(0.9, 0.1, 0.1), Color(1, 0.9, 0.1), Color(1, 1, 1),
+  };
+  const int segments = sizeof(ramp) / sizeof(ramp[0]) - 1;
+
+  const double x = std::clamp(t, 0.0, 1.0) * segments;
+  const int i = std::min(int(x), segments - 1);
+  const double a = x - i;
+  return (1 - a) * ramp[i] + a * ramp[i + 1];
+}
+
+/*
+ * Writes the values of a width by height image, one per pixel in row order, to the given file path
+ * as a heatmap from the smallest value in black to the largest one in white.
+ */
+template <typename T>
+void write_heatmap(const std::string& file_path, const std::vector<T>& values, int width, int height) {
+  if (values.empty()) {
+    return;
+  }
+
+  const auto [low, high] = std::minmax_element(values.begin(), values.end());
+  const double range = double(*high) - double(*low);
+
+  ImageBuffer image_buffer(width, height);
+  for (int row = 0; row < height; row++) {
+    for (int col = 0; col < width; col++) {
+      const double t = (range > 0) ? (double(values[row * width + col]) - double(*low)) / range : 1;
+      const Color c = heat_color(t);
+
+      // the buffer is converted to gamma space when written, squaring keeps the ramp as it is
+      image_buffer.get(row, col) = c * c;
+    }
+  }
+
+  image_buffer.write_to_file(file_path, file_path.substr(file_path.size() - 4, 4));
+}
+
+#endif //!HEATMAP_H_
@@ -38,6 +38,17 @@ class Image {
       load(filepath);
     }
 
+    /*
+     * Constructs the image object over width x height pixels of 3 bytes each that are owned
+     * elsewhere, such as in a mapped scene cache, and must outlive the image.
+     */
+    Image(const unsigned char* data, int width, int height) :
+      pixels(data),
+      image_width(width),
+      image_height(height),
+      bytes_per_scanline(width * bytes_per_pixel) {
+      }
+
     /*
      * Destructs the image object by freeing the buffers.
      */
@@ -69,14 +80,21 @@ class Image {
      * Returns width of the image loaded. Returns 0 if no image is loaded.
      */
     int width() const {
-      return (fdata == nullptr) ? 0 : image_width;
+      return (pixels == nullptr) ? 0 : image_width;
     }
 
     /*
      * Returns height of the image loaded. Returns 0 if no image is loaded.
      */
     int height() const {
-      return (fdata == nullptr) ? 0 : image_height;
+      return (pixels == nullptr) ? 0 : image_height;
+    }
+
+    /*
+     * Returns the 3 byte pixels of the image row by row, null if no image is loaded.
+     */
+    const unsigned char* data() const {
+      return pixels;
     }
 
     /*
@@ -84,23 +102,24 @@ class Image {
      */
     const unsigned char *pixel_data(int x, int y) const {
       static unsigned char magenta[] = {255, 0, 255};
-      if (bdata == nullptr) {
+      if (pixels == nullptr) {
         return magenta;
       }
 
       x = clamp(x, 0, image_width);
       y = clamp(y, 0, image_height);
 
-      return bdata + y * bytes_per_scanline + x * bytes_per_pixel;
+      return pixels + y * bytes_per_scanline + x * bytes_per_pixel;
     }
 
   private:
-    const int bytes_per_pixel = 3;     // number of bytes per pixel
-    float *fdata = nullptr;            // pointer to store floating point data loaded by stb
-    unsigned char *bdata = nullptr;    // pointer to store byte data calculated from fdata
-    int image_width = 0;               // width of the image loaded
-    int image_height = 0;              // height of the image loaded
-    int bytes_per_scanline = 0;        // bytes for each line of the image
+    const int bytes_per_pixel = 3;          // number of bytes per pixel
+    float *fdata = nullptr;                 // pointer to store floating point data loaded by stb
+    unsigned char *bdata = nullptr;         // pointer to store byte data calculated from fdata
+    const unsigned char *pixels = nullptr;  // byte data read by pixel_data, bdata or borrowed memory
+    int image_width = 0;                    // width of the image loaded
+    int image_height = 0;                   // height of the image loaded
+    int bytes_per_scanline = 0;             // bytes for each line of the image
 
     /*
      * Clamps the given x value between low and high
@@ -145,6 +164,7 @@ class Image {
       for (int i = 0; i < total_bytes; i++, fptr++, bptr++) {
         *bptr = float_to_byte(*fptr);
       }
+      pixels = bdata;
     }
 };
 
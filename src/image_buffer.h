@@ -2,6 +2,8 @@
 #define IMAGE_BUFFER_H_
 
 #include <string>
+#include <fstream>
+#include <iostream>
 
 #include "color.h"
 
@@ -43,9 +45,36 @@ class ImageBuffer {
     }
 
     /*
-     * Write the current image buffer to the given file path using stbi
+     * Get color of given row and column of the pixel in the buffer
+     */
+    const Color& get(int row, int col) const {
+      return buffer[row * width + col];
+    }
+
+    /*
+     * Get width of the image in pixels
+     */
+    int get_width() const {
+      return width;
+    }
+
+    /*
+     * Get height of the image in pixels
+     */
+    int get_height() const {
+      return height;
+    }
+
+    /*
+     * Write the current image buffer to the given file path, as a P3 file for .ppm and using stbi
+     * for .jpg, .jpeg and .png
      */
     void write_to_file(const std::string& file_path, const std::string& extension) {
+      if (extension == ".ppm") {
+        write_to_ppm(file_path);
+        return;
+      }
+
       unsigned char* image = new unsigned char[width * height * 3];
 
       for (int row = 0; row < height; row++) {
@@ -76,6 +105,31 @@ class ImageBuffer {
     }
 
   private:
+    /*
+     * Write the current image buffer to the given file path as a P3 file
+     */
+    void write_to_ppm(const std::string& file_path) {
+      // Open the output file
+      std::ofstream image_file(file_path);
+      if (!image_file) {
+        std::cerr << "Failed to open output image file " << file_path << "\n";
+        return;
+      }
+
+      // write the image file header
+      image_file << "P3\n" << width << ' ' << height << "\n255\n";
+
+      // write image pixel values
+      for (int row = 0; row < height; row++) {
+        for (int col = 0; col < width; col++) {
+          write_color(image_file, get(row, col));
+        }
+      }
+
+      // Close the image file
+      image_file.close();
+    }
+
     int width;       // width of the image
     int height;      // height of the image
     Color *buffer;   // buffer to hold the color values of the pixels
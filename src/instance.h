@@ -0,0 +1,248 @@
+#ifndef INSTANCE_H_
+#define INSTANCE_H_
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+#include "raymond.h"
+#include "vector3.h"
+#include "ray.h"
+#include "interval.h"
+#include "aabb.h"
+#include "entity.h"
+#include "light_bounds.h"
+#include "ray_packet.h"
+
+// ==============================
+// Transform class
+// ==============================
+
+/*
+ * Uniform scale, then rotation around the x, y and z axes in that order, the same way as Box,
+ * then translation. Transforms of this kind keep angles, so that solid angles and the densities
+ * of sampling lights are the same in the space of an instance and in the world.
+ */
+class Transform {
+  public:
+    /*
+     * Constructs the transform scaling by the given factor, rotating by the given angles in
+     * radians and moving by the given offset.
+     */
+    Transform(double scale, const Vector3& rotations, const Vector3& offset) :
+      scale(scale),
+      inverse_scale(1 / scale),
+      offset(offset) {
+        for (int axis = 0; axis < 3; axis++) {
+          Vector3 e(0, 0, 0);
+          e[axis] = 1;
+          columns[axis] = e.rotate(rotations[0], 0).rotate(rotations[1], 1).rotate(rotations[2], 2);
+        }
+      }
+
+    /*
+     * Returns the given direction rotated into the world, keeping its length.
+     */
+    Vector3 rotate(const Vector3& v) const {
+      return v[0] * columns[0] + v[1] * columns[1] + v[2] * columns[2];
+    }
+
+    /*
+     * Returns the given point of the instance in the world.
+     */
+    Point3 to_world_point(const Point3& p) const {
+      return scale * rotate(p) + offset;
+    }
+
+    /*
+     * Returns the given vector of the instance in the world.
+     */
+    Vector3 to_world_vector(const Vector3& v) const {
+      return scale * rotate(v);
+    }
+
+    /*
+     * Returns the given point of the world in the instance.
+     */
+    Point3 to_local_point(const Point3& p) const {
+      return to_local_vector(p - offset);
+    }
+
+    /*
+     * Returns the given vector of the world in the instance. Rays keep their hit times, as their
+     * directions are scaled along with the distances.
+     */
+    Vector3 to_local_vector(const Vector3& v) const {
+      return inverse_scale * Vector3(dot(columns[0], v), dot(columns[1], v), dot(columns[2], v));
+    }
+
+    /*
+     * Returns the bounding box of the given box of the instance in the world.
+     */
+    Aabb to_world_box(const Aabb& box) const {
+      Point3 min(infinity, infinity, infinity);
+      Point3 max(-infinity, -infinity, -infinity);
+      for (int corner = 0; corner < 8; corner++) {
+        const Point3 p = to_world_point(Point3(corner & 1 ? box.x.max : box.x.min, corner & 2 ? box.y.max : box.y.min,
+              corner & 4 ? box.z.max : box.z.min));
+        for (int axis = 0; axis < 3; axis++) {
+          min[axis] = std::min(min[axis], p[axis]);
+          max[axis] = std::max(max[axis], p[axis]);
+        }
+      }
+      return Aabb(min, max);
+    }
+
+    /*
+     * Returns the factor the transform scales by.
+     */
+    double get_scale() const {
+      return scale;
+    }
+
+  private:
+    Vector3 columns[3];    // the x, y and z axes of the instance in the world
+    double scale;          // factor the instance is scaled by
+    double inverse_scale;  // 1 / scale
+    Vector3 offset;        // position of the origin of the instance in the world
+};
+
+// ==============================
+// Instance class
+// (derived from Entity class)
+// ==============================
+
+/*
+ * Places a shared prototype in the world through a transform. The prototype is usually a BVH
+ * over a group of entities and is traced in its own space, so that any number of instances cost
+ * one copy of its entities and acceleration structure plus a transform each, and the BVH over
+ * the world only holds the instances.
+ */
+class Instance : public Entity {
+  public:
+    /*
+     * Constructs the instance of the given prototype placed by the given transform. The given
+     * emitters are the parts of the prototype sampled as lights, which get an instance each that
+     * the lights of the scene can hold.
+     */
+    Instance(shared_ptr<Entity> prototype, const std::vector<shared_ptr<Entity>>& emitters,
+        const Transform& transform) :
+      Instance(prototype, transform) {
+        for (const shared_ptr<Entity>& emitter : emitters) {
+          this->emitters.push_back(make_shared<Instance>(emitter, transform));
+        }
+      }
+
+    /*
+     * Constructs the instance of the given prototype placed by the given transform.
+     */
+    Instance(shared_ptr<Entity> prototype, const Transform& transform) :
+      prototype(prototype),
+      transform(transform) {
+        bound_box = transform.to_world_box(prototype->bounding_box());
+      }
+
+    /*
+     * Traces the given ray through the prototype in the space of the instance and moves the hit
+     * recorded in the given HitRecord back into the world.
+     * Returns true if the ray hits, else returns false.
+     */
+    bool hit(const Ray& r, Interval ray_t, HitRecord& rec) const override {
+      const Ray local(transform.to_local_point(r.origin()), transform.to_local_vector(r.direction()), r.time());
+      if (!prototype->hit(local, ray_t, rec)) {
+        return false;
+      }
+
+      to_world(rec);
+      return true;
+    }
+
+    /*
+     * Traces the given rays through the prototype together, so that a prototype that shares work
+     * between coherent rays still can.
+     */
+    uint32_t hit_packet(const Ray rays[], Interval ray_t[], HitRecord recs[], int count) const override {
+      Ray local[MAX_PACKET_SIZE];
+      for (int i = 0; i < count; i++) {
+        local[i] = Ray(transform.to_local_point(rays[i].origin()), transform.to_local_vector(rays[i].direction()),
+            rays[i].time());
+      }
+
+      const uint32_t mask = prototype->hit_packet(local, ray_t, recs, count);
+      for (int i = 0; i < count; i++) {
+        if (mask & (1u << i)) {
+          to_world(recs[i]);
+        }
+      }
+      return mask;
+    }
+
+    /*
+     * Returns the bounding box of the instance
+     */
+    Aabb bounding_box() const override {
+      return bound_box;
+    }
+
+    /*
+     * Returns the density of the prototype sampling the given direction from the given origin,
+     * which the transform keeps.
+     */
+    double pdf_value(const Point3& origin, const Vector3& direction) const override {
+      return prototype->pdf_value(transform.to_local_point(origin), transform.to_local_vector(direction));
+    }
+
+    /*
+     * Returns the direction from the given origin to a random point of the prototype.
+     */
+    Vector3 random(const Point3& origin, Sampler& sampler) const override {
+      return transform.to_world_vector(prototype->random(transform.to_local_point(origin), sampler));
+    }
+
+    /*
+     * Bounds of the light of the prototype moved into the world, where its area and so its power
+     * grow with the square of the scale.
+     */
+    LightBounds light_bounds() const override {
+      LightBounds bounds = prototype->light_bounds();
+      if (bounds.power == 0) {
+        return bounds;
+      }
+
+      bounds.bounds = transform.to_world_box(bounds.bounds);
+      bounds.power *= transform.get_scale() * transform.get_scale();
+      bounds.normals.w = transform.rotate(bounds.normals.w);
+      return bounds;
+    }
+
+    /*
+     * Returns the instances of the emitters of the prototype placed like this instance.
+     */
+    const std::vector<shared_ptr<Instance>>& get_emitters() const {
+      return emitters;
+    }
+
+  private:
+    shared_ptr<Entity> prototype;                // entity placed by the instance
+    Transform transform;                         // from the space of the prototype to the world
+    Aabb bound_box;                              // bounding box of the instance
+    std::vector<shared_ptr<Instance>> emitters;  // emitters of the prototype placed like this instance
+
+    /*
+     * Moves the given hit on the prototype into the world. Hits on an emitter of the prototype
+     * are recorded as hits on its instance, which is what the lights of the scene hold.
+     */
+    void to_world(HitRecord& rec) const {
+      rec.p = transform.to_world_point(rec.p);
+      rec.normal = transform.rotate(rec.normal);
+
+      for (const shared_ptr<Instance>& emitter : emitters) {
+        if (rec.entity == emitter->prototype.get()) {
+          rec.entity = emitter.get();
+          break;
+        }
+      }
+    }
+};
+
+#endif //!INSTANCE_H_
@@ -0,0 +1,241 @@
+#ifndef LIGHT_BOUNDS_H_
+#define LIGHT_BOUNDS_H_
+
+#include <cmath>
+#include <algorithm>
+
+#include "raymond.h"
+#include "vector3.h"
+#include "aabb.h"
+
+// ==============================
+// Angle helper functions
+// ==============================
+
+/*
+ * Returns the arc cosine of x after clamping it to [-1, 1].
+ */
+inline double safe_acos(double x) {
+  return std::acos(std::clamp(x, -1.0, 1.0));
+}
+
+/*
+ * Returns the square root of x, or 0 when rounding made x slightly negative.
+ */
+inline double safe_sqrt(double x) {
+  return std::sqrt(std::max(0.0, x));
+}
+
+/*
+ * Returns cos(max(0, a - b)) given the sines and cosines of the angles a and b.
+ */
+inline double cos_sub_clamped(double sin_a, double cos_a, double sin_b, double cos_b) {
+  if (cos_a > cos_b) {
+    return 1;
+  }
+
+  return cos_a * cos_b + sin_a * sin_b;
+}
+
+/*
+ * Returns sin(max(0, a - b)) given the sines and cosines of the angles a and b.
+ */
+inline double sin_sub_clamped(double sin_a, double cos_a, double sin_b, double cos_b) {
+  if (cos_a > cos_b) {
+    return 0;
+  }
+
+  return sin_a * cos_b - cos_a * sin_b;
+}
+
+// ==============================
+// DirectionCone class
+// ==============================
+
+/*
+ * Set of directions within an angle of an axis, stored as the cosine of that angle.
+ */
+class DirectionCone {
+  public:
+    Vector3 w = Vector3(0, 0, 1);  // unit axis of the cone
+    double cos_theta = infinity;   // cosine of the half angle of the cone, infinity for an empty cone
+
+    /*
+     * Constructs an empty cone.
+     */
+    DirectionCone() {
+    }
+
+    /*
+     * Constructs the cone of directions within the angle whose cosine is cos_theta of the axis w.
+     */
+    DirectionCone(const Vector3& w, double cos_theta) :
+      w(unit_vector(w)),
+      cos_theta(cos_theta) {
+      }
+
+    /*
+     * Constructs the smallest cone that contains both of the given cones.
+     */
+    DirectionCone(const DirectionCone& a, const DirectionCone& b) {
+      if (a.is_empty() || b.is_empty()) {
+        *this = a.is_empty() ? b : a;
+        return;
+      }
+
+      // one cone may already hold the other
+      const double theta_a = safe_acos(a.cos_theta);
+      const double theta_b = safe_acos(b.cos_theta);
+      const double theta_d = safe_acos(dot(a.w, b.w));
+      if (std::min(theta_d + theta_b, pi) <= theta_a) {
+        *this = a;
+        return;
+      }
+      if (std::min(theta_d + theta_a, pi) <= theta_b) {
+        *this = b;
+        return;
+      }
+
+      // the merged cone spans from the far edge of a to the far edge of b
+      const double theta_o = (theta_a + theta_d + theta_b) / 2;
+      const Vector3 axis = cross(a.w, b.w);
+      if (theta_o >= pi || axis.length_squared() == 0) {
+        *this = entire_sphere();
+        return;
+      }
+
+      // rotate the axis of a towards b by theta_o - theta_a (Rodrigues' rotation formula)
+      const double theta_r = theta_o - theta_a;
+      const Vector3 k = unit_vector(axis);
+      w = unit_vector(a.w * std::cos(theta_r) + cross(k, a.w) * std::sin(theta_r)
+          + k * dot(k, a.w) * (1 - std::cos(theta_r)));
+      cos_theta = std::cos(theta_o);
+    }
+
+    /*
+     * Returns true if the cone holds no direction.
+     */
+    bool is_empty() const {
+      return cos_theta == infinity;
+    }
+
+    /*
+     * Returns the cone holding every direction.
+     */
+    static DirectionCone entire_sphere() {
+      return DirectionCone(Vector3(0, 0, 1), -1);
+    }
+};
+
+// ==============================
+// LightBounds class
+// ==============================
+
+/*
+ * Conservative summary of one or more lights used to estimate how much they can light a point:
+ * where they are, how much power they emit, and in which directions.
+ * Every point of the lights has its surface normal inside the normals cone and emits only into
+ * directions within the angle whose cosine is cos_theta_e of that normal.
+ */
+class LightBounds {
+  public:
+    Aabb bounds;            // bounding box of the lights
+    double power = 0;       // total emitted power, 0 for entities that do not emit
+    DirectionCone normals;  // cone holding the surface normals of the lights
+    double cos_theta_e = 1; // cosine of the largest angle from the normal that light is emitted at
+    bool two_sided = false; // whether the lights emit from both sides of their surfaces
+
+    /*
+     * Constructs the bounds of something that emits no light.
+     */
+    LightBounds() {
+    }
+
+    /*
+     * Constructs light bounds from its parts.
+     */
+    LightBounds(const Aabb& bounds, double power, const DirectionCone& normals, double cos_theta_e,
+        bool two_sided) :
+      bounds(bounds),
+      power(power),
+      normals(normals),
+      cos_theta_e(cos_theta_e),
+      two_sided(two_sided) {
+      }
+
+    /*
+     * Constructs the bounds of the lights of both of the given light bounds.
+     */
+    LightBounds(const LightBounds& a, const LightBounds& b) {
+      if (a.power == 0 || b.power == 0) {
+        *this = (a.power == 0) ? b : a;
+        return;
+      }
+
+      bounds = Aabb(a.bounds, b.bounds);
+      power = a.power + b.power;
+      normals = DirectionCone(a.normals, b.normals);
+      cos_theta_e = std::min(a.cos_theta_e, b.cos_theta_e);
+      two_sided = a.two_sided || b.two_sided;
+    }
+
+    /*
+     * Returns the center of the bounding box.
+     */
+    Point3 centroid() const {
+      return Point3((bounds.x.min + bounds.x.max) / 2, (bounds.y.min + bounds.y.max) / 2,
+          (bounds.z.min + bounds.z.max) / 2);
+    }
+
+    /*
+     * Returns an estimate of the light that the bounded lights can send to the point p on a
+     * surface with normal n, or 0 if they can not light it at all. The estimate uses the power, the
+     * distance to the box and the smallest angles between the box and the emission and surface
+     * normals that the bounds allow, so it never drops to 0 for a point that could be lit.
+     * Passing a zero normal skips the angle with the surface.
+     */
+    double importance(const Point3& p, const Vector3& n) const {
+      const Point3 pc = centroid();
+      const Vector3 diagonal(bounds.x.size(), bounds.y.size(), bounds.z.size());
+
+      // clamp the distance so that points inside the box do not blow up
+      const double distance_squared = std::max((p - pc).length_squared(), diagonal.length() / 2);
+      const Vector3 wi = unit_vector(p - pc);
+
+      // angle between the normal axis and the direction towards the point
+      double cos_theta_w = dot(normals.w, wi);
+      if (two_sided) {
+        cos_theta_w = std::fabs(cos_theta_w);
+      }
+      const double sin_theta_w = safe_sqrt(1 - cos_theta_w * cos_theta_w);
+
+      // half angle of the directions the box covers as seen from the point
+      const double radius_squared = diagonal.length_squared() / 4;
+      const double center_distance_squared = (p - pc).length_squared();
+      const double cos_theta_b = (center_distance_squared < radius_squared)
+        ? -1 : safe_sqrt(1 - radius_squared / center_distance_squared);
+      const double sin_theta_b = safe_sqrt(1 - cos_theta_b * cos_theta_b);
+
+      // smallest angle between an emission normal inside the cone and a direction to the point
+      const double sin_theta_o = safe_sqrt(1 - normals.cos_theta * normals.cos_theta);
+      const double cos_theta_x = cos_sub_clamped(sin_theta_w, cos_theta_w, sin_theta_o, normals.cos_theta);
+      const double sin_theta_x = sin_sub_clamped(sin_theta_w, cos_theta_w, sin_theta_o, normals.cos_theta);
+      const double cos_theta_p = cos_sub_clamped(sin_theta_x, cos_theta_x, sin_theta_b, cos_theta_b);
+      if (cos_theta_p <= cos_theta_e) {
+        return 0;
+      }
+
+      double result = power * cos_theta_p / distance_squared;
+
+      // smallest angle between the surface normal and a direction to the box
+      if (n.length_squared() > 0) {
+        const double cos_theta_i = std::fabs(dot(wi, n));
+        const double sin_theta_i = safe_sqrt(1 - cos_theta_i * cos_theta_i);
+        result *= cos_sub_clamped(sin_theta_i, cos_theta_i, sin_theta_b, cos_theta_b);
+      }
+
+      return std::max(result, 0.0);
+    }
+};
+
+#endif //!LIGHT_BOUNDS_H_
@@ -0,0 +1,322 @@
+#ifndef LIGHT_BVH_H_
+#define LIGHT_BVH_H_
+
+#include <cassert>
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <omp.h>
+
+#include "raymond.h"
+#include "vector3.h"
+#include "aabb.h"
+#include "entity.h"
+#include "light_bounds.h"
+#include "light_sampler.h"
+
+// ==============================
+// LightBVHNode class
+// ==============================
+
+/*
+ * Node of a LightBVH stored in depth first order. The first child of an interior node directly
+ * follows it, the second one is at second_child. Every leaf holds exactly one light.
+ */
+class LightBVHNode {
+  public:
+    LightBounds bounds;     // bounds of every light below the node
+    uint32_t second_child;  // index of the second child, unused for leaves
+    uint32_t light;         // index of the light of a leaf, unused for interior nodes
+    bool is_leaf;           // whether the node is a leaf
+};
+
+// ==============================
+// LightBVH class
+// (derived from LightSampler class)
+// ==============================
+
+/*
+ * Hierarchy over the lights whose nodes bound the position, power and emission directions of the
+ * lights below them. Sampling walks down from the root, choosing each child with a probability
+ * proportional to its estimated contribution at the shading point, so the lights that matter
+ * most there are picked most often no matter how many lights the scene has.
+ * Nodes are split along the axis and position that minimise the surface area orientation
+ * heuristic, which weighs the power of each side by the area of its box and the solid angle
+ * of its emission.
+ */
+class LightBVH : public LightSampler {
+  public:
+    static const int SPLIT_BINS = 12;    // candidate split positions tried along each axis
+    static const int MAX_DEPTH = 64;     // deepest leaf, the path to a light is kept in 64 bits
+
+    std::vector<LightBVHNode> nodes;     // nodes in depth first order, the root first
+    std::vector<uint64_t> light_paths;   // child choices from the root to the leaf of every light
+
+    /*
+     * Builds the hierarchy over the given lights. Lights that emit no power can never be picked.
+     */
+    LightBVH(const std::vector<shared_ptr<Entity>>& lights) :
+      LightSampler(lights),
+      light_paths(lights.size(), 0) {
+        double start = omp_get_wtime();
+
+        std::vector<std::pair<uint32_t, LightBounds>> build_lights;
+        for (uint32_t i = 0; i < lights.size(); i++) {
+          LightBounds bounds = lights[i]->light_bounds();
+          if (bounds.power > 0) {
+            build_lights.push_back({ i, bounds });
+          }
+        }
+
+        if (!build_lights.empty()) {
+          build(build_lights, 0, build_lights.size(), 0, 0);
+        }
+
+        std::clog << "[INFO]: Built light BVH in " << (omp_get_wtime() - start) << " seconds: "
+          << build_lights.size() << " lights, " << nodes.size() << " nodes\n";
+      }
+
+    /*
+     * Walks down from the root, choosing each child by its importance at the point p, and
+     * reuses what is left of u after each choice.
+     */
+    const Entity* sample(const Point3& p, const Vector3& n, double u, double& pmf) const override {
+      if (nodes.empty()) {
+        return nullptr;
+      }
+
+      // a single light that can not reach the point is never picked
+      if (nodes[0].is_leaf) {
+        if (nodes[0].bounds.importance(p, n) <= 0) {
+          return nullptr;
+        }
+        pmf = 1;
+        return lights[nodes[0].light].get();
+      }
+
+      uint32_t node_index = 0;
+      pmf = 1;
+
+      while (!nodes[node_index].is_leaf) {
+        const uint32_t first = node_index + 1;
+        const uint32_t second = nodes[node_index].second_child;
+        const double importance_first = nodes[first].bounds.importance(p, n);
+        const double importance_second = nodes[second].bounds.importance(p, n);
+        if (importance_first <= 0 && importance_second <= 0) {
+          return nullptr;
+        }
+
+        const double p_first = importance_first / (importance_first + importance_second);
+        if (u < p_first) {
+          node_index = first;
+          u = std::min(u / p_first, ONE_MINUS_EPSILON);
+          pmf *= p_first;
+        }
+        else {
+          node_index = second;
+          u = std::min((u - p_first) / (1 - p_first), ONE_MINUS_EPSILON);
+          pmf *= 1 - p_first;
+        }
+      }
+
+      return lights[nodes[node_index].light].get();
+    }
+
+    /*
+     * Follows the recorded path from the root to the leaf of the light and multiplies the
+     * probabilities of the choices along it.
+     */
+    double pmf(const Point3& p, const Vector3& n, const Entity* light) const override {
+      auto it = light_index.find(light);
+      if (it == light_index.end() || nodes.empty()) {
+        return 0;
+      }
+
+      if (nodes[0].is_leaf) {
+        return (lights[nodes[0].light].get() == light && nodes[0].bounds.importance(p, n) > 0) ? 1 : 0;
+      }
+
+      uint64_t path = light_paths[it->second];
+      uint32_t node_index = 0;
+      double result = 1;
+
+      while (!nodes[node_index].is_leaf) {
+        const uint32_t first = node_index + 1;
+        const uint32_t second = nodes[node_index].second_child;
+        const double importance_first = nodes[first].bounds.importance(p, n);
+        const double importance_second = nodes[second].bounds.importance(p, n);
+        if (importance_first <= 0 && importance_second <= 0) {
+          return 0;
+        }
+
+        const bool take_second = path & 1;
+        result *= (take_second ? importance_second : importance_first) / (importance_first + importance_second);
+        node_index = take_second ? second : first;
+        path >>= 1;
+      }
+
+      // the light has no leaf if it emits nothing
+      return (lights[nodes[node_index].light].get() == light) ? result : 0;
+    }
+
+  private:
+    static constexpr double ONE_MINUS_EPSILON = 0x1.fffffffffffffp-1;  // largest double below 1
+
+    /*
+     * Builds the subtree over lights [start, end) at the given depth, whose leaves are reached from
+     * the root by the choices in path. Returns the index of its root.
+     */
+    uint32_t build(std::vector<std::pair<uint32_t, LightBounds>>& build_lights, size_t start,
+        size_t end, int depth, uint64_t path) {
+      const uint32_t node_index = nodes.size();
+      nodes.push_back(LightBVHNode());
+
+      if (end - start == 1) {
+        nodes[node_index].bounds = build_lights[start].second;
+        nodes[node_index].light = build_lights[start].first;
+        nodes[node_index].is_leaf = true;
+        light_paths[build_lights[start].first] = path;
+        return node_index;
+      }
+
+      LightBounds bounds;
+      Aabb centroid_bounds = Aabb::empty;
+      for (size_t i = start; i < end; i++) {
+        bounds = LightBounds(bounds, build_lights[i].second);
+        const Point3 c = build_lights[i].second.centroid();
+        centroid_bounds = Aabb(centroid_bounds, Aabb(c, c));
+      }
+
+      // the heuristic may leave a single light on one side, so it is only used while a balanced
+      // split of the rest below the next level still ends within MAX_DEPTH
+      assert(depth < MAX_DEPTH);
+      size_t mid = start;
+      if (depth + 1 + ceil_log2(end - start) <= MAX_DEPTH) {
+        mid = split_saoh(build_lights, start, end, bounds, centroid_bounds);
+      }
+
+      // split in the middle of the list when the heuristic finds no split or the tree gets too deep
+      if (mid == start || mid == end) {
+        mid = (start + end) / 2;
+        const int axis = centroid_bounds.longest_axis();
+        std::nth_element(build_lights.begin() + start, build_lights.begin() + mid, build_lights.begin() + end,
+            [axis](const auto& a, const auto& b) {
+              return a.second.centroid()[axis] < b.second.centroid()[axis];
+            });
+      }
+
+      build(build_lights, start, mid, depth + 1, path);
+      const uint32_t second_child = build(build_lights, mid, end, depth + 1, path | (uint64_t(1) << depth));
+
+      nodes[node_index].bounds = bounds;
+      nodes[node_index].second_child = second_child;
+      nodes[node_index].is_leaf = false;
+      return node_index;
+    }
+
+    /*
+     * Partitions lights [start, end) at the cheapest binned split of any axis by the surface
+     * area orientation heuristic. Returns the first index of the second half, or start if no
+     * axis can be split.
+     */
+    static size_t split_saoh(std::vector<std::pair<uint32_t, LightBounds>>& build_lights, size_t start,
+        size_t end, const LightBounds& bounds, const Aabb& centroid_bounds) {
+      double best_cost = infinity;
+      int best_axis = -1;
+      int best_bin = -1;
+
+      for (int axis = 0; axis < 3; axis++) {
+        const Interval& extent = centroid_bounds.axis_interval(axis);
+        if (extent.size() <= 0) {
+          continue;
+        }
+
+        LightBounds bins[SPLIT_BINS];
+        for (size_t i = start; i < end; i++) {
+          const int b = bin_of(build_lights[i].second.centroid()[axis], extent);
+          bins[b] = LightBounds(bins[b], build_lights[i].second);
+        }
+
+        // costs of the bounds below and above every split between bins
+        LightBounds below[SPLIT_BINS - 1];
+        LightBounds above[SPLIT_BINS - 1];
+        LightBounds sweep;
+        for (int b = 0; b < SPLIT_BINS - 1; b++) {
+          sweep = LightBounds(sweep, bins[b]);
+          below[b] = sweep;
+        }
+        sweep = LightBounds();
+        for (int b = SPLIT_BINS - 1; b > 0; b--) {
+          sweep = LightBounds(sweep, bins[b]);
+          above[b - 1] = sweep;
+        }
+
+        for (int b = 0; b < SPLIT_BINS - 1; b++) {
+          const double cost = split_cost(below[b], bounds.bounds, axis) + split_cost(above[b], bounds.bounds, axis);
+          if (below[b].power > 0 && above[b].power > 0 && cost < best_cost) {
+            best_cost = cost;
+            best_axis = axis;
+            best_bin = b;
+          }
+        }
+      }
+
+      if (best_axis < 0) {
+        return start;
+      }
+
+      const Interval& extent = centroid_bounds.axis_interval(best_axis);
+      auto mid = std::partition(build_lights.begin() + start, build_lights.begin() + end,
+          [&](const auto& light) {
+            return bin_of(light.second.centroid()[best_axis], extent) <= best_bin;
+          });
+
+      return mid - build_lights.begin();
+    }
+
+    /*
+     * Returns the depth of a balanced tree over n leaves, the smallest d with 2^d >= n.
+     */
+    static int ceil_log2(size_t n) {
+      int d = 0;
+      while ((size_t(1) << d) < n) {
+        d++;
+      }
+      return d;
+    }
+
+    /*
+     * Returns the bin of the given centroid coordinate within the extent of the centroids.
+     */
+    static int bin_of(double coordinate, const Interval& extent) {
+      const int b = int(SPLIT_BINS * (coordinate - extent.min) / extent.size());
+      return std::clamp(b, 0, SPLIT_BINS - 1);
+    }
+
+    /*
+     * Cost of one side of a split: its power times the surface area of its box times the solid
+     * angle its emission can reach, with thin boxes split across their long axis penalised.
+     */
+    static double split_cost(const LightBounds& side, const Aabb& node_bounds, int axis) {
+      if (side.power == 0) {
+        return 0;
+      }
+
+      const double theta_o = safe_acos(side.normals.cos_theta);
+      const double theta_e = safe_acos(side.cos_theta_e);
+      const double theta_w = std::min(theta_o + theta_e, pi);
+      const double sin_theta_o = safe_sqrt(1 - side.normals.cos_theta * side.normals.cos_theta);
+      const double solid_angle = 2 * pi * (1 - side.normals.cos_theta)
+        + pi / 2 * (2 * theta_w * sin_theta_o - std::cos(theta_o - 2 * theta_w)
+            - 2 * theta_o * sin_theta_o + side.normals.cos_theta);
+
+      const double longest = std::max({ node_bounds.x.size(), node_bounds.y.size(), node_bounds.z.size() });
+      const double regularization = longest / node_bounds.axis_interval(axis).size();
+
+      return side.power * solid_angle * regularization * side.bounds.surface_area();
+    }
+};
+
+#endif //!LIGHT_BVH_H_
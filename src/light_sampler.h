@@ -0,0 +1,99 @@
+#ifndef LIGHT_SAMPLER_H_
+#define LIGHT_SAMPLER_H_
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+#include "raymond.h"
+#include "vector3.h"
+#include "entity.h"
+
+// ==============================
+// LightSamplerType enum
+// ==============================
+
+/*
+ * Strategy used to pick the light that a shadow ray is traced towards.
+ */
+enum class LightSamplerType {
+  Uniform,  // every light is equally likely, see UniformLightSampler
+  BVH,      // lights are picked by their estimated contribution, see LightBVH
+};
+
+// ==============================
+// LightSampler class
+// ==============================
+
+/*
+ * Picks one of the lights of a scene for a shading point. The lights must be primitives that
+ * record themselves as HitRecord::entity, so that the light found by a bounce can be looked up.
+ */
+class LightSampler {
+  public:
+    std::vector<shared_ptr<Entity>> lights;                  // lights that can be picked
+    std::unordered_map<const Entity*, uint32_t> light_index; // index of every light in lights
+
+    /*
+     * Constructs the sampler over the given lights.
+     */
+    LightSampler(const std::vector<shared_ptr<Entity>>& lights) :
+      lights(lights) {
+        for (uint32_t i = 0; i < lights.size(); i++) {
+          light_index[lights[i].get()] = i;
+        }
+      }
+
+    virtual ~LightSampler() = default;
+
+    /*
+     * Picks a light for the point p on a surface with normal n using the uniform random number u.
+     * Stores the probability of picking it in pmf.
+     * Returns the light, or nullptr if no light can reach the point.
+     */
+    virtual const Entity* sample(const Point3& p, const Vector3& n, double u, double& pmf) const = 0;
+
+    /*
+     * Returns the probability of sample() picking the given light for the point p on a surface with
+     * normal n, 0 if it is not one of the lights.
+     */
+    virtual double pmf(const Point3& p, const Vector3& n, const Entity* light) const = 0;
+};
+
+// ==============================
+// UniformLightSampler class
+// (derived from LightSampler class)
+// ==============================
+
+class UniformLightSampler : public LightSampler {
+  public:
+    /*
+     * Constructs the sampler over the given lights.
+     */
+    UniformLightSampler(const std::vector<shared_ptr<Entity>>& lights) :
+      LightSampler(lights) {
+      }
+
+    /*
+     * Picks every light with the same probability.
+     */
+    const Entity* sample(const Point3& p, const Vector3& n, double u, double& pmf) const override {
+      (void) p, (void) n;
+      if (lights.empty()) {
+        return nullptr;
+      }
+
+      pmf = 1.0 / lights.size();
+      return lights[std::min(size_t(u * lights.size()), lights.size() - 1)].get();
+    }
+
+    /*
+     * Every light has the same probability.
+     */
+    double pmf(const Point3& p, const Vector3& n, const Entity* light) const override {
+      (void) p, (void) n;
+      return light_index.count(light) ? 1.0 / lights.size() : 0;
+    }
+};
+
+#endif //!LIGHT_SAMPLER_H_
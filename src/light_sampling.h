@@ -0,0 +1,101 @@
+#ifndef LIGHT_SAMPLING_H_
+#define LIGHT_SAMPLING_H_
+
+#include "raymond.h"
+#include "vector3.h"
+#include "color.h"
+#include "ray.h"
+#include "interval.h"
+#include "entity.h"
+#include "light_sampler.h"
+#include "material.h"
+#include "trace_stats.h"
+
+// ==============================
+// MISHeuristic enum
+// ==============================
+
+/*
+ * Rule that splits the light found along a direction between the strategies that could have
+ * sampled it, in proportion to their densities (balance) or their squared densities (power).
+ */
+enum class MISHeuristic {
+  Balance,
+  Power,
+};
+
+// ==============================
+// Light sampling functions
+// ==============================
+
+/*
+ * Returns the weight of a sample drawn with density pdf when another strategy could have drawn the
+ * same direction with density other_pdf.
+ */
+inline double mis_weight(MISHeuristic heuristic, double pdf, double other_pdf) {
+  if (heuristic == MISHeuristic::Power) {
+    pdf *= pdf;
+    other_pdf *= other_pdf;
+  }
+
+  return pdf / (pdf + other_pdf);
+}
+
+/*
+ * Estimates the light that reaches the hit point in the given HitRecord directly from the given
+ * lights and leaves along r_in (next event estimation).
+ * The light sampler picks a light for the hit point and a direction towards a random point of it
+ * is traced as a shadow ray. If that light is the nearest entity along it, its emission is weighed
+ * by the material of the hit point, divided by the density of choosing that direction and
+ * multiplied by its MIS weight against the material sampling the same direction.
+ */
+inline Color sample_direct_light(const Ray& r_in, const HitRecord& rec, const Entity& world,
+    const LightSampler& lights, MISHeuristic heuristic, Sampler& sampler) {
+  double pick_pmf = 0;
+  const Entity* light = lights.sample(rec.p, rec.normal, random_double(sampler), pick_pmf);
+  if (!light) {
+    return Color(0, 0, 0);
+  }
+
+  const Vector3 direction = light->random(rec.p, sampler);
+
+  // light from below the surface can not leave along r_in, skip its shadow ray
+  const Color scattering = rec.mat->eval(r_in, rec, direction);
+  if (scattering.e[0] == 0 && scattering.e[1] == 0 && scattering.e[2] == 0) {
+    return Color(0, 0, 0);
+  }
+
+  const Ray shadow_ray(rec.p, direction, r_in.time());
+  RAYMOND_STAT(shadow_rays++);
+
+  HitRecord light_rec;
+  if (!world.hit(shadow_ray, Interval(0.001, infinity), light_rec) || light_rec.entity != light) {
+    return Color(0, 0, 0);
+  }
+
+  const Color emission = light_rec.mat->emitted(light_rec.u, light_rec.v, light_rec.p);
+  const double light_pdf = pick_pmf * light->pdf_value(rec.p, direction);
+  if (light_pdf <= 0) {
+    return Color(0, 0, 0);
+  }
+
+  const double weight = mis_weight(heuristic, light_pdf, rec.mat->pdf(r_in, rec, direction));
+  return scattering * emission * (weight / light_pdf);
+}
+
+/*
+ * Returns the MIS weight of the emission that the ray r found at the hit in rec, when the material
+ * at the origin of r, whose normal is normal, sampled r with density bsdf_pdf and the lights could
+ * have picked the same direction too.
+ */
+inline double emission_weight(const Ray& r, const Vector3& normal, double bsdf_pdf, const HitRecord& rec,
+    const LightSampler& lights, MISHeuristic heuristic) {
+  const double pick_pmf = lights.pmf(r.origin(), normal, rec.entity);
+  if (pick_pmf <= 0) {
+    return 1;
+  }
+
+  return mis_weight(heuristic, bsdf_pdf, pick_pmf * rec.entity->pdf_value(r.origin(), r.direction()));
+}
+
+#endif //!LIGHT_SAMPLING_H_
@@ -0,0 +1,487 @@
+#ifndef LINEAR_BVH_H_
+#define LINEAR_BVH_H_
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <stdexcept>
+#include <omp.h>
+
+#include "raymond.h"
+#include "ray.h"
+#include "interval.h"
+#include "aabb.h"
+#include "entity.h"
+#include "entity_list.h"
+#include "bvh_builder.h"
+#include "wide_bvh.h"
+#include "ray_packet.h"
+#include "trace_stats.h"
+
+// ==============================
+// LinearBVHTree class
+// ==============================
+
+/*
+ * Pointer free BVH stored as a single depth first array of nodes.
+ * The tree only knows primitive bounds, the owner decides how its leaves are intersected.
+ * The nodes are either built into the tree or attached from memory owned elsewhere, such as a
+ * mapped scene cache.
+ */
+class LinearBVHTree {
+  public:
+    static const int MAX_DEPTH = 128;  // deepest tree the traversal stack can hold
+
+    std::vector<LinearBVHNode> nodes;  // depth first array of built nodes, root at index 0
+    BVHBuildOptions options;           // settings used to build the tree
+
+    /*
+     * Builds the tree over the given primitives.
+     * The primitives are reordered so that every leaf refers to a contiguous range of them.
+     */
+    void build(std::vector<BVHPrimitive>& primitives) {
+      nodes = BVHBuilder(options).build(primitives);
+      attached_nodes = nullptr;
+      attached_count = 0;
+    }
+
+    /*
+     * Traverses the given nodes, laid out like built ones, instead of building a tree. The nodes
+     * must stay alive as long as the tree is used.
+     */
+    void attach(const LinearBVHNode* data, size_t count) {
+      nodes.clear();
+      attached_nodes = data;
+      attached_count = count;
+    }
+
+    /*
+     * Returns true if the given nodes form a tree the traversal can walk safely: every interior
+     * node has its two subtrees in order within the array, every leaf refers to primitives below
+     * primitive_count and no leaf is deeper than MAX_DEPTH. Used on nodes read from a file.
+     */
+    static bool is_valid(const LinearBVHNode* data, size_t count, size_t primitive_count) {
+      if (count == 0) {
+        return true;
+      }
+
+      // (first node, end of the subtree, depth) of the subtrees still to check
+      struct Subtree {
+        size_t index;
+        size_t end;
+        int depth;
+      };
+      std::vector<Subtree> pending = { {0, count, 1} };
+      while (!pending.empty()) {
+        const Subtree subtree = pending.back();
+        pending.pop_back();
+
+        const LinearBVHNode& node = data[subtree.index];
+        if (subtree.depth > MAX_DEPTH) {
+          return false;
+        }
+
+        if (node.is_leaf()) {
+          if (subtree.end != subtree.index + 1 || size_t(node.offset) + node.primitive_count > primitive_count) {
+            return false;
+          }
+          continue;
+        }
+
+        if (node.axis > 2 || node.offset <= subtree.index + 1 || node.offset >= subtree.end) {
+          return false;
+        }
+        pending.push_back({ subtree.index + 1, node.offset, subtree.depth + 1 });
+        pending.push_back({ node.offset, subtree.end, subtree.depth + 1 });
+      }
+
+      return true;
+    }
+
+    /*
+     * Returns the nodes traversed, built or attached.
+     */
+    const LinearBVHNode* node_data() const {
+      return attached_nodes ? attached_nodes : nodes.data();
+    }
+
+    /*
+     * Returns the number of nodes traversed.
+     */
+    size_t size() const {
+      return attached_nodes ? attached_count : nodes.size();
+    }
+
+    /*
+     * Returns the bounding box of the whole tree.
+     */
+    Aabb bounding_box() const {
+      if (size() == 0) {
+        return Aabb::empty;
+      }
+
+      return node_data()[0].get_bounds();
+    }
+
+    /*
+     * Walks the tree with an explicit stack, visiting the near child first based on the sign of
+     * the ray direction along the split axis.
+     * For every leaf the ray enters, hit_leaf(first, count, ray_t) is called with the range of
+     * primitives in the leaf. It must return true on a hit and shrink ray_t.max to the hit distance.
+     * Returns true if any leaf reported a hit.
+     */
+    template <typename LeafFunction>
+    bool traverse(const Ray& r, Interval& ray_t, LeafFunction hit_leaf) const {
+      if (size() == 0) {
+        return false;
+      }
+
+      const LinearBVHNode* tree_nodes = node_data();
+
+      const Point3& ray_orig = r.origin();
+      const Vector3& ray_dir = r.direction();
+      const double origin[3] = { ray_orig.e[0], ray_orig.e[1], ray_orig.e[2] };
+      const double inv_dir[3] = { 1.0 / ray_dir.e[0], 1.0 / ray_dir.e[1], 1.0 / ray_dir.e[2] };
+      const bool dir_is_neg[3] = { inv_dir[0] < 0, inv_dir[1] < 0, inv_dir[2] < 0 };
+
+      uint32_t stack[MAX_DEPTH];
+      int stack_size = 0;
+      uint32_t current = 0;
+      bool hit_anything = false;
+
+      while (true) {
+        const LinearBVHNode& node = tree_nodes[current];
+        RAYMOND_STAT(bvh_nodes++);
+        RAYMOND_STAT(box_tests++);
+
+        if (node.hit(origin, inv_dir, ray_t)) {
+          if (node.is_leaf()) {
+            if (hit_leaf(node.offset, node.primitive_count, ray_t)) {
+              hit_anything = true;
+            }
+
+            if (stack_size == 0) {
+              break;
+            }
+            current = stack[--stack_size];
+          }
+          else if (dir_is_neg[node.axis]) {
+            stack[stack_size++] = current + 1;
+            current = node.offset;
+          }
+          else {
+            stack[stack_size++] = node.offset;
+            current = current + 1;
+          }
+        }
+        else {
+          if (stack_size == 0) {
+            break;
+          }
+          current = stack[--stack_size];
+        }
+      }
+
+      return hit_anything;
+    }
+
+    /*
+     * Walks the tree once for a packet of up to K coherent rays. A node is entered when any ray of
+     * the packet hits its box, and children are visited near first based on the direction of the
+     * first ray.
+     * For every leaf entered, hit_leaf(first, count, lanes) is called with the bit mask of the rays
+     * that hit the leaf box. It must return the mask of the rays that hit a primitive and shrink
+     * their ray_t.max to the hit distance. Returns the mask of all rays that hit.
+     */
+    template <int K, typename LeafFunction>
+    uint32_t traverse_packet(const Ray rays[], Interval ray_t[], int count, LeafFunction hit_leaf) const {
+      if (size() == 0) {
+        return 0;
+      }
+
+      const LinearBVHNode* tree_nodes = node_data();
+
+      RayPacket<K> packet(rays, ray_t, count);
+
+      uint32_t stack[MAX_DEPTH];
+      int stack_size = 0;
+      uint32_t current = 0;
+      uint32_t hit_mask = 0;
+
+      while (true) {
+        const LinearBVHNode& node = tree_nodes[current];
+        const uint32_t lanes = packet.intersect(node);
+        RAYMOND_STAT(bvh_nodes++);
+        RAYMOND_STAT(box_tests += count);
+
+        if (lanes && node.is_leaf()) {
+          uint32_t hits = hit_leaf(node.offset, node.primitive_count, lanes);
+          hit_mask |= hits;
+
+          for (; hits; hits &= hits - 1) {
+            int i = __builtin_ctz(hits);
+            packet.t_max[i] = float(ray_t[i].max);
+          }
+        }
+        else if (lanes) {
+          if (packet.neg[node.axis]) {
+            stack[stack_size++] = current + 1;
+            current = node.offset;
+          }
+          else {
+            stack[stack_size++] = node.offset;
+            current = current + 1;
+          }
+          continue;
+        }
+
+        if (stack_size == 0) {
+          break;
+        }
+        current = stack[--stack_size];
+      }
+
+      return hit_mask;
+    }
+
+    /*
+     * Walks the built tree and returns its node count, depth, leaf sizes and SAH cost.
+     */
+    BVHStats compute_stats() const {
+      BVHStats stats;
+      if (size() == 0) {
+        return stats;
+      }
+
+      const LinearBVHNode* tree_nodes = node_data();
+      stats.node_count = size();
+      stats.min_leaf_size = std::numeric_limits<size_t>::max();
+
+      double root_area = node_area(tree_nodes[0]);
+      size_t primitive_total = 0;
+
+      // (node index, depth) pairs still to visit
+      std::vector<std::pair<uint32_t, int>> pending = { {0, 1} };
+      while (!pending.empty()) {
+        auto [index, depth] = pending.back();
+        pending.pop_back();
+
+        const LinearBVHNode& node = tree_nodes[index];
+        double relative_area = root_area > 0 ? node_area(node) / root_area : 1;
+        stats.max_depth = std::max(stats.max_depth, depth);
+
+        if (node.is_leaf()) {
+          stats.leaf_count++;
+          stats.min_leaf_size = std::min(stats.min_leaf_size, size_t(node.primitive_count));
+          stats.max_leaf_size = std::max(stats.max_leaf_size, size_t(node.primitive_count));
+          primitive_total += node.primitive_count;
+          stats.sah_cost += options.intersection_cost * node.primitive_count * relative_area;
+        }
+        else {
+          stats.sah_cost += options.traversal_cost * relative_area;
+          pending.push_back({index + 1, depth + 1});
+          pending.push_back({node.offset, depth + 1});
+        }
+      }
+
+      stats.average_leaf_size = double(primitive_total) / stats.leaf_count;
+      return stats;
+    }
+
+  private:
+    const LinearBVHNode* attached_nodes = nullptr;  // nodes owned elsewhere, null when built
+    size_t attached_count = 0;                      // number of attached nodes
+
+    /*
+     * Surface area of the bounding box of the given node.
+     */
+    static double node_area(const LinearBVHNode& node) {
+      double dx = node.bounds_max[0] - node.bounds_min[0];
+      double dy = node.bounds_max[1] - node.bounds_min[1];
+      double dz = node.bounds_max[2] - node.bounds_min[2];
+      return 2 * (dx * dy + dy * dz + dz * dx);
+    }
+};
+
+// ==============================
+// LinearBVH class
+// (derived from Entity class)
+// ==============================
+
+class LinearBVH : public Entity {
+  public:
+    /*
+     * Constructs the linear BVH over all the entities provided in the entity list.
+     */
+    LinearBVH(const EntityList& el, const BVHBuildOptions& options = BVHBuildOptions()) :
+      LinearBVH(el.list, options) {
+    }
+
+    /*
+     * Constructs the linear BVH over the given entities using the given build options.
+     */
+    LinearBVH(const std::vector<shared_ptr<Entity>>& entities,
+        const BVHBuildOptions& options = BVHBuildOptions()) {
+      double start = omp_get_wtime();
+
+      const int count = int(entities.size());
+      const bool parallel = options.parallel && size_t(count) >= BVHBuilder::PARALLEL_TASK_SIZE;
+
+      std::vector<BVHPrimitive> build_primitives(count);
+      #pragma omp parallel for if (parallel)
+      for (int i = 0; i < count; i++) {
+        build_primitives[i] = BVHPrimitive(entities[i]->bounding_box(), uint32_t(i));
+      }
+
+      tree.options = options;
+      tree.build(build_primitives);
+
+      // store the entities in leaf order so each leaf is a contiguous range
+      primitives.resize(count);
+      #pragma omp parallel for if (parallel)
+      for (int i = 0; i < count; i++) {
+        primitives[i] = entities[build_primitives[i].index];
+      }
+
+      finish_build(options, start);
+    }
+
+    /*
+     * Constructs the linear BVH over the nodes of a binary tree built before over the given
+     * entities, which must already be in the leaf order of that tree. The nodes are attached
+     * rather than copied, and the source keeps the memory they are in alive.
+     */
+    LinearBVH(const std::vector<shared_ptr<Entity>>& leaf_ordered, const LinearBVHNode* nodes, size_t node_count,
+        const BVHBuildOptions& options, shared_ptr<const void> source) :
+      source(source),
+      primitives(leaf_ordered) {
+      double start = omp_get_wtime();
+      tree.options = options;
+      tree.attach(nodes, node_count);
+      finish_build(options, start);
+    }
+
+    /*
+     * Returns true if the given ray hits any entity in the given time interval and records the
+     * nearest hit in the given HitRecord.
+     */
+    bool hit(const Ray& r, Interval ray_t, HitRecord& rec) const override {
+      auto hit_leaf = [&](uint32_t first, uint32_t count, Interval& t) {
+        bool hit_anything = false;
+        for (uint32_t i = first; i < first + count; i++) {
+          if (primitives[i]->hit(r, t, rec)) {
+            hit_anything = true;
+            t.max = rec.t;
+          }
+        }
+        return hit_anything;
+      };
+
+      if (build_stats.width == 4) {
+        return tree4.traverse(r, ray_t, hit_leaf);
+      }
+      if (build_stats.width == 8) {
+        return tree8.traverse(r, ray_t, hit_leaf);
+      }
+      return tree.traverse(r, ray_t, hit_leaf);
+    }
+
+    /*
+     * Traces the rays together through the binary tree, see LinearBVHTree::traverse_packet.
+     */
+    uint32_t hit_packet(const Ray rays[], Interval ray_t[], HitRecord recs[], int count) const override {
+      auto hit_leaf = [&](uint32_t first, uint32_t primitive_count, uint32_t lanes) {
+        uint32_t hits = 0;
+        for (; lanes; lanes &= lanes - 1) {
+          int lane = __builtin_ctz(lanes);
+          for (uint32_t i = first; i < first + primitive_count; i++) {
+            if (primitives[i]->hit(rays[lane], ray_t[lane], recs[lane])) {
+              hits |= 1u << lane;
+              ray_t[lane].max = recs[lane].t;
+            }
+          }
+        }
+        return hits;
+      };
+
+      if (count <= 4) {
+        return tree.traverse_packet<4>(rays, ray_t, count, hit_leaf);
+      }
+      if (count <= 8) {
+        return tree.traverse_packet<8>(rays, ray_t, count, hit_leaf);
+      }
+      return tree.traverse_packet<16>(rays, ray_t, count, hit_leaf);
+    }
+
+    /*
+     * Returns the bounding box of all the entities in the BVH.
+     */
+    Aabb bounding_box() const override {
+      return bound_box;
+    }
+
+    /*
+     * Returns the number of nodes in the flattened tree.
+     */
+    size_t node_count() const {
+      return tree.size();
+    }
+
+    /*
+     * Returns the quality and build statistics of the tree.
+     */
+    const BVHStats& stats() const {
+      return build_stats;
+    }
+
+    /*
+     * Returns the binary tree over the entities.
+     */
+    const LinearBVHTree& binary_tree() const {
+      return tree;
+    }
+
+    /*
+     * Returns the entities in the leaf order of the binary tree.
+     */
+    const std::vector<shared_ptr<Entity>>& leaf_entities() const {
+      return primitives;
+    }
+
+  private:
+    shared_ptr<const void> source;                  // owner of attached nodes, null when built
+    LinearBVHTree tree;                             // flattened tree over the entities
+    WideBVHTree<4> tree4;                           // tree collapsed to 4 children per node
+    WideBVHTree<8> tree8;                           // tree collapsed to 8 children per node
+    std::vector<shared_ptr<Entity>> primitives;     // entities ordered by leaf
+    Aabb bound_box;                                 // bounding box of all the entities
+    BVHStats build_stats;                           // statistics of the built tree
+
+    /*
+     * Sets the bounding box, collapses the binary tree to the configured width and records the
+     * statistics of the tree, timed from start.
+     */
+    void finish_build(const BVHBuildOptions& options, double start) {
+      bound_box = tree.bounding_box();
+
+      // wide trees are collapsed from the binary one, the binary stats still describe the split
+      build_stats = tree.compute_stats();
+      build_stats.width = options.width;
+      if (options.width == 4) {
+        tree4.build(tree.node_data(), tree.size());
+        build_stats.wide_node_count = tree4.nodes.size();
+      }
+      else if (options.width == 8) {
+        tree8.build(tree.node_data(), tree.size());
+        build_stats.wide_node_count = tree8.nodes.size();
+      }
+      else if (options.width != 2) {
+        throw std::runtime_error("Unsupported BVH width " + std::to_string(options.width));
+      }
+      build_stats.build_seconds = omp_get_wtime() - start;
+    }
+};
+
+#endif //!LINEAR_BVH_H_
@@ -1,22 +1,45 @@
 #include <iostream>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
 #include "scene.h"
 
 int main(int argc, char * argv[]) {
   // Parse arguments
 
-  if (argc != 3) {
-    std::cerr << "Usage: raymond <scene_input.json> <image_output.{jpg/png/ppm}>\n";
+  std::string stats_json;
+  std::vector<std::string> paths;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "--stats-json" && i + 1 < argc) {
+      stats_json = argv[++i];
+    }
+    else {
+      paths.push_back(arg);
+    }
+  }
+
+  const bool compile = paths.size() == 3 && paths[0] == "compile";
+  if (paths.size() != 2 && !compile) {
+    std::cerr << "Usage: raymond [--stats-json <stats_output.json>] <scene_input.{json/rbin}> <image_output.{jpg/png/ppm}>\n"
+      << "       raymond compile <scene_input.json> <scene_output.rbin>\n";
     return 1;
   }
 
-  // Setup scene and render it
+  // Setup scene and render it, or compile it
 
   try {
-    Scene scene(argv[1]);
+    if (compile) {
+      Scene scene(paths[1]);
+      scene.compile(paths[2]);
+      return 0;
+    }
+
+    Scene scene(paths[0]);
+    scene.get_camera().stats_json = stats_json;
     std::clog << "[INFO]: Preparing to render\n";
-    scene.render(argv[2]);
+    scene.render(paths[1]);
   }
   catch (const std::runtime_error& e) {
     std::cerr << "[ERROR]: " << e.what() << "\n";
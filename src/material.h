@@ -10,6 +10,21 @@
 #include "entity.h"
 #include "texture.h"
 
+// ==============================
+// ScatterRecord class
+// ==============================
+
+/*
+ * Result of sampling the direction a material scatters an incoming ray into.
+ */
+class ScatterRecord {
+  public:
+    Ray scattered;            // ray leaving the surface in the sampled direction
+    Color attenuation;        // eval(direction) / pdf(direction), the fraction of light carried back
+    double pdf = 0;           // density of sampling the direction, 0 for specular bounces
+    bool is_specular = true;  // true if the direction was picked among a few exact directions
+};
+
 // ==============================
 // Material class
 // ==============================
@@ -19,14 +34,13 @@ class Material {
     virtual ~Material() = default;
 
     /*
-     * Scatters the given ray depending on its hit record and properties of the material
-     * Stores the scattered ray in the given scattered parameter.
+     * Samples a direction that the given ray scatters into depending on its hit record and
+     * properties of the material, and stores it with its attenuation and density in srec.
+     * Random decisions are drawn from the given generator.
      * Returns true if the ray is scattered, else returns false.
      */
-    virtual bool scatter(
-        const Ray& r_in, const HitRecord& record, Color& Attenuation, Ray& scattered
-        ) const {
-      (void) r_in, (void) record, (void) Attenuation, (void) scattered;
+    virtual bool sample(const Ray& r_in, const HitRecord& record, ScatterRecord& srec, Sampler& sampler) const {
+      (void) r_in, (void) record, (void) srec, (void) sampler;
       return false;
     }
 
@@ -37,6 +51,41 @@ class Material {
       (void) u, (void) v, (void) p;
       return Color(0, 0, 0);
     }
+
+    /*
+     * Returns the fraction of light arriving from the given direction that the material sends
+     * back along r_in, multiplied by the cosine between the direction and the normal.
+     * Used to weigh explicitly sampled light. Materials that only scatter into a few exact
+     * directions return black.
+     */
+    virtual Color eval(const Ray& r_in, const HitRecord& record, const Vector3& direction) const {
+      (void) r_in, (void) record, (void) direction;
+      return Color(0, 0, 0);
+    }
+
+    /*
+     * Returns the density, with respect to solid angle, of sample() choosing the given direction.
+     * Specular materials return 0.
+     */
+    virtual double pdf(const Ray& r_in, const HitRecord& record, const Vector3& direction) const {
+      (void) r_in, (void) record, (void) direction;
+      return 0;
+    }
+
+    /*
+     * Returns true if the material only scatters into a few exact directions, so that sampling
+     * lights explicitly from it is pointless.
+     */
+    virtual bool is_specular() const {
+      return true;
+    }
+
+    /*
+     * Returns true if the material emits light
+     */
+    virtual bool is_emissive() const {
+      return false;
+    }
 };
 
 // ==============================
@@ -62,15 +111,13 @@ class Lambertian : public Material {
       }
 
     /*
-     * Scatters the given ray depending on its hit record and properties of the material
-     * Stores the scattered ray in the given scattered parameter.
+     * Samples a direction around the normal with a density proportional to its cosine
+     * Stores the scattered ray in the given scatter record.
      * Returns true if the ray is scattered, else returns false.
      */
-    bool scatter(
-        const Ray& r_in, const HitRecord& record, Color& attenuation, Ray& scattered
-        ) const override {
-      // scattered ray has a random direction from the normal
-      Vector3 scatter_direction = record.normal + random_unit_vector();
+    bool sample(const Ray& r_in, const HitRecord& record, ScatterRecord& srec, Sampler& sampler) const override {
+      // the tip of the normal plus a random unit vector is cosine distributed around the normal
+      Vector3 scatter_direction = record.normal + random_unit_vector(sampler);
 
       // if the scattered ray is close to the normal, make is same as normal
       if (scatter_direction.near_zero()) {
@@ -78,14 +125,45 @@ class Lambertian : public Material {
       }
 
       // set the scattered ray
-      scattered = Ray(record.p, scatter_direction, r_in.time());
+      srec.scattered = Ray(record.p, scatter_direction, r_in.time());
+      srec.pdf = pdf(r_in, record, scatter_direction);
+      srec.is_specular = false;
 
-      // get the color of the ray from the texture of the material
-      attenuation = tex->value(record.u, record.v, record.p);
+      // eval / pdf leaves only the color of the texture
+      srec.attenuation = tex->value(record.u, record.v, record.p);
 
       return true;
     }
 
+    /*
+     * Lambertian surfaces scatter albedo / pi of the light from every direction above the surface
+     */
+    Color eval(const Ray& r_in, const HitRecord& record, const Vector3& direction) const override {
+      (void) r_in;
+      double cosine = dot(record.normal, unit_vector(direction));
+      if (cosine <= 0) {
+        return Color(0, 0, 0);
+      }
+
+      return tex->value(record.u, record.v, record.p) * (cosine / pi);
+    }
+
+    /*
+     * Cosine weighted density of the directions above the surface
+     */
+    double pdf(const Ray& r_in, const HitRecord& record, const Vector3& direction) const override {
+      (void) r_in;
+      double cosine = dot(record.normal, unit_vector(direction));
+      return cosine <= 0 ? 0 : cosine / pi;
+    }
+
+    /*
+     * Lambertian surfaces scatter in every direction
+     */
+    bool is_specular() const override {
+      return false;
+    }
+
   private:
     shared_ptr<Texture> tex; // texture of the material
 };
@@ -107,26 +185,66 @@ class Metal : public Material {
       }
 
     /*
-     * Scatters the given ray depending on its hit record and properties of the material
-     * Stores the scattered ray in the given scattered parameter.
+     * Samples the reflected direction, blurred by a random offset of length fuzz
+     * Stores the scattered ray in the given scatter record.
      * Returns true if the ray is scattered, else returns false.
      */
-    bool scatter(
-        const Ray& r_in, const HitRecord& record, Color& attenuation, Ray& scattered
-        ) const override {
+    bool sample(const Ray& r_in, const HitRecord& record, ScatterRecord& srec, Sampler& sampler) const override {
 
       // Calculate the reflected ray
       Vector3 reflected = reflect(r_in.direction(), record.normal);
-      reflected = unit_vector(reflected) + (fuzz * random_unit_vector());
+      reflected = unit_vector(reflected) + (fuzz * random_unit_vector(sampler));
 
       // Set the scattered ray as the reflected ray
-      scattered = Ray(record.p, reflected, r_in.time());
+      srec.scattered = Ray(record.p, reflected, r_in.time());
+      srec.pdf = pdf(r_in, record, reflected);
+      srec.is_specular = is_specular();
 
       // color of the ray is same as albedo of the material
-      attenuation = albedo;
+      srec.attenuation = albedo;
 
       // the ray is reflected if the scattered ray is in the same hemisphere as the normal ray
-      return (dot(scattered.direction(), record.normal) > 0);
+      return (dot(srec.scattered.direction(), record.normal) > 0);
+    }
+
+    /*
+     * Every direction sample() keeps carries the albedo, so the material sends back albedo times
+     * the density of sampling the direction
+     */
+    Color eval(const Ray& r_in, const HitRecord& record, const Vector3& direction) const override {
+      if (dot(direction, record.normal) <= 0) {
+        return Color(0, 0, 0);
+      }
+
+      return albedo * pdf(r_in, record, direction);
+    }
+
+    /*
+     * Density of the direction towards a uniform point on the sphere of radius fuzz around the
+     * tip of the unit reflected vector. A direction d meets that sphere at the distances t that
+     * solve t^2 - 2bt + 1 - fuzz^2 = 0 with b = dot(d, reflected), and converting the area density
+     * of both points to solid angle gives (t1^2 + t2^2) / (4 pi fuzz sqrt(b^2 - 1 + fuzz^2)).
+     */
+    double pdf(const Ray& r_in, const HitRecord& record, const Vector3& direction) const override {
+      if (is_specular()) {
+        return 0;
+      }
+
+      Vector3 reflected = unit_vector(reflect(r_in.direction(), record.normal));
+      double b = dot(unit_vector(direction), reflected);
+      double discriminant = b * b - 1 + fuzz * fuzz;
+      if (b <= 0 || discriminant <= 0) {
+        return 0;
+      }
+
+      return (4 * b * b - 2 * (1 - fuzz * fuzz)) / (4 * pi * fuzz * std::sqrt(discriminant));
+    }
+
+    /*
+     * Metal without fuzz is a perfect mirror
+     */
+    bool is_specular() const override {
+      return fuzz <= 0;
     }
 
   private:
@@ -155,15 +273,15 @@ class Dielectric : public Material {
       }
 
     /*
-     * Scatters the given ray depending on its hit record and properties of the material
-     * Stores the scattered ray in the given scattered parameter.
+     * Samples either the reflected or the refracted direction of the given ray
+     * Stores the scattered ray in the given scatter record.
      * Returns true if the ray is scattered, else returns false.
      */
-    bool scatter(
-        const Ray& r_in, const HitRecord& record, Color& attenuation, Ray& scattered
-        ) const override {
+    bool sample(const Ray& r_in, const HitRecord& record, ScatterRecord& srec, Sampler& sampler) const override {
       // Attenuation has the color white
-      attenuation = Color(1.0, 1.0, 1.0);
+      srec.attenuation = Color(1.0, 1.0, 1.0);
+      srec.pdf = 0;
+      srec.is_specular = true;
 
       // Sets the refraction_index base on the surface that the ray hit(inside or outside)
       double ri = record.front_face ? (1.0/refraction_index) : refraction_index;
@@ -178,7 +296,7 @@ class Dielectric : public Material {
       Vector3 direction;
 
       // Check whether to reflect the ray or to refract the ray
-      if (cannot_refract || reflectance(cos_theta, ri) > random_double()) {
+      if (cannot_refract || reflectance(cos_theta, ri) > random_double(sampler)) {
         direction = reflect(unit_direction, record.normal);
       }
       else {
@@ -186,7 +304,7 @@ class Dielectric : public Material {
       }
 
       // Record the scatterd ray
-      scattered = Ray(record.p, direction, r_in.time());
+      srec.scattered = Ray(record.p, direction, r_in.time());
 
       return true;
     }
@@ -223,6 +341,10 @@ class DiffuseLight : public Material {
       return tex->value(u, v, p);
     }
 
+    bool is_emissive() const override {
+      return true;
+    }
+
   private:
     shared_ptr<Texture> tex;
 };
@@ -0,0 +1,634 @@
+#ifndef MESH_H_
+#define MESH_H_
+
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
+
+#include "raymond.h"
+#include "vector3.h"
+
+// ==============================
+// MeshView class
+// ==============================
+
+/*
+ * Read only view of the vertex and triangle buffers of a mesh, wherever they are stored.
+ */
+class MeshView {
+  public:
+    const double* px = nullptr;        // vertex positions
+    const double* py = nullptr;
+    const double* pz = nullptr;
+    const double* nx = nullptr;        // vertex normals, null if the mesh has none
+    const double* ny = nullptr;
+    const double* nz = nullptr;
+    const double* tu = nullptr;        // vertex texture coordinates, null if the mesh has none
+    const double* tv = nullptr;
+    const uint32_t* indices = nullptr; // three vertex indices per triangle
+    size_t vertex_count = 0;           // number of vertices
+    size_t triangle_count = 0;         // number of triangles
+
+    /*
+     * Returns true if every vertex has a normal.
+     */
+    bool has_normals() const {
+      return nx != nullptr;
+    }
+
+    /*
+     * Returns true if every vertex has texture coordinates.
+     */
+    bool has_uvs() const {
+      return tu != nullptr;
+    }
+
+    /*
+     * Returns the position of the given vertex.
+     */
+    Point3 position(uint32_t vertex) const {
+      return Point3(px[vertex], py[vertex], pz[vertex]);
+    }
+
+    /*
+     * Returns the normal of the given vertex, the mesh must have normals.
+     */
+    Vector3 normal(uint32_t vertex) const {
+      return Vector3(nx[vertex], ny[vertex], nz[vertex]);
+    }
+};
+
+// ==============================
+// Mesh class
+// ==============================
+
+/*
+ * Vertex and triangle buffers of a triangle mesh. Every vertex attribute is stored as its own array
+ * of components so that the buffers can be loaded once and shared by every entity that uses the
+ * mesh, and the triangles index into them three vertices at a time.
+ */
+class Mesh {
+  public:
+    std::vector<double> px, py, pz;  // vertex positions
+    std::vector<double> nx, ny, nz;  // vertex normals, empty if the mesh has none
+    std::vector<double> tu, tv;      // vertex texture coordinates, empty if the mesh has none
+    std::vector<uint32_t> indices;   // three vertex indices per triangle
+
+    /*
+     * Loads the mesh in the given .obj or .ply file.
+     * Throws if the file can not be read or is not a valid mesh.
+     */
+    static shared_ptr<Mesh> load(const std::string& file_path);
+
+    /*
+     * Returns the number of vertices.
+     */
+    size_t vertex_count() const {
+      return px.size();
+    }
+
+    /*
+     * Returns the number of triangles.
+     */
+    size_t triangle_count() const {
+      return indices.size() / 3;
+    }
+
+    /*
+     * Returns true if every vertex has a normal.
+     */
+    bool has_normals() const {
+      return !nx.empty();
+    }
+
+    /*
+     * Returns true if every vertex has texture coordinates.
+     */
+    bool has_uvs() const {
+      return !tu.empty();
+    }
+
+    /*
+     * Returns the position of the given vertex.
+     */
+    Point3 position(uint32_t vertex) const {
+      return Point3(px[vertex], py[vertex], pz[vertex]);
+    }
+
+    /*
+     * Returns the normal of the given vertex, the mesh must have normals.
+     */
+    Vector3 normal(uint32_t vertex) const {
+      return Vector3(nx[vertex], ny[vertex], nz[vertex]);
+    }
+
+    /*
+     * Returns a view of the buffers, valid while the mesh is alive and unchanged.
+     */
+    MeshView view() const {
+      MeshView v;
+      v.px = px.data();
+      v.py = py.data();
+      v.pz = pz.data();
+      if (has_normals()) {
+        v.nx = nx.data();
+        v.ny = ny.data();
+        v.nz = nz.data();
+      }
+      if (has_uvs()) {
+        v.tu = tu.data();
+        v.tv = tv.data();
+      }
+      v.indices = indices.data();
+      v.vertex_count = vertex_count();
+      v.triangle_count = triangle_count();
+      return v;
+    }
+
+    /*
+     * Scales the mesh by the given factor, rotates it by the given angles around the x, y and z
+     * axes in that order, the same way as Box, and then moves it by the given offset.
+     */
+    void transform(double scale, const Vector3& rotations, const Vector3& offset) {
+      for (size_t i = 0; i < vertex_count(); i++) {
+        Point3 p = scale * position(uint32_t(i));
+        p = p.rotate(rotations[0], 0).rotate(rotations[1], 1).rotate(rotations[2], 2) + offset;
+        px[i] = p.x();
+        py[i] = p.y();
+        pz[i] = p.z();
+
+        if (has_normals()) {
+          Vector3 n = normal(uint32_t(i)).rotate(rotations[0], 0).rotate(rotations[1], 1).rotate(rotations[2], 2);
+          nx[i] = n.x();
+          ny[i] = n.y();
+          nz[i] = n.z();
+        }
+      }
+    }
+
+    /*
+     * Checks that the attribute buffers match the vertex count and that every index refers to a
+     * vertex. Throws with the given file path if they do not.
+     */
+    void validate(const std::string& file_path) const {
+      if (py.size() != vertex_count() || pz.size() != vertex_count()) {
+        throw std::runtime_error(file_path + ": Mesh positions are incomplete");
+      }
+      if (has_normals() && (nx.size() != vertex_count() || ny.size() != vertex_count() || nz.size() != vertex_count())) {
+        throw std::runtime_error(file_path + ": Mesh normals do not match its vertices");
+      }
+      if (has_uvs() && (tu.size() != vertex_count() || tv.size() != vertex_count())) {
+        throw std::runtime_error(file_path + ": Mesh texture coordinates do not match its vertices");
+      }
+      if (indices.size() % 3 != 0) {
+        throw std::runtime_error(file_path + ": Mesh triangles are incomplete");
+      }
+      for (uint32_t index : indices) {
+        if (index >= vertex_count()) {
+          throw std::runtime_error(file_path + ": Mesh refers to vertex " + std::to_string(index)
+              + " of " + std::to_string(vertex_count()));
+        }
+      }
+    }
+};
+
+// ==============================
+// OBJ loading
+// ==============================
+
+/*
+ * Position, texture coordinate and normal indices of one corner of an OBJ face, -1 where missing.
+ */
+class ObjCorner {
+  public:
+    long p = -1;  // index of the position
+    long t = -1;  // index of the texture coordinates
+    long n = -1;  // index of the normal
+
+    bool operator==(const ObjCorner& other) const {
+      return p == other.p && t == other.t && n == other.n;
+    }
+};
+
+/*
+ * Hash of an ObjCorner, used to share the mesh vertex of corners that repeat.
+ */
+class ObjCornerHash {
+  public:
+    size_t operator()(const ObjCorner& c) const {
+      uint64_t h = uint64_t(c.p) * 0x9e3779b97f4a7c15ull;
+      h ^= uint64_t(c.t) + 0x7f4a7c159e3779b9ull + (h << 6) + (h >> 2);
+      h ^= uint64_t(c.n) + 0x94d049bb133111ebull + (h << 6) + (h >> 2);
+      return size_t(h);
+    }
+};
+
+/*
+ * Loads the triangles of the given Wavefront OBJ file. Faces with more than three corners are
+ * split into fans, and every distinct combination of position, texture coordinate and normal
+ * indices becomes one vertex. Normals and texture coordinates are kept only if every corner has
+ * them. Groups, objects and materials are ignored.
+ */
+inline shared_ptr<Mesh> load_obj(const std::string& file_path) {
+  std::ifstream input(file_path);
+  if (!input.good()) {
+    throw std::runtime_error(file_path + ": File not found");
+  }
+
+  std::vector<Vector3> positions, normals, uvs;
+  std::unordered_map<ObjCorner, uint32_t, ObjCornerHash> vertex_of;
+  std::vector<ObjCorner> corners;
+  shared_ptr<Mesh> mesh = make_shared<Mesh>();
+  bool all_normals = true;
+  bool all_uvs = true;
+
+  // resolves a 1 based or negative relative OBJ index against count elements
+  auto resolve = [&](long index, size_t count, size_t line_number) {
+    const long resolved = index < 0 ? long(count) + index : index - 1;
+    if (index == 0 || resolved < 0 || resolved >= long(count)) {
+      throw std::runtime_error(file_path + ":" + std::to_string(line_number) + " Index out of range");
+    }
+    return resolved;
+  };
+
+  std::string line;
+  size_t line_number = 0;
+  while (std::getline(input, line)) {
+    line_number++;
+    const char* s = line.c_str();
+    while (*s == ' ' || *s == '\t') {
+      s++;
+    }
+
+    if (s[0] == 'v' && (s[1] == ' ' || s[1] == '\t')) {
+      char* end;
+      const double x = std::strtod(s + 2, &end);
+      const double y = std::strtod(end, &end);
+      const double z = std::strtod(end, &end);
+      positions.push_back(Vector3(x, y, z));
+    }
+    else if (s[0] == 'v' && s[1] == 'n') {
+      char* end;
+      const double x = std::strtod(s + 2, &end);
+      const double y = std::strtod(end, &end);
+      const double z = std::strtod(end, &end);
+      normals.push_back(Vector3(x, y, z));
+    }
+    else if (s[0] == 'v' && s[1] == 't') {
+      char* end;
+      const double u = std::strtod(s + 2, &end);
+      const double v = std::strtod(end, &end);
+      uvs.push_back(Vector3(u, v, 0));
+    }
+    else if (s[0] == 'f' && (s[1] == ' ' || s[1] == '\t')) {
+      // corners are written as p, p/t, p//n or p/t/n
+      corners.clear();
+      const char* cursor = s + 2;
+      while (true) {
+        char* end;
+        const long p = std::strtol(cursor, &end, 10);
+        if (end == cursor) {
+          break;
+        }
+
+        ObjCorner corner;
+        corner.p = resolve(p, positions.size(), line_number);
+        cursor = end;
+        if (*cursor == '/') {
+          cursor++;
+          if (*cursor != '/') {
+            corner.t = resolve(std::strtol(cursor, &end, 10), uvs.size(), line_number);
+            cursor = end;
+          }
+          if (*cursor == '/') {
+            cursor++;
+            corner.n = resolve(std::strtol(cursor, &end, 10), normals.size(), line_number);
+            cursor = end;
+          }
+        }
+        corners.push_back(corner);
+      }
+
+      if (corners.size() < 3) {
+        throw std::runtime_error(file_path + ":" + std::to_string(line_number) + " Face has fewer than 3 corners");
+      }
+
+      // one vertex per distinct corner
+      for (ObjCorner& corner : corners) {
+        all_uvs = all_uvs && corner.t >= 0;
+        all_normals = all_normals && corner.n >= 0;
+
+        auto [it, inserted] = vertex_of.try_emplace(corner, uint32_t(mesh->px.size()));
+        if (inserted) {
+          const Vector3& p = positions[corner.p];
+          mesh->px.push_back(p.x());
+          mesh->py.push_back(p.y());
+          mesh->pz.push_back(p.z());
+
+          const Vector3 n = corner.n >= 0 ? normals[corner.n] : Vector3(0, 0, 0);
+          mesh->nx.push_back(n.x());
+          mesh->ny.push_back(n.y());
+          mesh->nz.push_back(n.z());
+
+          const Vector3 uv = corner.t >= 0 ? uvs[corner.t] : Vector3(0, 0, 0);
+          mesh->tu.push_back(uv.x());
+          mesh->tv.push_back(uv.y());
+        }
+        corner.p = it->second;
+      }
+
+      for (size_t i = 1; i + 1 < corners.size(); i++) {
+        mesh->indices.push_back(uint32_t(corners[0].p));
+        mesh->indices.push_back(uint32_t(corners[i].p));
+        mesh->indices.push_back(uint32_t(corners[i + 1].p));
+      }
+    }
+  }
+
+  if (!all_normals) {
+    mesh->nx.clear();
+    mesh->ny.clear();
+    mesh->nz.clear();
+  }
+  if (!all_uvs) {
+    mesh->tu.clear();
+    mesh->tv.clear();
+  }
+
+  return mesh;
+}
+
+// ==============================
+// PLY loading
+// ==============================
+
+/*
+ * One property of a PLY element, either a single value or a list of values preceded by their count.
+ */
+class PlyProperty {
+  public:
+    std::string name;        // name of the property
+    std::string type;        // type of the value, or of the list items
+    std::string count_type;  // type of the list count, empty for single values
+};
+
+/*
+ * One element of a PLY file, such as vertex or face, with its count and properties.
+ */
+class PlyElement {
+  public:
+    std::string name;                     // name of the element
+    size_t count = 0;                     // number of elements in the file
+    std::vector<PlyProperty> properties;  // properties of every element, in file order
+};
+
+/*
+ * Reads values of a PLY body in its ascii, binary_little_endian or binary_big_endian format.
+ */
+class PlyReader {
+  public:
+    /*
+     * Constructs the reader of the body that follows the header in the given stream.
+     */
+    PlyReader(std::istream& input, const std::string& format, const std::string& file_path) :
+      input(input),
+      ascii(format == "ascii"),
+      swap(format == "binary_big_endian"),
+      file_path(file_path) {
+        if (!ascii && !swap && format != "binary_little_endian") {
+          throw std::runtime_error(file_path + ": Unknown PLY format " + format);
+        }
+      }
+
+    /*
+     * Reads one value of the given type and returns it as a double.
+     */
+    double read(const std::string& type) {
+      if (ascii) {
+        double value;
+        if (!(input >> value)) {
+          throw std::runtime_error(file_path + ": Unexpected end of PLY data");
+        }
+        return value;
+      }
+
+      if (type == "char" || type == "int8") {
+        return read_binary<int8_t>();
+      }
+      else if (type == "uchar" || type == "uint8") {
+        return read_binary<uint8_t>();
+      }
+      else if (type == "short" || type == "int16") {
+        return read_binary<int16_t>();
+      }
+      else if (type == "ushort" || type == "uint16") {
+        return read_binary<uint16_t>();
+      }
+      else if (type == "int" || type == "int32") {
+        return read_binary<int32_t>();
+      }
+      else if (type == "uint" || type == "uint32") {
+        return read_binary<uint32_t>();
+      }
+      else if (type == "float" || type == "float32") {
+        return read_binary<float>();
+      }
+      else if (type == "double" || type == "float64") {
+        return read_binary<double>();
+      }
+      throw std::runtime_error(file_path + ": Unknown PLY type " + type);
+    }
+
+  private:
+    std::istream& input;           // stream positioned at the body
+    bool ascii;                    // whether the body is text
+    bool swap;                     // whether the binary values are big endian
+    const std::string& file_path;  // path of the file, for errors
+
+    /*
+     * Reads one binary value of type T, swapping its bytes if the file is big endian.
+     */
+    template <typename T>
+    double read_binary() {
+      unsigned char bytes[sizeof(T)];
+      if (!input.read(reinterpret_cast<char*>(bytes), sizeof(T))) {
+        throw std::runtime_error(file_path + ": Unexpected end of PLY data");
+      }
+      if (swap) {
+        std::reverse(bytes, bytes + sizeof(T));
+      }
+
+      T value;
+      std::memcpy(&value, bytes, sizeof(T));
+      return double(value);
+    }
+};
+
+/*
+ * Loads the triangles of the given PLY file in ascii or binary format. Vertices are read from the
+ * x, y, z, nx, ny, nz and u, v (or s, t) properties of the vertex element and faces from the
+ * vertex_indices (or vertex_index) list of the face element, split into fans. Other elements and
+ * properties are skipped.
+ */
+inline shared_ptr<Mesh> load_ply(const std::string& file_path) {
+  std::ifstream input(file_path, std::ios::binary);
+  if (!input.good()) {
+    throw std::runtime_error(file_path + ": File not found");
+  }
+
+  // header
+  std::string line;
+  std::getline(input, line);
+  if (line.rfind("ply", 0) != 0) {
+    throw std::runtime_error(file_path + ": Expected to start with ply");
+  }
+
+  std::string format;
+  std::vector<PlyElement> elements;
+  while (std::getline(input, line)) {
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+
+    std::istringstream words(line);
+    std::string keyword;
+    words >> keyword;
+
+    if (keyword == "format") {
+      words >> format;
+    }
+    else if (keyword == "element") {
+      PlyElement element;
+      words >> element.name >> element.count;
+      elements.push_back(element);
+    }
+    else if (keyword == "property") {
+      if (elements.empty()) {
+        throw std::runtime_error(file_path + ": PLY property outside of an element");
+      }
+      PlyProperty property;
+      words >> property.type;
+      if (property.type == "list") {
+        words >> property.count_type >> property.type;
+      }
+      words >> property.name;
+      elements.back().properties.push_back(property);
+    }
+    else if (keyword == "end_header") {
+      break;
+    }
+  }
+
+  // body
+  PlyReader reader(input, format, file_path);
+  shared_ptr<Mesh> mesh = make_shared<Mesh>();
+  std::vector<double> values;
+  std::vector<uint32_t> polygon;
+
+  // converts a list count or index to uint32_t, values outside of its range (or NaN) are rejected
+  auto to_uint32 = [&](double value, const char* message) {
+    if (!(value >= 0 && value < 4294967296.0)) {
+      throw std::runtime_error(file_path + ": " + message);
+    }
+    return uint32_t(value);
+  };
+
+  for (const PlyElement& element : elements) {
+    const bool is_vertex = element.name == "vertex";
+    const bool is_face = element.name == "face";
+
+    // where every property of the element is stored, null for skipped properties
+    std::vector<std::vector<double>*> targets;
+    for (const PlyProperty& p : element.properties) {
+      std::vector<double>* target = nullptr;
+      if (is_vertex) {
+        if (p.name == "x") target = &mesh->px;
+        else if (p.name == "y") target = &mesh->py;
+        else if (p.name == "z") target = &mesh->pz;
+        else if (p.name == "nx") target = &mesh->nx;
+        else if (p.name == "ny") target = &mesh->ny;
+        else if (p.name == "nz") target = &mesh->nz;
+        else if (p.name == "u" || p.name == "s" || p.name == "texture_u" || p.name == "texture_s") target = &mesh->tu;
+        else if (p.name == "v" || p.name == "t" || p.name == "texture_v" || p.name == "texture_t") target = &mesh->tv;
+      }
+      targets.push_back(target);
+    }
+
+    for (size_t i = 0; i < element.count; i++) {
+      for (size_t j = 0; j < element.properties.size(); j++) {
+        const PlyProperty& p = element.properties[j];
+        if (p.count_type.empty()) {
+          const double value = reader.read(p.type);
+          if (targets[j]) {
+            targets[j]->push_back(value);
+          }
+          continue;
+        }
+
+        const size_t count = to_uint32(reader.read(p.count_type), "List size out of range");
+        const bool is_polygon = is_face && (p.name == "vertex_indices" || p.name == "vertex_index");
+        polygon.clear();
+        for (size_t k = 0; k < count; k++) {
+          const double value = reader.read(p.type);
+          if (is_polygon) {
+            polygon.push_back(to_uint32(value, "Index out of range"));
+          }
+        }
+
+        for (size_t k = 1; k + 1 < polygon.size(); k++) {
+          mesh->indices.push_back(polygon[0]);
+          mesh->indices.push_back(polygon[k]);
+          mesh->indices.push_back(polygon[k + 1]);
+        }
+      }
+    }
+
+    // normals and texture coordinates missing a component are dropped
+    if (is_vertex) {
+      const size_t n = mesh->px.size();
+      if (mesh->nx.size() != n || mesh->ny.size() != n || mesh->nz.size() != n) {
+        mesh->nx.clear();
+        mesh->ny.clear();
+        mesh->nz.clear();
+      }
+      if (mesh->tu.size() != n || mesh->tv.size() != n) {
+        mesh->tu.clear();
+        mesh->tv.clear();
+      }
+    }
+  }
+
+  return mesh;
+}
+
+inline shared_ptr<Mesh> Mesh::load(const std::string& file_path) {
+  const size_t dot = file_path.find_last_of('.');
+  std::string extension = dot == std::string::npos ? "" : file_path.substr(dot);
+  std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+  shared_ptr<Mesh> mesh;
+  if (extension == ".obj") {
+    mesh = load_obj(file_path);
+  }
+  else if (extension == ".ply") {
+    mesh = load_ply(file_path);
+  }
+  else {
+    throw std::runtime_error(file_path + ": Expected a .obj or .ply mesh");
+  }
+
+  mesh->validate(file_path);
+  if (mesh->triangle_count() == 0) {
+    throw std::runtime_error(file_path + ": Mesh has no triangles");
+  }
+  return mesh;
+}
+
+#endif //!MESH_H_
@@ -4,13 +4,17 @@
 #include <string>
 #include <fstream>
 #include <string>
+#include <vector>
 #include <unordered_map>
 #include <queue>
+#include <functional>
 #include <stdexcept>
+#include <algorithm>
 
 #include "external/json.hpp"
 #include "raymond.h"
 #include "entity.h"
+#include "entity_list.h"
 #include "vector3.h"
 #include "color.h"
 #include "camera.h"
@@ -18,12 +22,256 @@
 #include "material.h"
 #include "sphere.h"
 #include "quad.h"
+#include "box.h"
+#include "mesh.h"
+#include "triangle_mesh.h"
+#include "instance.h"
+#include "linear_bvh.h"
+#include "scene_cache.h"
 
 using json = nlohmann::json;
 
 using TextureMap = std::unordered_map<std::string, shared_ptr<Texture>>;
 using MaterialMap = std::unordered_map<std::string, shared_ptr<Material>>;
-using EntityMap = std::unordered_map<std::string, shared_ptr<Entity>>;
+
+// ==============================
+// ParsePath class
+// Path to a value of the scene file, only formatted when an error is reported
+// ==============================
+
+class ParsePath {
+  public:
+    /*
+     * Construct the path to a value of the given section
+     */
+    ParsePath(const char* section) :
+      section(section),
+      group(nullptr),
+      key(nullptr) {
+    }
+
+    /*
+     * Construct the path to a value of the object with the given key in the given section
+     */
+    ParsePath(const char* section, const std::string& key) :
+      section(section),
+      group(nullptr),
+      key(&key) {
+    }
+
+    /*
+     * Construct the path to a value of the object with the given key in the given group of the
+     * given section
+     */
+    ParsePath(const char* section, const std::string& group, const std::string& key) :
+      section(section),
+      group(&group),
+      key(&key) {
+    }
+
+    /*
+     * Return the path to the given field as section.group.key.field
+     */
+    std::string to_string(const char* field) const {
+      std::string path = section;
+      if (group) {
+        path += "." + *group;
+      }
+      if (key) {
+        path += "." + *key;
+      }
+      return path + "." + field;
+    }
+
+  private:
+    const char* section;       // name of the section
+    const std::string* group;  // group of the object in the section, null if it has none
+    const std::string* key;    // key of the object in the section, null for the section itself
+};
+
+// ==============================
+// ParsedEntity class
+// ==============================
+
+class ParsedEntity {
+  public:
+    std::string key;            // name of the entity in the scene file
+    shared_ptr<Entity> entity;  // the entity, null for unknown types
+    bool emissive;              // true if the material of the entity emits light
+    CachedEntityRecord record;  // flat record of the entity stored in scene caches
+};
+
+// ==============================
+// Prototype class
+// ==============================
+
+class Prototype {
+  public:
+    shared_ptr<Entity> entity;                 // entities of the prototype, under a BVH if there are several
+    std::vector<shared_ptr<Entity>> emitters;  // parts of the prototype sampled as lights
+    uint32_t index = 0;                        // index of the prototype record in scene caches
+};
+
+// ==============================
+// SceneSaxHandler class
+// Builds the json of a scene file from its stream of tokens, except for the objects of the
+// entities section, which can be handed to a callback one at a time and then dropped
+// ==============================
+
+class SceneSaxHandler : public nlohmann::json_sax<json> {
+  public:
+    using EntitiesCallback = std::function<bool()>;
+    using EntityCallback = std::function<void(const std::string&, const json&)>;
+
+    /*
+     * Construct the handler building the scene json into root. begin_entities is called when the
+     * entities section is reached and returns true to have its objects passed to on_entity
+     * instead of being kept in root.
+     */
+    SceneSaxHandler(json& root, EntitiesCallback begin_entities, EntityCallback on_entity) :
+      root(root),
+      begin_entities(std::move(begin_entities)),
+      on_entity(std::move(on_entity)) {
+    }
+
+    /*
+     * Return the error the scene file failed to parse with
+     */
+    const std::string& get_error() const {
+      return error;
+    }
+
+    bool null() override {
+      insert(nullptr);
+      end_value();
+      return true;
+    }
+
+    bool boolean(bool value) override {
+      insert(value);
+      end_value();
+      return true;
+    }
+
+    bool number_integer(number_integer_t value) override {
+      insert(value);
+      end_value();
+      return true;
+    }
+
+    bool number_unsigned(number_unsigned_t value) override {
+      insert(value);
+      end_value();
+      return true;
+    }
+
+    bool number_float(number_float_t value, const string_t&) override {
+      insert(value);
+      end_value();
+      return true;
+    }
+
+    bool string(string_t& value) override {
+      insert(std::move(value));
+      end_value();
+      return true;
+    }
+
+    bool binary(binary_t& value) override {
+      insert(json::binary(std::move(value)));
+      end_value();
+      return true;
+    }
+
+    bool start_object(std::size_t) override {
+      const bool is_entities = entities_pending && stack.size() == 1;
+      stack.push_back(insert(json::value_t::object));
+      if (is_entities) {
+        entities = stack.back();
+      }
+      return true;
+    }
+
+    bool key(string_t& key) override {
+      if (stack.size() == 1 && key == "entities") {
+        entities_pending = begin_entities();
+      }
+
+      // objects of the streamed entities section are built on their own
+      if (stack.size() == 2 && stack.back() == entities) {
+        entity_key = std::move(key);
+        element = &entity;
+        return true;
+      }
+
+      element = &(*stack.back())[key];
+      return true;
+    }
+
+    bool end_object() override {
+      stack.pop_back();
+      end_value();
+      return true;
+    }
+
+    bool start_array(std::size_t) override {
+      stack.push_back(insert(json::value_t::array));
+      return true;
+    }
+
+    bool end_array() override {
+      stack.pop_back();
+      end_value();
+      return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& exception) override {
+      error = exception.what();
+      return false;
+    }
+
+  private:
+    json& root;                       // json of the scene file
+    EntitiesCallback begin_entities;  // decides whether to stream the entities section
+    EntityCallback on_entity;         // receives the streamed entities
+    std::vector<json*> stack;         // values being built, from the root down
+    json* element = nullptr;          // value of the last key of the innermost object
+    json* entities = nullptr;         // streamed entities section in root, null if not streamed
+    bool entities_pending = false;    // true if the next value is the entities section to stream
+    std::string entity_key;           // key of the streamed entity being built
+    json entity;                      // streamed entity being built
+    std::string error;                // parse error, empty if none
+
+    /*
+     * Store the given value in the innermost array or object, and return it
+     */
+    json* insert(json value) {
+      entities_pending = false;
+
+      if (stack.empty()) {
+        root = std::move(value);
+        return &root;
+      }
+
+      if (stack.back()->is_array()) {
+        stack.back()->push_back(std::move(value));
+        return &stack.back()->back();
+      }
+
+      *element = std::move(value);
+      return element;
+    }
+
+    /*
+     * Hand over the streamed entity that was just completed, if any
+     */
+    void end_value() {
+      if (stack.size() == 2 && stack.back() == entities) {
+        on_entity(entity_key, entity);
+        entity = json();
+      }
+    }
+};
 
 // ==============================
 // Parser class
@@ -42,10 +290,139 @@ class Parser {
         if (!target_input_stream.good()) {
           throw std::runtime_error(target_file_path + ": File not found");
         }
+    };
 
-        target_json = json::parse(target_input_stream);
+    /*
+     * Construct the parser over the scene the given cache was compiled from
+     * The scene is created from the records of the cache instead of its scene file
+     */
+    Parser(shared_ptr<const SceneCache> cache) :
+      target_file_path(cache->get_source_path()),
+      cache(cache) {
     };
 
+    /*
+     * Return the path to the target json file
+     */
+    const std::string& get_path() const {
+      return target_file_path;
+    }
+
+    /*
+     * Return the flat records of the parsed scene file, which scene caches store
+     */
+    const SceneRecords& get_records() const {
+      return records;
+    }
+
+    /*
+     * Return the paths of the meshes and images used by the scene, in the order they were parsed
+     */
+    const std::vector<std::string>& get_assets() const {
+      return assets;
+    }
+
+    /*
+     * Parse the scene file into the provided objects
+     * The file is read as a stream of tokens. When the materials, and the textures they use, come
+     * before the entities, every entity is created as soon as it is read, so that the json of at
+     * most one entity is held at a time. Otherwise, and for instances read before the prototypes,
+     * the entities are created once the whole file is read. The entities are added to the provided
+     * list in the order of their names, and the emissive ones are also added to the provided list of
+     * lights. A parser over a scene cache creates them from its records instead.
+     */
+    void parse_scene(Camera& camera, BVHBuildOptions& bvh_options, TextureMap& texture_map,
+        MaterialMap& material_map, EntityList& entities, EntityList& lights) {
+      if (cache) {
+        load_cache(camera, bvh_options, texture_map, material_map, entities, lights);
+        return;
+      }
+
+      std::vector<ParsedEntity> parsed;
+      bool streamed = false;
+      bool parsed_prototypes = false;
+
+      SceneSaxHandler handler(target_json,
+        [&]() {
+          if (!streamed && can_stream()) {
+            parse_textures(texture_map);
+            parse_materials(material_map, texture_map);
+            if (target_json.contains("prototypes")) {
+              parse_prototypes(material_map);
+              parsed_prototypes = true;
+            }
+            streamed = true;
+          }
+          return streamed;
+        },
+        [&](const std::string& key, const json& value) {
+          // instances read before their prototypes are left in the json for later
+          if (!parsed_prototypes && is_instance(value)) {
+            target_json["entities"][key] = value;
+            return;
+          }
+          parsed.push_back(parse_entity(key, value, material_map, ParsePath("entities", key)));
+        });
+
+      std::ifstream target_input_stream(target_file_path);
+      if (!json::sax_parse(target_input_stream, &handler)) {
+        throw std::runtime_error(target_file_path + ": " + handler.get_error());
+      }
+
+      parse_camera(camera);
+      parse_bvh(bvh_options);
+
+      if (!streamed) {
+        parse_textures(texture_map);
+        parse_materials(material_map, texture_map);
+      }
+      if (!parsed_prototypes) {
+        parse_prototypes(material_map);
+      }
+      parse_entities(parsed, material_map);
+
+      add_entities(parsed, entities, lights, records.entities);
+
+      json settings = { { "camera", target_json["camera"] } };
+      if (target_json.contains("bvh")) {
+        settings["bvh"] = target_json["bvh"];
+      }
+      records.settings = settings.dump();
+    }
+
+  private:
+    const std::string target_file_path;  // path to the target json file
+    json target_json;                    // parsed json object, without the streamed entities
+    std::unordered_map<std::string, shared_ptr<const Mesh>> meshes;  // meshes loaded so far by path
+    shared_ptr<const SceneCache> cache;  // compiled scene to create the scene from, if any
+    std::vector<std::string> assets;     // paths of the meshes and images used by the scene
+    std::unordered_map<std::string, Prototype> prototypes;  // prototypes placed by instances, by name
+    SceneRecords records;                // flat records of the parsed scene file
+    std::unordered_map<std::string, uint32_t> texture_records;   // index of the record of every texture, by name
+    std::unordered_map<std::string, uint32_t> material_records;  // index of the record of every material, by name
+
+    /*
+     * Return true if the entities can be created as they are read, which needs the materials and
+     * the textures they use to have been read
+     */
+    bool can_stream() const {
+      auto materials = target_json.find("materials");
+      if (materials == target_json.end()) {
+        return false;
+      }
+
+      if (target_json.contains("textures")) {
+        return true;
+      }
+
+      for (const json& material : *materials) {
+        if (material.contains("texture")) {
+          return false;
+        }
+      }
+      return true;
+    }
+
     /*
      * Parse the camera settings from the json file into the provided camera object
      */
@@ -55,17 +432,194 @@ class Parser {
       }
 
       const json& section = target_json["camera"];
+      const ParsePath path("camera");
+
+      camera.aspect_ratio = parse_float(section, "aspect_ratio", path);
+      camera.image_width = parse_number_unsigned(section, "image_width", path);
+      camera.samples_per_pixel = parse_number_unsigned(section, "samples_per_pixel", path);
+      camera.max_depth = parse_number_unsigned(section, "max_depth", path);
+      camera.background = parse_color(section, "background", path);
+      camera.vfov = parse_number_unsigned(section, "vfov", path);
+      camera.lookfrom = parse_vector3(section, "lookfrom", path);
+      camera.lookat = parse_vector3(section, "lookat", path);
+      camera.vup = parse_vector3(section, "vup", path);
+      camera.defocus_angle = parse_float(section, "defocus_angle", path);
+
+      if (section.contains("seed")) {
+        camera.seed = parse_uint64(section, "seed", path);
+      }
+
+      if (section.contains("sampler")) {
+        const std::string& sampler = parse_string(section, "sampler", path);
+        if (sampler == "independent") {
+          camera.sampler_type = SamplerType::Independent;
+        }
+        else if (sampler == "stratified") {
+          camera.sampler_type = SamplerType::Stratified;
+        }
+        else if (sampler == "sobol") {
+          camera.sampler_type = SamplerType::Sobol;
+        }
+        else {
+          throw std::runtime_error(target_file_path + ":camera.sampler Expected to be independent, stratified or sobol");
+        }
+      }
+
+      if (section.contains("packet_size")) {
+        camera.packet_size = parse_number_unsigned(section, "packet_size", path);
+        if (camera.packet_size != 1 && camera.packet_size != 4 && camera.packet_size != 8 && camera.packet_size != 16) {
+          throw std::runtime_error(target_file_path + ":camera.packet_size Expected to be 1, 4, 8 or 16");
+        }
+      }
+
+      if (section.contains("roulette_depth")) {
+        camera.roulette_depth = parse_number_unsigned(section, "roulette_depth", path);
+      }
+
+      if (section.contains("light_sampling")) {
+        camera.light_sampling = parse_bool(section, "light_sampling", path);
+      }
+
+      if (section.contains("mis_heuristic")) {
+        const std::string& heuristic = parse_string(section, "mis_heuristic", path);
+        if (heuristic == "power") {
+          camera.mis_heuristic = MISHeuristic::Power;
+        }
+        else if (heuristic == "balance") {
+          camera.mis_heuristic = MISHeuristic::Balance;
+        }
+        else {
+          throw std::runtime_error(target_file_path + ":camera.mis_heuristic Expected to be power or balance");
+        }
+      }
+
+      if (section.contains("light_sampler")) {
+        const std::string& sampler = parse_string(section, "light_sampler", path);
+        if (sampler == "bvh") {
+          camera.light_sampler = LightSamplerType::BVH;
+        }
+        else if (sampler == "uniform") {
+          camera.light_sampler = LightSamplerType::Uniform;
+        }
+        else {
+          throw std::runtime_error(target_file_path + ":camera.light_sampler Expected to be bvh or uniform");
+        }
+      }
+
+      if (section.contains("integrator")) {
+        const std::string& integrator = parse_string(section, "integrator", path);
+        if (integrator == "path") {
+          camera.integrator = CameraIntegrator::Path;
+        }
+        else if (integrator == "wavefront") {
+          camera.integrator = CameraIntegrator::Wavefront;
+        }
+        else if (integrator == "restir") {
+          camera.integrator = CameraIntegrator::ReSTIR;
+        }
+        else {
+          throw std::runtime_error(target_file_path + ":camera.integrator Expected to be path, wavefront or restir");
+        }
+      }
+
+      if (section.contains("restir_candidates")) {
+        camera.restir_candidates = parse_number_unsigned(section, "restir_candidates", path);
+      }
+
+      if (section.contains("restir_history")) {
+        camera.restir_history = parse_number_unsigned(section, "restir_history", path);
+      }
+
+      if (section.contains("restir_neighbors")) {
+        camera.restir_neighbors = parse_number_unsigned(section, "restir_neighbors", path);
+      }
+
+      if (section.contains("adaptive_threshold")) {
+        camera.adaptive_threshold = parse_float(section, "adaptive_threshold", path);
+        if (camera.adaptive_threshold < 0) {
+          throw std::runtime_error(target_file_path + ":camera.adaptive_threshold Expected to be positive or 0");
+        }
+      }
+
+      if (section.contains("min_samples_per_pixel")) {
+        camera.min_samples_per_pixel = parse_number_unsigned(section, "min_samples_per_pixel", path);
+      }
+
+      if (section.contains("spp_heatmap")) {
+        camera.spp_heatmap = parse_string(section, "spp_heatmap", path);
+        const std::string extension = camera.spp_heatmap.substr(std::max<size_t>(camera.spp_heatmap.size(), 4) - 4);
+        if (extension != ".ppm" && extension != ".png" && extension != ".jpg") {
+          throw std::runtime_error(target_file_path + ":camera.spp_heatmap Expected to end with .ppm, .png or .jpg");
+        }
+      }
+
+      if (section.contains("tile_size")) {
+        camera.tile_size = parse_number_unsigned(section, "tile_size", path);
+        if (camera.tile_size == 0 || camera.tile_size % 8 != 0) {
+          throw std::runtime_error(target_file_path + ":camera.tile_size Expected a positive multiple of 8");
+        }
+      }
+    }
+
+    /*
+     * Parse the optional BVH build settings from the json file into the provided options object
+     */
+    void parse_bvh(BVHBuildOptions& options) {
+      if (!target_json.contains("bvh")) {
+        return;
+      }
+
+      const json& section = target_json["bvh"];
+      const ParsePath path("bvh");
+
+      if (section.type() != json::value_t::object) {
+        throw std::runtime_error(target_file_path + ":bvh Expected to be an object");
+      }
+
+      if (section.contains("split")) {
+        const std::string& split = parse_string(section, "split", path);
+        if (split == "sah") {
+          options.split = BVHSplitMethod::SAH;
+        }
+        else if (split == "median") {
+          options.split = BVHSplitMethod::Median;
+        }
+        else if (split == "lbvh") {
+          options.split = BVHSplitMethod::LBVH;
+        }
+        else {
+          throw std::runtime_error(target_file_path + ":bvh.split Expected to be sah, median or lbvh");
+        }
+      }
 
-      camera.aspect_ratio = parse_float(section, "aspect_ratio", "camera.aspect_ratio");
-      camera.image_width = parse_number_unsigned(section, "image_width", "camera.image_width");
-      camera.samples_per_pixel = parse_number_unsigned(section, "samples_per_pixel", "camera.samples_per_pixel");
-      camera.max_depth = parse_number_unsigned(section, "max_depth", "camera.max_depth");
-      camera.background = parse_color(section, "background", "camera.backgound");
-      camera.vfov = parse_number_unsigned(section, "vfov", "camera.vfov");
-      camera.lookfrom = parse_vector3(section, "lookfrom", "camera.lookfrom");
-      camera.lookat = parse_vector3(section, "lookat", "camera.lookat");
-      camera.vup = parse_vector3(section, "vup", "camera.vup");
-      camera.defocus_angle = parse_float(section, "defocus_angle", "camera.defocus_angle");
+      if (section.contains("bins")) {
+        options.bins = parse_number_unsigned(section, "bins", path);
+        if (options.bins < 2 || options.bins > 256) {
+          throw std::runtime_error(target_file_path + ":bvh.bins Expected to be between 2 and 256");
+        }
+      }
+
+      if (section.contains("max_leaf_size")) {
+        options.max_leaf_size = parse_number_unsigned(section, "max_leaf_size", path);
+        if (options.max_leaf_size < 1 || size_t(options.max_leaf_size) > BVHBuilder::MAX_LEAF_PRIMITIVES) {
+          throw std::runtime_error(target_file_path + ":bvh.max_leaf_size Expected to be between 1 and 255");
+        }
+      }
+
+      if (section.contains("traversal_cost")) {
+        options.traversal_cost = parse_float(section, "traversal_cost", path);
+      }
+
+      if (section.contains("intersection_cost")) {
+        options.intersection_cost = parse_float(section, "intersection_cost", path);
+      }
+
+      if (section.contains("width")) {
+        options.width = parse_number_unsigned(section, "width", path);
+        if (options.width != 2 && options.width != 4 && options.width != 8) {
+          throw std::runtime_error(target_file_path + ":bvh.width Expected to be 2, 4 or 8");
+        }
+      }
     }
 
     /*
@@ -86,19 +640,32 @@ class Parser {
       std::queue<std::string> checker_queue;
 
       for (const auto& [key, value]: section.items()) {
-        const std::string type = parse_string(value, "type", "textures." + key + ".type");
+        const ParsePath path("textures", key);
+        const std::string& type = parse_string(value, "type", path);
 
+        CachedTextureRecord record;
         if (type == "SolidColor") {
-          Color albedo = parse_color(value, "albedo", "textures." + key + ".albedo");
-          texture_map[key] = make_shared<SolidColor>(albedo);
+          Color albedo = parse_color(value, "albedo", path);
+          record.type = CachedTextureType::SolidColor;
+          store_values(record.albedo, albedo);
+          add_texture(key, make_shared<SolidColor>(albedo), record, texture_map);
         }
         else if (type == "ImageTexture") {
-          const std::string source = parse_string(value, "source", "textures." + key + ".source");
-          texture_map[key] = make_shared<ImageTexture>(source.c_str());
+          const std::string& source = parse_string(value, "source", path);
+          add_asset(source);
+
+          shared_ptr<ImageTexture> image = make_shared<ImageTexture>(source.c_str());
+          record.type = CachedTextureType::Image;
+          record.image = records.images.size();
+          records.images.push_back(image);
+          add_texture(key, image, record, texture_map);
         }
         else if (type == "NoiseTexture") {
-          double scale = parse_float(value, "scale", "textures." + key + ".scale");
-          texture_map[key] = make_shared<NoiseTexture>(scale);
+          double scale = parse_float(value, "scale", path);
+          record.type = CachedTextureType::Noise;
+          record.scale = scale;
+          // every noise texture gets its own noise, drawn from the stream of its record index
+          add_texture(key, make_shared<NoiseTexture>(scale, records.textures.size()), record, texture_map);
         }
         else if (type == "CheckerTexture") {
           checker_queue.push(key);
@@ -111,25 +678,42 @@ class Parser {
       while (checker_queue.size()) {
         const std::string key = checker_queue.front();
         checker_queue.pop();
-        auto value = section[key];
+        const json& value = section[key];
+        const ParsePath path("textures", key);
 
-        const std::string odd = parse_string(value, "odd", "textures." + key + ".odd");
+        const std::string& odd = parse_string(value, "odd", path);
 
         if (texture_map.find(odd) == texture_map.end()) {
           throw std::runtime_error(target_file_path + ":textures." + key + ".odd Could not find texture named " + odd);
         }
 
-        const std::string even = parse_string(value, "even", "textures." + key + ".even");
+        const std::string& even = parse_string(value, "even", path);
 
         if (texture_map.find(even) == texture_map.end()) {
           throw std::runtime_error(target_file_path + ":textures." + key + ".even Could not find texture named " + even);
         }
 
-        double scale = parse_float(value, "scale", "textures." + key + ".scale");
-        texture_map[key] = make_shared<CheckerTexture>(scale, texture_map[even], texture_map[odd]);
+        double scale = parse_float(value, "scale", path);
+        CachedTextureRecord record;
+        record.type = CachedTextureType::Checker;
+        record.even = texture_records[even];
+        record.odd = texture_records[odd];
+        record.scale = scale;
+        add_texture(key, make_shared<CheckerTexture>(scale, texture_map[even], texture_map[odd]), record, texture_map);
       }
     }
 
+    /*
+     * Add the given texture to the provided textures map, and its record to the records of the scene
+     */
+    void add_texture(const std::string& key, shared_ptr<Texture> texture, const CachedTextureRecord& record,
+        TextureMap& texture_map) {
+      texture_map[key] = texture;
+      texture_records[key] = records.textures.size();
+      records.texture_keys.push_back(key);
+      records.textures.push_back(record);
+    }
+
     /*
      * Parse the materials from the json file into the provided materials map
      * Stores the shared pointers to materials along with their identifiers
@@ -146,44 +730,57 @@ class Parser {
       }
 
       for (const auto& [key, value]: section.items()) {
-        const std::string type = parse_string(value, "type", "materials." + key + ".type");
+        const ParsePath path("materials", key);
+        const std::string& type = parse_string(value, "type", path);
+        CachedMaterialRecord record;
 
         if (type == "Lambertian") {
+          record.type = CachedMaterialType::Lambertian;
           if (value.contains("albedo")) {
-            Color color = parse_color(value, "albedo", "materials." + key + ".albedo");
-            materials_map[key] = make_shared<Lambertian>(color);
+            Color color = parse_color(value, "albedo", path);
+            store_values(record.color, color);
+            add_material(key, make_shared<Lambertian>(color), record, materials_map);
           }
           else if (value.contains("texture")) {
-            const std::string texture_name = parse_string(value, "texture", "materials." + key + ".texture");
+            const std::string& texture_name = parse_string(value, "texture", path);
             if (texture_map.find(texture_name) == texture_map.end()) {
               throw std::runtime_error(target_file_path + ":materials." + key + ".texture Could not find a texture with name " + texture_name );
             }
-            materials_map[key] = make_shared<Lambertian>(texture_map[texture_name]);
+            record.texture = texture_records[texture_name];
+            add_material(key, make_shared<Lambertian>(texture_map[texture_name]), record, materials_map);
           }
           else {
             throw std::runtime_error(target_file_path + ":materials." + key + " Expected either color or texture");
           }
         }
         else if (type == "Metal") {
-          Color albedo = parse_color(value, "albedo", "materials." + key + ".albedo");
-          double fuzz = parse_float(value, "fuzz", "materials." + key + ".fuzz");
-          materials_map[key] = make_shared<Metal>(albedo, fuzz);
+          Color albedo = parse_color(value, "albedo", path);
+          double fuzz = parse_float(value, "fuzz", path);
+          record.type = CachedMaterialType::Metal;
+          store_values(record.color, albedo);
+          record.value = fuzz;
+          add_material(key, make_shared<Metal>(albedo, fuzz), record, materials_map);
         }
         else if (type == "Dielectric") {
-          double refraction_index = parse_float(value, "refractive_index", "materials." + key + ".refractive_index");
-          materials_map[key] = make_shared<Dielectric>(refraction_index);
+          double refraction_index = parse_float(value, "refractive_index", path);
+          record.type = CachedMaterialType::Dielectric;
+          record.value = refraction_index;
+          add_material(key, make_shared<Dielectric>(refraction_index), record, materials_map);
         }
         else if (type == "DiffuseLight") {
+          record.type = CachedMaterialType::DiffuseLight;
           if (value.contains("color")) {
-            Color color = parse_color(value, "color", "materials." + key + ".color");
-            materials_map[key] = make_shared<DiffuseLight>(color);
+            Color color = parse_color(value, "color", path);
+            store_values(record.color, color);
+            add_material(key, make_shared<DiffuseLight>(color), record, materials_map);
           }
           else if (value.contains("texture")) {
-            const std::string texture_name = parse_string(value, "texture", "materials." + key + ".texture");
+            const std::string& texture_name = parse_string(value, "texture", path);
             if (texture_map.find(texture_name) == texture_map.end()) {
               throw std::runtime_error(target_file_path + ":materials." + key + ".texture Could not find a texture with name " + texture_name );
             }
-            materials_map[key] = make_shared<DiffuseLight>(texture_map[texture_name]);
+            record.texture = texture_records[texture_name];
+            add_material(key, make_shared<DiffuseLight>(texture_map[texture_name]), record, materials_map);
           }
           else {
             throw std::runtime_error(target_file_path + ":materials." + key + " Expected either color or texture");
@@ -193,10 +790,21 @@ class Parser {
     }
 
     /*
-     * Parse the entities from the json file into the provided entities map
-     * Stores the shared pointers to entities along with their identifiers
+     * Add the given material to the provided materials map, and its record to the records of the scene
      */
-    void parse_entities(EntityMap& entity_map, MaterialMap& material_map) {
+    void add_material(const std::string& key, shared_ptr<Material> material, const CachedMaterialRecord& record,
+        MaterialMap& materials_map) {
+      materials_map[key] = material;
+      material_records[key] = records.materials.size();
+      records.material_keys.push_back(key);
+      records.materials.push_back(record);
+    }
+
+    /*
+     * Parse the entities left in the json file, the ones that were not streamed, into the provided
+     * list of parsed entities
+     */
+    void parse_entities(std::vector<ParsedEntity>& parsed, const MaterialMap& material_map) {
       if (!target_json.contains("entities")) {
         return;
       }
@@ -208,69 +816,441 @@ class Parser {
       }
 
       for (const auto& [key, value]: section.items()) {
-        const std::string type = parse_string(value, "type", "entities." + key + ".type");
-        const std::string material_name = parse_string(value, "material", "entities." + key + ".material");
+        parsed.push_back(parse_entity(key, value, material_map, ParsePath("entities", key)));
+      }
+    }
 
-        if (material_map.find(material_name) ==material_map.end()) {
-          throw std::runtime_error(target_file_path + ":materials." + key + ".material Could not find a material with name " + material_name);
+    /*
+     * Parse the prototypes from the json file, groups of entities that Instance entities place
+     * copies of. Each group with more than one entity gets its own BVH.
+     */
+    void parse_prototypes(const MaterialMap& material_map) {
+      if (!target_json.contains("prototypes")) {
+        return;
+      }
+
+      const json& section = target_json["prototypes"];
+
+      if (section.type() != json::value_t::object) {
+        throw std::runtime_error(target_file_path + ":prototypes Expected to be an object");
+      }
+
+      for (const auto& [name, members]: section.items()) {
+        if (members.type() != json::value_t::object || members.empty()) {
+          throw std::runtime_error(target_file_path + ":prototypes." + name + " Expected to be an object of entities");
         }
 
-        if (type == "Sphere") {
-          Vector3 position = parse_vector3(value, "center", "entities." + key + ".center");
-          double radius = parse_float(value, "radius", "entities." + key + ".radius");
-          if (radius < 0) {
-            throw std::runtime_error(target_file_path + ":entities." + key + " Expected radius to be positive");
+        std::vector<ParsedEntity> parsed;
+        for (const auto& [key, value]: members.items()) {
+          const ParsePath path("prototypes", name, key);
+          if (is_instance(value)) {
+            throw std::runtime_error(target_file_path + ":" + path.to_string("type") + " Instances can not be placed in prototypes");
           }
-          entity_map[key] = make_shared<Sphere>(position, radius, material_map[material_name]);
-        }
-        else if (type == "Quad") {
-          Vector3 center = parse_vector3(value, "center", "entities." + key + ".center");
-          Vector3 horizontal = parse_vector3(value, "horizontal", "entities." + key + ".horizontal");
-          Vector3 vertical = parse_vector3(value, "vertical", "entities." + key + ".vertical");
-          entity_map[key] = make_shared<Quad>(center, horizontal, vertical, material_map[material_name]);
-        }
-        else if (type == "Box") {
-          Vector3 center = parse_vector3(value, "center", "entities." + key + ".center");
-          Vector3 dimensions = parse_vector3(value, "dimensions", "entities." + key + ".dimensions");
-          Vector3 rotations = parse_vector3(value, "rotations", "entities." + key + ".rotations");
-          if (dimensions[0] < 0) {
-            throw std::runtime_error(target_file_path + ":entities." + key + "dimensions[0] Can not be negative");
-          }
-          if (dimensions[1] < 0) {
-            throw std::runtime_error(target_file_path + ":entities." + key + "dimensions[1] Can not be negative");
-          }
-          if (dimensions[2] < 0) {
-            throw std::runtime_error(target_file_path + ":entities." + key + "dimensions[2] Can not be negative");
-          }
-          entity_map[key] = box(center, dimensions, rotations, material_map[material_name]);
+
+          parsed.push_back(parse_entity(key, value, material_map, path));
+        }
+
+        CachedPrototypeRecord record;
+        record.first = records.prototype_members.size();
+
+        EntityList entities, emitters;
+        add_entities(parsed, entities, emitters, records.prototype_members);
+        if (entities.list.empty()) {
+          throw std::runtime_error(target_file_path + ":prototypes." + name + " Expected to have an entity of a known type");
         }
+        record.count = entities.list.size();
+
+        Prototype& prototype = prototypes[name];
+        prototype.index = records.prototypes.size();
+        add_prototype(prototype, entities, emitters);
+        records.prototypes.push_back(record);
       }
     }
 
-  private:
-    const std::string target_file_path;  // path to the target json file
-    json target_json;                    // parsed json object
+    /*
+     * Make the given prototype out of the given entities and the ones of them sampled as lights
+     */
+    static void add_prototype(Prototype& prototype, const EntityList& entities, const EntityList& emitters) {
+      prototype.entity = entities.list.size() == 1 ? entities.list[0] : make_shared<LinearBVH>(entities);
+      prototype.emitters = emitters.list;
+    }
+
+    /*
+     * Return if the given json value is an entity of type Instance
+     * Values with a missing or malformed type are left for parse_entity to report
+     */
+    static bool is_instance(const json& value) {
+      if (!value.is_object()) {
+        return false;
+      }
+
+      auto type_it = value.find("type");
+      return type_it != value.end() && type_it->is_string() && type_it->get_ref<const std::string&>() == "Instance";
+    }
+
+    /*
+     * Create the entity with the given key from its json value at the given path
+     * Entities of unknown types are returned without an entity
+     */
+    ParsedEntity parse_entity(const std::string& key, const json& value, const MaterialMap& material_map,
+        const ParsePath& path) {
+      const std::string& type = parse_string(value, "type", path);
+      if (type == "Instance") {
+        return parse_instance(key, value, path);
+      }
+
+      const std::string& material_name = parse_string(value, "material", path);
+
+      auto material_it = material_map.find(material_name);
+      if (material_it == material_map.end()) {
+        throw std::runtime_error(target_file_path + ":" + path.to_string("material") + " Could not find a material with name " + material_name);
+      }
+      const shared_ptr<Material>& material = material_it->second;
+
+      ParsedEntity parsed { key, nullptr, material->is_emissive(), CachedEntityRecord() };
+      CachedEntityRecord& record = parsed.record;
+      record.material = material_records[material_name];
+
+      if (type == "Sphere") {
+        Vector3 position = parse_vector3(value, "center", path);
+        double radius = parse_float(value, "radius", path);
+        if (radius < 0) {
+          throw std::runtime_error(target_file_path + ":" + path.to_string("radius") + " Expected to be positive");
+        }
+        record.type = CachedEntityType::Sphere;
+        store_values(record.values, position);
+        record.values[3] = radius;
+        parsed.entity = make_shared<Sphere>(position, radius, material);
+      }
+      else if (type == "Quad") {
+        Vector3 center = parse_vector3(value, "center", path);
+        Vector3 horizontal = parse_vector3(value, "horizontal", path);
+        Vector3 vertical = parse_vector3(value, "vertical", path);
+        record.type = CachedEntityType::Quad;
+        store_values(record.values, center);
+        store_values(record.values + 3, horizontal);
+        store_values(record.values + 6, vertical);
+        parsed.entity = make_shared<Quad>(center, horizontal, vertical, material);
+      }
+      else if (type == "Box") {
+        Vector3 center = parse_vector3(value, "center", path);
+        Vector3 dimensions = parse_vector3(value, "dimensions", path);
+        Vector3 rotations = parse_vector3(value, "rotations", path);
+        if (dimensions[0] < 0) {
+          throw std::runtime_error(target_file_path + ":" + path.to_string("dimensions[0]") + " Can not be negative");
+        }
+        if (dimensions[1] < 0) {
+          throw std::runtime_error(target_file_path + ":" + path.to_string("dimensions[1]") + " Can not be negative");
+        }
+        if (dimensions[2] < 0) {
+          throw std::runtime_error(target_file_path + ":" + path.to_string("dimensions[2]") + " Can not be negative");
+        }
+        record.type = CachedEntityType::Box;
+        store_values(record.values, center);
+        store_values(record.values + 3, dimensions);
+        store_values(record.values + 6, rotations);
+        parsed.entity = make_shared<Box>(center, dimensions, rotations, material);
+      }
+      else if (type == "TriangleMesh") {
+        const std::string& source = parse_string(value, "source", path);
+        add_asset(source);
+
+        // the mesh record is assigned once the entity is added
+        record.type = CachedEntityType::TriangleMesh;
+
+        shared_ptr<const Mesh> mesh = load_mesh(source);
+
+        // placed copies of the mesh get their own buffers, unplaced ones share the loaded buffers
+        if (value.contains("center") || value.contains("scale") || value.contains("rotations")) {
+          double scale;
+          Vector3 rotations, center;
+          parse_placement(value, path, scale, rotations, center);
+
+          shared_ptr<Mesh> placed = make_shared<Mesh>(*mesh);
+          placed->transform(scale, rotations, center);
+          mesh = placed;
+        }
+        parsed.entity = make_shared<TriangleMesh>(mesh, material);
+      }
+
+      return parsed;
+    }
+
+    /*
+     * Create the Instance entity with the given key from its json value at the given path
+     */
+    ParsedEntity parse_instance(const std::string& key, const json& value, const ParsePath& path) {
+      const std::string& prototype_name = parse_string(value, "prototype", path);
+
+      auto prototype_it = prototypes.find(prototype_name);
+      if (prototype_it == prototypes.end()) {
+        throw std::runtime_error(target_file_path + ":" + path.to_string("prototype") + " Could not find a prototype with name " + prototype_name);
+      }
+      const Prototype& prototype = prototype_it->second;
+
+      double scale;
+      Vector3 rotations, center;
+      parse_placement(value, path, scale, rotations, center);
+
+      shared_ptr<Instance> instance = make_shared<Instance>(prototype.entity, prototype.emitters,
+          Transform(scale, rotations, center));
+
+      CachedEntityRecord record;
+      record.type = CachedEntityType::Instance;
+      record.index = prototype.index;
+      store_values(record.values, center);
+      store_values(record.values + 3, rotations);
+      record.values[6] = scale;
+      return ParsedEntity { key, instance, !prototype.emitters.empty(), record };
+    }
+
+    /*
+     * Parse the optional scale, rotations and center that place a mesh or an instance from the
+     * given json value, which default to leaving it in place
+     */
+    void parse_placement(const json& value, const ParsePath& path, double& scale, Vector3& rotations, Vector3& center) {
+      scale = value.contains("scale") ? parse_float(value, "scale", path) : 1;
+      rotations = value.contains("rotations") ? parse_vector3(value, "rotations", path) : Vector3(0, 0, 0);
+      center = value.contains("center") ? parse_vector3(value, "center", path) : Vector3(0, 0, 0);
+      if (scale <= 0) {
+        throw std::runtime_error(target_file_path + ":" + path.to_string("scale") + " Expected to be positive");
+      }
+    }
+
+    /*
+     * Add the parsed entities to the provided list in the order of their keys, and their records
+     * to the provided list of records. Of entities sharing a key the last one read is kept.
+     * Emitters are also added to the provided list of lights, so that they can be sampled
+     * directly by the integrator.
+     */
+    void add_entities(std::vector<ParsedEntity>& parsed, EntityList& entities, EntityList& lights,
+        std::vector<CachedEntityRecord>& entity_records) {
+      std::stable_sort(parsed.begin(), parsed.end(), [](const ParsedEntity& a, const ParsedEntity& b) {
+        return a.key < b.key;
+      });
+
+      for (size_t i = 0; i < parsed.size(); i++) {
+        if ((i + 1 < parsed.size() && parsed[i + 1].key == parsed[i].key) || !parsed[i].entity) {
+          continue;
+        }
+
+        if (parsed[i].record.type == CachedEntityType::TriangleMesh) {
+          parsed[i].record.index = records.meshes.size();
+          records.meshes.push_back(std::static_pointer_cast<TriangleMesh>(parsed[i].entity));
+        }
+
+        entities.add(parsed[i].entity);
+        entity_records.push_back(parsed[i].record);
+        add_light(parsed[i], lights);
+      }
+    }
+
+    /*
+     * Add the given entity to the provided list of lights if it is emissive
+     */
+    static void add_light(const ParsedEntity& parsed, EntityList& lights) {
+      if (!parsed.emissive) {
+        return;
+      }
+
+      // each emitter of an instance is sampled as its own light
+      if (parsed.record.type == CachedEntityType::Instance) {
+        for (const auto& emitter : static_cast<const Instance&>(*parsed.entity).get_emitters()) {
+          lights.add(emitter);
+        }
+      }
+      else {
+        lights.add(parsed.entity);
+      }
+    }
+
+    /*
+     * Create the scene from the records of the cache. Only the camera and bvh settings are parsed,
+     * every texture, material, prototype and entity is created straight from its record.
+     */
+    void load_cache(Camera& camera, BVHBuildOptions& bvh_options, TextureMap& texture_map,
+        MaterialMap& material_map, EntityList& entities, EntityList& lights) {
+      target_json = json::parse(cache->get_settings(), nullptr, false);
+      if (!target_json.is_object()) {
+        throw std::runtime_error(target_file_path + ": Scene cache is damaged");
+      }
+      parse_camera(camera);
+      parse_bvh(bvh_options);
+      assets = cache->get_assets();
+
+      std::vector<shared_ptr<Texture>> textures;
+      for (const CachedTextureRecord& record : cache->get_textures()) {
+        const uint64_t index = textures.size();
+        shared_ptr<Texture> texture;
+        if (record.type == CachedTextureType::SolidColor) {
+          texture = make_shared<SolidColor>(load_color(record.albedo));
+        }
+        else if (record.type == CachedTextureType::Image) {
+          const CachedImage& image = cache->get_image(record.image);
+          texture = make_shared<ImageTexture>(image.pixels, image.width, image.height);
+        }
+        else if (record.type == CachedTextureType::Noise) {
+          texture = make_shared<NoiseTexture>(record.scale, index);
+        }
+        else {
+          texture = make_shared<CheckerTexture>(record.scale, textures[record.even], textures[record.odd]);
+        }
+        texture_map[cache->get_key(record.key)] = texture;
+        textures.push_back(texture);
+      }
+
+      std::vector<shared_ptr<Material>> materials;
+      for (const CachedMaterialRecord& record : cache->get_materials()) {
+        shared_ptr<Material> material;
+        if (record.type == CachedMaterialType::Lambertian) {
+          material = record.texture == CACHE_NONE ? make_shared<Lambertian>(load_color(record.color))
+            : make_shared<Lambertian>(textures[record.texture]);
+        }
+        else if (record.type == CachedMaterialType::Metal) {
+          material = make_shared<Metal>(load_color(record.color), record.value);
+        }
+        else if (record.type == CachedMaterialType::Dielectric) {
+          material = make_shared<Dielectric>(record.value);
+        }
+        else {
+          material = record.texture == CACHE_NONE ? make_shared<DiffuseLight>(load_color(record.color))
+            : make_shared<DiffuseLight>(textures[record.texture]);
+        }
+        material_map[cache->get_key(record.key)] = material;
+        materials.push_back(material);
+      }
+
+      std::vector<Prototype> cached_prototypes;
+      for (const CachedPrototypeRecord& record : cache->get_prototypes()) {
+        EntityList members, emitters;
+        for (uint64_t i = record.first; i < record.first + record.count; i++) {
+          ParsedEntity parsed = load_entity(cache->get_prototype_members()[i], materials, cached_prototypes);
+          members.add(parsed.entity);
+          add_light(parsed, emitters);
+        }
+
+        Prototype prototype;
+        prototype.index = cached_prototypes.size();
+        add_prototype(prototype, members, emitters);
+        cached_prototypes.push_back(prototype);
+      }
+
+      const CachedEntityRecord* world = cache->get_world_entities();
+      entities.list.reserve(cache->world_entity_count());
+      for (size_t i = 0; i < cache->world_entity_count(); i++) {
+        ParsedEntity parsed = load_entity(world[i], materials, cached_prototypes);
+        entities.add(parsed.entity);
+        add_light(parsed, lights);
+      }
+    }
+
+    /*
+     * Create the entity of the given record of the cache, whose materials and prototypes are
+     * given by record index
+     */
+    ParsedEntity load_entity(const CachedEntityRecord& record, const std::vector<shared_ptr<Material>>& materials,
+        const std::vector<Prototype>& cached_prototypes) {
+      const double* v = record.values;
+
+      if (record.type == CachedEntityType::Instance) {
+        const Prototype& prototype = cached_prototypes[record.index];
+        shared_ptr<Instance> instance = make_shared<Instance>(prototype.entity, prototype.emitters,
+            Transform(v[6], Vector3(v[3], v[4], v[5]), Vector3(v[0], v[1], v[2])));
+        return ParsedEntity { std::string(), instance, !prototype.emitters.empty(), record };
+      }
+
+      const shared_ptr<Material>& material = materials[record.material];
+      ParsedEntity parsed { std::string(), nullptr, material->is_emissive(), record };
+
+      if (record.type == CachedEntityType::Sphere) {
+        parsed.entity = make_shared<Sphere>(Vector3(v[0], v[1], v[2]), v[3], material);
+      }
+      else if (record.type == CachedEntityType::Quad) {
+        parsed.entity = make_shared<Quad>(Vector3(v[0], v[1], v[2]), Vector3(v[3], v[4], v[5]),
+            Vector3(v[6], v[7], v[8]), material);
+      }
+      else if (record.type == CachedEntityType::Box) {
+        parsed.entity = make_shared<Box>(Vector3(v[0], v[1], v[2]), Vector3(v[3], v[4], v[5]),
+            Vector3(v[6], v[7], v[8]), material);
+      }
+      else {
+        parsed.entity = make_shared<TriangleMesh>(cache->get_mesh(record.index), cache, material);
+      }
+
+      return parsed;
+    }
+
+    /*
+     * Store the components of the given vector or color in the given values of a record
+     */
+    template <typename T>
+    static void store_values(double* values, const T& vector) {
+      values[0] = vector[0];
+      values[1] = vector[1];
+      values[2] = vector[2];
+    }
+
+    /*
+     * Return the color stored in the given values of a record
+     */
+    static Color load_color(const double* values) {
+      return Color(values[0], values[1], values[2]);
+    }
+
+    /*
+     * Record the given path as an asset of the scene, once
+     */
+    void add_asset(const std::string& path) {
+      if (std::find(assets.begin(), assets.end(), path) == assets.end()) {
+        assets.push_back(path);
+      }
+    }
+
+    /*
+     * Returns the mesh in the given file, loading it on its first use
+     */
+    shared_ptr<const Mesh> load_mesh(const std::string& source) {
+      auto it = meshes.find(source);
+      if (it != meshes.end()) {
+        return it->second;
+      }
+
+      shared_ptr<const Mesh> mesh = Mesh::load(source);
+      std::clog << "[INFO]: Loaded mesh " << source << " with " << mesh->vertex_count() << " vertices and "
+        << mesh->triangle_count() << " triangles\n";
+      meshes[source] = mesh;
+      return mesh;
+    }
+
+    /*
+     * Return the given value of the given json section
+     * Throws if the section does not have the value
+     */
+    const json& find_value(const json& section, const char* value, const ParsePath& path) {
+      auto it = section.find(value);
+      if (it == section.end()) {
+        throw std::runtime_error(target_file_path + ":" + path.to_string(value) + " Path not found");
+      }
+      return *it;
+    }
 
     /*
      * Parse a 3 element array of given value as a Vector3 object from the given json section
      * Throws relavent errors with the given path to the value
      */
-    Vector3 parse_vector3(const json& section, const std::string& value, const std::string& path) {
-      if (!section.contains(value)) {
-        throw std::runtime_error(target_file_path + ":" + path + " Path not found");
-      }
+    Vector3 parse_vector3(const json& section, const char* value, const ParsePath& path) {
+      const json& vector_json = find_value(section, value, path);
 
-      if (section[value].type() != json::value_t::array) {
-        throw std::runtime_error(target_file_path + ":" + path + " Expected to be an array");
+      if (vector_json.type() != json::value_t::array) {
+        throw std::runtime_error(target_file_path + ":" + path.to_string(value) + " Expected to be an array");
       }
 
       Vector3 vector;
-      const json& vector_json = section[value];
       for (int i = 0; i < 3; i++) {
         if (vector_json[i].type() != json::value_t::number_float
             && vector_json[i].type() != json::value_t::number_unsigned
             && vector_json[i].type() != json::value_t::number_integer) {
-          throw std::runtime_error(target_file_path + ":" + path + " Expected to be a float");
+          throw std::runtime_error(target_file_path + ":" + path.to_string(value) + " Expected to be a float");
         }
 
         vector[i] = vector_json[i];
@@ -283,21 +1263,18 @@ class Parser {
      * Parse a 3 element array of given value as a Color object from the given json section
      * Throws relavent errors with the given path to the value
      */
-    Color parse_color(const json& section, const std::string& value, const std::string& path) {
-      if (!section.contains(value)) {
-        throw std::runtime_error(target_file_path + ":" + path + " Path not found");
-      }
+    Color parse_color(const json& section, const char* value, const ParsePath& path) {
+      const json& color_json = find_value(section, value, path);
 
-      if (section[value].type() != json::value_t::array) {
-        throw std::runtime_error(target_file_path + ":" + path + " Expected to be an array");
+      if (color_json.type() != json::value_t::array) {
+        throw std::runtime_error(target_file_path + ":" + path.to_string(value) + " Expected to be an array");
       }
 
       Color color;
-      const json& color_json = section[value];
       for (int i = 0; i < 3; i++) {
         if (color_json[i].type() != json::value_t::number_float &&
             color_json[i].type() != json::value_t::number_unsigned) {
-          throw std::runtime_error(target_file_path + ":" + path + " Expected to be a float");
+          throw std::runtime_error(target_file_path + ":" + path.to_string(value) + " Expected to be a float");
         }
 
         color[i] = color_json[i];
@@ -310,50 +1287,72 @@ class Parser {
      * Parse a string of given value from the given json section
      * Throws relavent errors with the given path to the value
      */
-    std::string parse_string(const json& section, const std::string& value, const std::string& path) {
-      if (!section.contains(value)) {
-        throw std::runtime_error(target_file_path + ":" + path + " Path not found");
-      }
+    const std::string& parse_string(const json& section, const char* value, const ParsePath& path) {
+      const json& string_json = find_value(section, value, path);
 
-      if (section[value].type() != json::value_t::string) {
-        throw std::runtime_error(target_file_path + ":" + path + " Expected to be string");
+      if (string_json.type() != json::value_t::string) {
+        throw std::runtime_error(target_file_path + ":" + path.to_string(value) + " Expected to be string");
       }
 
-      return section[value];
+      return string_json.get_ref<const std::string&>();
     }
 
     /*
      * Parse a decimal number of given value from the given json section
      * Throws relavent errors with the given path to the value
      */
-    double parse_float(const json& section, const std::string& value, const std::string& path) {
-      if (!section.contains(value)) {
-        throw std::runtime_error(target_file_path + ":" + path + " Path not found");
-      }
+    double parse_float(const json& section, const char* value, const ParsePath& path) {
+      const json& number_json = find_value(section, value, path);
 
-      if (section[value].type() != json::value_t::number_float
-          && section[value].type() != json::value_t::number_integer
-          && section[value].type() != json::value_t::number_unsigned) {
-        throw std::runtime_error(target_file_path + ":" + path + " Expected to be a float");
+      if (number_json.type() != json::value_t::number_float
+          && number_json.type() != json::value_t::number_integer
+          && number_json.type() != json::value_t::number_unsigned) {
+        throw std::runtime_error(target_file_path + ":" + path.to_string(value) + " Expected to be a float");
       }
 
-      return section[value];
+      return number_json;
     }
 
     /*
      * Parse a positive integer of given value from the given json section
      * Throws relavent errors with the given path to the value
      */
-    int parse_number_unsigned(const json& section, const std::string& value, const std::string& path) {
-      if (!section.contains(value)) {
-        throw std::runtime_error(target_file_path + ":" + path + " Path not found");
+    int parse_number_unsigned(const json& section, const char* value, const ParsePath& path) {
+      const json& number_json = find_value(section, value, path);
+
+      if (number_json.type() != json::value_t::number_unsigned) {
+        throw std::runtime_error(target_file_path + ":" + path.to_string(value) + " Expected to be a positive integer");
       }
 
-      if (section[value].type() != json::value_t::number_unsigned) {
-        throw std::runtime_error(target_file_path + ":" + path + " Expected to be a positive integer");
+      return number_json;
+    }
+
+    /*
+     * Parse a positive integer of given value from the given json section as a 64 bit integer
+     * Throws relavent errors with the given path to the value
+     */
+    uint64_t parse_uint64(const json& section, const char* value, const ParsePath& path) {
+      const json& number_json = find_value(section, value, path);
+
+      if (number_json.type() != json::value_t::number_unsigned) {
+        throw std::runtime_error(target_file_path + ":" + path.to_string(value) + " Expected to be a positive integer");
+      }
+
+      return number_json.get<uint64_t>();
+    }
+
+    /*
+     * Parse a boolean of given value from the given json section
+     * Throws relavent errors with the given path to the value
+     */
+    bool parse_bool(const json& section, const char* value, const ParsePath& path) {
+      const json& bool_json = find_value(section, value, path);
+
+      if (bool_json.type() != json::value_t::boolean) {
+        throw std::runtime_error(target_file_path + ":" + path.to_string(value) + " Expected to be true or false");
       }
 
-      return section[value];
+      return bool_json;
     }
 };
 
@@ -9,15 +9,21 @@
 
 class Perlin {
   public:
-    Perlin() {
+    /*
+     * Constructs the noise with its gradients and permutations drawn from the given stream, so
+     * that generators on different streams give different noise and each is the same every run
+     */
+    Perlin(uint64_t stream = 0) {
+      Rng rng(0, stream);
+
       for (int i = 0; i < point_count; i++) {
-        randvec[i] = unit_vector(Vector3::random(-1, 1));
+        randvec[i] = unit_vector(Vector3::random(rng, -1, 1));
       }
 
 
-      perline_generate_perm(perm_x);
-      perline_generate_perm(perm_y);
-      perline_generate_perm(perm_z);
+      perline_generate_perm(perm_x, rng);
+      perline_generate_perm(perm_y, rng);
+      perline_generate_perm(perm_z, rng);
 
     }
 
@@ -67,17 +73,17 @@ class Perlin {
     int perm_y[point_count];
     int perm_z[point_count];
 
-    static void perline_generate_perm(int* p) {
+    static void perline_generate_perm(int* p, Rng& rng) {
       for (int i = 0; i < point_count; i++) {
         p[i] = i;
       }
 
-      permute(p, point_count);
+      permute(p, point_count, rng);
     }
 
-    static void permute(int* p, int n) {
+    static void permute(int* p, int n, Rng& rng) {
       for (int i = n - 1; i > 0; i--) {
-        int target = random_int(0, i);
+        int target = random_int(rng, 0, i);
         std::swap(p[i], p[target]);
       }
     }
@@ -0,0 +1,93 @@
+#ifndef PIXEL_STATISTICS_H_
+#define PIXEL_STATISTICS_H_
+
+#include <cmath>
+
+#include "color.h"
+#include "interval.h"
+
+/*
+ * Returns half the spread in gamma space of a pixel value of mean luminance plus and minus the
+ * standard error of count samples of the given variance.
+ */
+inline double display_error(double mean, double variance, int count) {
+  if (count == 0) {
+    return 0;
+  }
+
+  const double standard_error = std::sqrt(variance / count);
+  const Interval intensity(0, 1);
+  return (linear_to_gamma(intensity.clamp(mean + standard_error))
+      - linear_to_gamma(intensity.clamp(mean - standard_error))) / 2;
+}
+
+// ==============================
+// PixelStatistics class
+// ==============================
+
+/*
+ * Running estimate of one pixel: the sum of its sample colors, and the mean and variance of their
+ * luminance, updated one sample at a time with Welford's algorithm.
+ */
+class PixelStatistics {
+  public:
+    Color sum = Color(0, 0, 0);  // sum of the sample colors
+    int count = 0;               // number of samples taken
+    double mean_luminance = 0;   // mean luminance of the samples
+    double m2 = 0;               // sum of the squared differences from mean_luminance
+
+    /*
+     * Adds a sample color to the estimate.
+     */
+    void add(const Color& sample) {
+      sum += sample;
+      count++;
+
+      const double y = luminance(sample);
+      const double delta = y - mean_luminance;
+      mean_luminance += delta / count;
+      m2 += delta * (y - mean_luminance);
+    }
+
+    /*
+     * Returns the mean color of the samples, black if none were taken.
+     */
+    Color mean() const {
+      return (count > 0) ? sum * (1.0 / count) : Color(0, 0, 0);
+    }
+
+    /*
+     * Returns the sample variance of the luminance.
+     */
+    double variance() const {
+      return (count > 1) ? m2 / (count - 1) : 0;
+    }
+
+    /*
+     * Returns the estimated standard error of the pixel once it is clamped and converted to gamma
+     * space like the written image, in the units of a pixel value between 0 and 1. The same noise
+     * is far more visible in dark pixels than in bright ones, and none of it shows in saturated ones.
+     */
+    double error() const {
+      return display_error(mean_luminance, variance(), count);
+    }
+};
+
+/*
+ * Returns the estimated error of a block of pixels that have all taken the same number of samples:
+ * the error of a pixel with the average luminance and variance of the block. Pooling the pixels
+ * catches noise that some of them have not shown yet, such as light that only reaches a few of
+ * the samples of a dark pixel.
+ */
+inline double block_error(const PixelStatistics pixels[], int count) {
+  double variance_sum = 0;
+  double luminance_sum = 0;
+  for (int i = 0; i < count; i++) {
+    variance_sum += pixels[i].variance();
+    luminance_sum += pixels[i].mean_luminance;
+  }
+
+  return display_error(luminance_sum / count, variance_sum / count, pixels[0].count);
+}
+
+#endif //!PIXEL_STATISTICS_H_
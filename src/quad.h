@@ -9,7 +9,9 @@
 #include "ray.h"
 #include "interval.h"
 #include "entity.h"
-#include "entity_list.h"
+#include "material.h"
+#include "color.h"
+#include "trace_stats.h"
 
 // ==============================
 // Quad class
@@ -31,6 +33,7 @@ class Quad : public Entity {
         normal = unit_vector(n);
         D = dot(normal, Q);
         w = n / dot(n, n);
+        area = n.length();
 
         set_bounding_box();
       }
@@ -57,6 +60,7 @@ class Quad : public Entity {
      * Returns true if the ray hits, else returns false.
      */
     bool hit(const Ray& r, Interval ray_t, HitRecord& rec) const override {
+      RAYMOND_STAT(quad_tests++);
       double denom = dot(normal, r.direction());
 
       // Ray is parallel to plane
@@ -87,11 +91,47 @@ class Quad : public Entity {
       rec.t = t;
       rec.p = intersection;
       rec.mat = mat;
+      rec.entity = this;
       rec.set_face_normal(r, normal);
 
       return true;
     }
 
+    /*
+     * Returns the density of sampling the given direction by picking a uniform point on the quad,
+     * converted from area to solid angle.
+     */
+    double pdf_value(const Point3& origin, const Vector3& direction) const override {
+      HitRecord rec;
+      if (!hit(Ray(origin, direction), Interval(0.001, infinity), rec)) {
+        return 0;
+      }
+
+      double distance_squared = rec.t * rec.t * direction.length_squared();
+      double cosine = std::fabs(dot(direction, rec.normal) / direction.length());
+
+      return distance_squared / (cosine * area);
+    }
+
+    /*
+     * Returns the direction from the given origin to a uniformly chosen point on the quad.
+     */
+    Vector3 random(const Point3& origin, Sampler& sampler) const override {
+      const Vector3 uv = sampler.get_2d();
+      Point3 p = Q + (uv.x() * u) + (uv.y() * v);
+      return p - origin;
+    }
+
+    /*
+     * Bounds of the light of the quad, which emits from both sides into the hemisphere around its
+     * normal. Textured emission is estimated by its value at the center.
+     */
+    LightBounds light_bounds() const override {
+      const Color emission = mat->emitted(0.5, 0.5, Q + 0.5 * u + 0.5 * v);
+      const double power = 2 * pi * area * luminance(emission);
+      return LightBounds(bound_box, power, DirectionCone(normal, 1), 0, true);
+    }
+
   private:
     Point3 Q;                  // bottom left corner of the quad
     Vector3 u;                 // horizontal length of the quad
@@ -99,40 +139,9 @@ class Quad : public Entity {
     Vector3 w;
     Vector3 normal;            // normal vector of the quad
     double  D;                 // Ax + By + Cz = D
+    double area;               // area of the quad
     shared_ptr<Material> mat;  // material of the quad
     Aabb bound_box;            // bounding box of the quad
 };
 
-
-inline shared_ptr<EntityList> box(const Point3& center,
-    const Vector3& dimensions, const Vector3& rotations, shared_ptr<Material> mat) {
-
-  double length = dimensions[0];
-  double width = dimensions[1];
-  double height = dimensions[2];
-
-  double rotation_x = rotations[0];
-  double rotation_y = rotations[1];
-  double rotation_z = rotations[2];
-
-  shared_ptr<EntityList> sides = make_shared<EntityList>();
-
-  Vector3 width_vec = Vector3(width, 0, 0);
-  Vector3 height_vec = Vector3(0, height, 0);
-  Vector3 length_vec = Vector3(0, 0, length);
-
-  width_vec = width_vec.rotate(rotation_x, 0).rotate(rotation_y, 1).rotate(rotation_z, 2);
-  height_vec = height_vec.rotate(rotation_x, 0).rotate(rotation_y, 1).rotate(rotation_z, 2);
-  length_vec = length_vec.rotate(rotation_x, 0).rotate(rotation_y, 1).rotate(rotation_z, 2);
-
-  sides->add(make_shared<Quad>(center - length_vec / 2, width_vec, height_vec, mat));
-  sides->add(make_shared<Quad>(center + length_vec / 2, width_vec, height_vec, mat));
-  sides->add(make_shared<Quad>(center - width_vec / 2, length_vec, height_vec, mat));
-  sides->add(make_shared<Quad>(center + width_vec / 2, length_vec, height_vec, mat));
-  sides->add(make_shared<Quad>(center - height_vec / 2, width_vec, length_vec, mat));
-  sides->add(make_shared<Quad>(center + height_vec / 2, width_vec, length_vec, mat));
-
-  return sides;
-}
-
 #endif //!QUAD_H_
@@ -0,0 +1,168 @@
+#ifndef RAY_PACKET_H_
+#define RAY_PACKET_H_
+
+#include <cstdint>
+#include <limits>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "raymond.h"
+#include "ray.h"
+#include "interval.h"
+#include "bvh_builder.h"
+
+// ==============================
+// Constants
+// ==============================
+
+const int MAX_PACKET_SIZE = 16;  // most rays that can be traced together
+
+// ==============================
+// RayPacket class
+// ==============================
+
+/*
+ * Single precision copy of up to K coherent rays stored as structure of arrays so that one SIMD
+ * slab test checks a box against every ray of the packet.
+ * Lanes past the number of rays in the packet have an empty interval and never hit.
+ */
+template <int K>
+class alignas(64) RayPacket {
+  public:
+    float origin[3][K];   // origins of the rays, one row per axis
+    float inv_dir[3][K];  // inverse directions of the rays, one row per axis
+    float t_min[K];       // start of the interval of each ray
+    float t_max[K];       // end of the interval of each ray, shrinks as hits are found
+    bool neg[3];          // sign of the direction of the first ray, used to order children
+    uint32_t lanes;       // bit mask of the lanes holding a ray
+
+    /*
+     * Copies the given rays and intervals into the packet.
+     */
+    RayPacket(const Ray rays[], const Interval ray_t[], int count) {
+      lanes = (count >= 32) ? ~0u : (1u << count) - 1;
+
+      for (int i = 0; i < K; i++) {
+        for (int axis = 0; axis < 3; axis++) {
+          origin[axis][i] = (i < count) ? float(rays[i].origin().e[axis]) : 0;
+          inv_dir[axis][i] = (i < count) ? float(1.0 / rays[i].direction().e[axis]) : 0;
+        }
+        t_min[i] = (i < count) ? float(ray_t[i].min) : 0;
+        t_max[i] = (i < count) ? float(ray_t[i].max) : -std::numeric_limits<float>::infinity();
+      }
+
+      for (int axis = 0; axis < 3; axis++) {
+        neg[axis] = inv_dir[axis][0] < 0;
+      }
+    }
+
+    /*
+     * Slab test of every ray against the bounds of the given node. Returns a bit mask of the lanes
+     * whose ray enters the box within its interval.
+     */
+    uint32_t intersect(const LinearBVHNode& node) const {
+#if defined(__AVX__)
+      if constexpr (K % 8 == 0) {
+        return intersect_avx(node);
+      }
+#endif
+#if defined(__SSE2__)
+      if constexpr (K % 4 == 0) {
+        return intersect_sse(node);
+      }
+#endif
+      return intersect_scalar(node);
+    }
+
+    /*
+     * Portable version of intersect that tests one ray at a time.
+     */
+    uint32_t intersect_scalar(const LinearBVHNode& node) const {
+      uint32_t mask = 0;
+      for (int i = 0; i < K; i++) {
+        float t0 = t_min[i];
+        float t1 = t_max[i];
+        for (int axis = 0; axis < 3; axis++) {
+          const float t_a = (node.bounds_min[axis] - origin[axis][i]) * inv_dir[axis][i];
+          const float t_b = (node.bounds_max[axis] - origin[axis][i]) * inv_dir[axis][i];
+          const float t_enter = t_a < t_b ? t_a : t_b;
+          const float t_exit = t_a < t_b ? t_b : t_a;
+
+          t0 = t_enter > t0 ? t_enter : t0;
+          t1 = t_exit < t1 ? t_exit : t1;
+        }
+
+        if (t0 <= t1 * ROUNDING_SLACK) {
+          mask |= 1u << i;
+        }
+      }
+
+      return mask;
+    }
+
+  private:
+    static constexpr float ROUNDING_SLACK = 1.0000004f;  // widens exit distances to absorb the
+                                                         // rounding of the single precision test
+
+#if defined(__SSE2__)
+    /*
+     * SSE version of intersect that tests four rays per instruction.
+     */
+    uint32_t intersect_sse(const LinearBVHNode& node) const {
+      uint32_t mask = 0;
+      for (int group = 0; group < K; group += 4) {
+        __m128 t0 = _mm_load_ps(t_min + group);
+        __m128 t1 = _mm_load_ps(t_max + group);
+
+        for (int axis = 0; axis < 3; axis++) {
+          const __m128 o = _mm_load_ps(origin[axis] + group);
+          const __m128 d = _mm_load_ps(inv_dir[axis] + group);
+          const __m128 t_a = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bounds_min[axis]), o), d);
+          const __m128 t_b = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bounds_max[axis]), o), d);
+
+          // max and min return their second operand when the first is NaN
+          t0 = _mm_max_ps(_mm_min_ps(t_a, t_b), t0);
+          t1 = _mm_min_ps(_mm_max_ps(t_a, t_b), t1);
+        }
+
+        const __m128 hit = _mm_cmple_ps(t0, _mm_mul_ps(t1, _mm_set1_ps(ROUNDING_SLACK)));
+        mask |= uint32_t(_mm_movemask_ps(hit)) << group;
+      }
+
+      return mask;
+    }
+#endif
+
+#if defined(__AVX__)
+    /*
+     * AVX version of intersect that tests eight rays per instruction.
+     */
+    uint32_t intersect_avx(const LinearBVHNode& node) const {
+      uint32_t mask = 0;
+      for (int group = 0; group < K; group += 8) {
+        __m256 t0 = _mm256_load_ps(t_min + group);
+        __m256 t1 = _mm256_load_ps(t_max + group);
+
+        for (int axis = 0; axis < 3; axis++) {
+          const __m256 o = _mm256_load_ps(origin[axis] + group);
+          const __m256 d = _mm256_load_ps(inv_dir[axis] + group);
+          const __m256 t_a = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.bounds_min[axis]), o), d);
+          const __m256 t_b = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.bounds_max[axis]), o), d);
+
+          // max and min return their second operand when the first is NaN
+          t0 = _mm256_max_ps(_mm256_min_ps(t_a, t_b), t0);
+          t1 = _mm256_min_ps(_mm256_max_ps(t_a, t_b), t1);
+        }
+
+        const __m256 hit = _mm256_cmp_ps(t0, _mm256_mul_ps(t1, _mm256_set1_ps(ROUNDING_SLACK)), _CMP_LE_OQ);
+        mask |= uint32_t(_mm256_movemask_ps(hit)) << group;
+      }
+
+      return mask;
+    }
+#endif
+};
+
+#endif //!RAY_PACKET_H_
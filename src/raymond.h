@@ -8,6 +8,8 @@
 #include <memory>
 #include <iomanip>
 
+#include "rng.h"
+
 // ==============================
 // Using statements
 // ==============================
@@ -34,24 +36,24 @@ inline double degrees_to_radians(double degrees) {
 }
 
 /*
- * Returns a random double between the range [0, 1).
+ * Returns a random double between the range [0, 1) drawn from the given generator.
  */
-inline double random_double() {
-  return std::rand() / (RAND_MAX + 1.0);
+inline double random_double(Rng& rng) {
+  return rng.next_double();
 }
 
 /*
- * Returns a random double between the range [min, max).
+ * Returns a random double between the range [min, max) drawn from the given generator.
  */
-inline double random_double(double min, double max) {
-  return min + (max - min) * random_double();
+inline double random_double(Rng& rng, double min, double max) {
+  return min + (max - min) * random_double(rng);
 }
 
 /*
- * Returns a random int between the range [min, max].
+ * Returns a random int between the range [min, max] drawn from the given generator.
  */
-inline int random_int(int min, int max) {
-  return int(random_double(min, max+1));
+inline int random_int(Rng& rng, int min, int max) {
+  return int(random_double(rng, min, max+1));
 }
 
 /*
@@ -0,0 +1,240 @@
+#ifndef RENDER_TELEMETRY_H_
+#define RENDER_TELEMETRY_H_
+
+#include <omp.h>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+#include <cstdint>
+
+#include "external/json.hpp"
+
+// ==============================
+// ThreadCounters class
+// ==============================
+
+/*
+ * Running totals of one render thread. Only the thread itself adds to them, the reporter reads
+ * them while the render runs. Every thread's counters fill their own cache line so that the
+ * threads do not slow each other down.
+ */
+class alignas(64) ThreadCounters {
+  public:
+    std::atomic<uint64_t> work = 0;              // units of work finished, pixels or pixel passes
+    std::atomic<uint64_t> rays = 0;              // rays traced
+    std::atomic<uint64_t> samples = 0;           // samples taken
+    std::atomic<uint64_t> busy_nanoseconds = 0;  // time spent rendering
+};
+
+// ==============================
+// RenderTotals class
+// ==============================
+
+/*
+ * Counters of every thread summed at one point in time.
+ */
+class RenderTotals {
+  public:
+    uint64_t work = 0;              // units of work finished
+    uint64_t rays = 0;              // rays traced
+    uint64_t samples = 0;           // samples taken
+    uint64_t busy_nanoseconds = 0;  // time spent rendering by all the threads
+};
+
+// ==============================
+// RenderTelemetry class
+// ==============================
+
+/*
+ * Progress and throughput of a render. The render threads add what they finish to their own
+ * counters, and a reporter thread sums them at a fixed interval and rewrites a status line with
+ * the percentage done, the rays and samples per second, the estimated time left and, when the
+ * threads record their busy time, how busy each thread was since the last report.
+ */
+class RenderTelemetry {
+  public:
+    /*
+     * Constructs the telemetry of a render of total_work units by up to thread_count threads.
+     */
+    RenderTelemetry(int thread_count, uint64_t total_work) :
+      total_work(std::max<uint64_t>(1, total_work)),
+      counters(std::make_unique<ThreadCounters[]>(thread_count)),
+      thread_count(thread_count) {
+      }
+
+    ~RenderTelemetry() {
+      stop();
+    }
+
+    /*
+     * Adds the work, rays and samples finished by the given thread, and the time it spent on them.
+     */
+    void record(int thread, uint64_t work, uint64_t rays, uint64_t samples, double busy_seconds = 0) {
+      ThreadCounters& c = counters[thread];
+      c.work.fetch_add(work, std::memory_order_relaxed);
+      c.rays.fetch_add(rays, std::memory_order_relaxed);
+      c.samples.fetch_add(samples, std::memory_order_relaxed);
+      c.busy_nanoseconds.fetch_add(uint64_t(busy_seconds * 1e9), std::memory_order_relaxed);
+    }
+
+    /*
+     * Starts the reporter thread, which writes the status line every interval_seconds.
+     */
+    void start(double interval_seconds = 0.5) {
+      start_time = omp_get_wtime();
+      last_time = start_time;
+      last_busy.assign(thread_count, 0);
+      stopping = false;
+
+      reporter = std::thread([this, interval_seconds] {
+        std::unique_lock<std::mutex> lock(mutex);
+        const auto interval = std::chrono::duration<double>(interval_seconds);
+        while (!wake.wait_for(lock, interval, [this] { return stopping; })) {
+          report();
+        }
+      });
+    }
+
+    /*
+     * Stops the reporter thread after writing the final status line, and fixes the render time.
+     */
+    void stop() {
+      if (!reporter.joinable()) {
+        return;
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+      }
+      wake.notify_one();
+      reporter.join();
+
+      elapsed_seconds = omp_get_wtime() - start_time;
+      report();
+      std::cerr << "\n";
+    }
+
+    /*
+     * Returns the counters summed over every thread.
+     */
+    RenderTotals total() const {
+      RenderTotals sum;
+      for (int t = 0; t < thread_count; t++) {
+        sum.work += counters[t].work.load(std::memory_order_relaxed);
+        sum.rays += counters[t].rays.load(std::memory_order_relaxed);
+        sum.samples += counters[t].samples.load(std::memory_order_relaxed);
+        sum.busy_nanoseconds += counters[t].busy_nanoseconds.load(std::memory_order_relaxed);
+      }
+      return sum;
+    }
+
+    /*
+     * Returns a summary of the finished render: its time, totals, throughput and the busy time of
+     * every thread.
+     */
+    nlohmann::json summary() const {
+      const RenderTotals sum = total();
+      const double seconds = std::max(elapsed_seconds, 1e-9);
+
+      nlohmann::json result;
+      result["seconds"] = elapsed_seconds;
+      result["rays"] = sum.rays;
+      result["samples"] = sum.samples;
+      result["rays_per_second"] = sum.rays / seconds;
+      result["samples_per_second"] = sum.samples / seconds;
+
+      result["threads"] = nlohmann::json::array();
+      for (int t = 0; t < thread_count; t++) {
+        const double busy = counters[t].busy_nanoseconds * 1e-9;
+        result["threads"].push_back({
+          {"rays", counters[t].rays.load()},
+          {"samples", counters[t].samples.load()},
+          {"busy_seconds", busy},
+          {"utilization", busy / seconds},
+        });
+      }
+
+      return result;
+    }
+
+  private:
+    uint64_t total_work;                          // units of work in the whole render
+    std::unique_ptr<ThreadCounters[]> counters;   // counters of every thread
+    int thread_count;                             // number of threads that may record work
+
+    std::thread reporter;                         // thread writing the status line
+    std::mutex mutex;                             // guards stopping
+    std::condition_variable wake;                 // wakes the reporter up early to stop it
+    bool stopping = false;                        // whether the reporter should stop
+
+    double start_time = 0;                        // time the render started
+    double elapsed_seconds = 0;                   // time the render took, once it has stopped
+    double last_time = 0;                         // time of the previous report
+    std::vector<uint64_t> last_busy;              // busy time of every thread at the previous report
+
+    /*
+     * Writes the status line.
+     */
+    void report() {
+      const double now = omp_get_wtime();
+      const double elapsed = std::max(now - start_time, 1e-9);
+      const RenderTotals sum = total();
+      const double fraction = std::min(1.0, double(sum.work) / total_work);
+
+      std::ostringstream line;
+      line << "\rProgress: " << int(100 * fraction) << "% | "
+        << format_rate(sum.rays / elapsed) << " rays/s | "
+        << format_rate(sum.samples / elapsed) << " samples/s | ETA ";
+
+      if (fraction >= 1) {
+        line << "0s";
+      }
+      else if (fraction > 0) {
+        line << int(elapsed * (1 - fraction) / fraction) << "s";
+      }
+      else {
+        line << "?";
+      }
+
+      // utilization of every thread since the previous report, if the threads record their busy time
+      if (sum.busy_nanoseconds > 0) {
+        const double interval = std::max(now - last_time, 1e-9);
+        line << " | threads";
+        for (int t = 0; t < thread_count; t++) {
+          const uint64_t busy = counters[t].busy_nanoseconds.load(std::memory_order_relaxed);
+          line << " " << std::min(100, int(100 * (busy - last_busy[t]) * 1e-9 / interval)) << "%";
+          last_busy[t] = busy;
+        }
+      }
+      last_time = now;
+
+      std::cerr << line.str() << "   " << std::flush;
+    }
+
+    /*
+     * Returns the given rate with a k, M or G suffix.
+     */
+    static std::string format_rate(double rate) {
+      const char* suffixes[] = {"", "k", "M", "G"};
+      int i = 0;
+      while (rate >= 1000 && i < 3) {
+        rate /= 1000;
+        i++;
+      }
+
+      std::ostringstream text;
+      text << std::fixed << std::setprecision(i > 0 ? 2 : 0) << rate << suffixes[i];
+      return text.str();
+    }
+};
+
+#endif //!RENDER_TELEMETRY_H_
@@ -0,0 +1,437 @@
+#ifndef RESTIR_H_
+#define RESTIR_H_
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <omp.h>
+
+#include "raymond.h"
+#include "vector3.h"
+#include "color.h"
+#include "ray.h"
+#include "interval.h"
+#include "entity.h"
+#include "material.h"
+#include "image_buffer.h"
+#include "light_sampler.h"
+#include "sampler.h"
+#include "render_telemetry.h"
+
+// ==============================
+// LightSample class
+// ==============================
+
+/*
+ * Point on a light chosen by a reservoir. It is stored as a point rather than a direction so that
+ * neighbouring pixels can reuse it from their own shading points.
+ */
+class LightSample {
+  public:
+    Point3 p;                       // point on the light
+    Vector3 normal;                 // normal of the light at p
+    Color emission;                 // light emitted from p
+    const Entity* light = nullptr;  // light that p lies on, null for an empty sample
+};
+
+// ==============================
+// Reservoir class
+// ==============================
+
+/*
+ * Weighted reservoir that keeps one light sample out of a stream of candidates, each kept with a
+ * probability proportional to its weight, and the statistics needed to weigh it.
+ */
+class Reservoir {
+  public:
+    LightSample sample;  // sample kept so far
+    double weight_sum;   // sum of the weights of every candidate seen
+    double count;        // number of candidates seen, M
+    double W;            // unbiased contribution weight of the kept sample
+
+    /*
+     * Constructs an empty reservoir.
+     */
+    Reservoir() :
+      weight_sum(0),
+      count(0),
+      W(0) {
+      }
+
+    /*
+     * Offers a candidate with the given weight, replacing the kept sample with probability
+     * weight / weight_sum. Returns true if the candidate was kept.
+     */
+    bool update(const LightSample& candidate, double weight, double candidates, Rng& rng) {
+      weight_sum += weight;
+      count += candidates;
+
+      if (weight > 0 && random_double(rng) * weight_sum < weight) {
+        sample = candidate;
+        return true;
+      }
+
+      return false;
+    }
+
+    /*
+     * Computes W once every candidate has been offered, given the target density of the kept
+     * sample at the shading point.
+     */
+    void finalize(double target) {
+      W = (target > 0 && count > 0) ? weight_sum / (count * target) : 0;
+    }
+};
+
+// ==============================
+// ReservoirBuffer class
+// ==============================
+
+/*
+ * One reservoir per pixel of an image, kept between the passes of a ReSTIRIntegrator.
+ */
+class ReservoirBuffer {
+  public:
+    /*
+     * Constructor for the reservoir buffer with the given width and height of the image
+     */
+    ReservoirBuffer(int width, int height) :
+      width(width),
+      height(height),
+      buffer(size_t(width) * height) {
+      }
+
+    /*
+     * Get reservoir reference to given row and column of the pixel in the buffer
+     */
+    Reservoir& get(int row, int col) {
+      return buffer[size_t(row) * width + col];
+    }
+
+    /*
+     * Get reservoir reference to the pixel at the given index in row major order
+     */
+    Reservoir& operator[](size_t index) {
+      return buffer[index];
+    }
+
+    /*
+     * Swaps the contents of two buffers of the same size.
+     */
+    void swap(ReservoirBuffer& other) {
+      buffer.swap(other.buffer);
+    }
+
+  private:
+    int width;                       // width of the image
+    int height;                      // height of the image
+    std::vector<Reservoir> buffer;   // reservoirs of the pixels
+};
+
+// ==============================
+// ShadingPoint class
+// ==============================
+
+/*
+ * First non-specular surface seen through a pixel in the current pass.
+ */
+class ShadingPoint {
+  public:
+    Ray r_in;           // ray that hit the surface
+    HitRecord rec;      // hit on the surface
+    Color throughput;   // attenuation of the specular bounces before the surface
+    double depth;       // distance from the camera to the first hit along the path
+    bool valid;         // false if the path escaped or ended before reaching such a surface
+};
+
+// ==============================
+// ReSTIRIntegrator class
+// ==============================
+
+/*
+ * Progressive direct lighting integrator for previews of scenes with many lights, based on
+ * reservoir spatiotemporal importance resampling (ReSTIR). Every pass traces one camera ray per
+ * pixel, follows it through specular bounces to the first rough surface and
+ *   - streams candidates picked by the light sampler through a per pixel reservoir, keeping one
+ *     with a probability proportional to its unshadowed contribution
+ *   - merges it with the reservoir the pixel ended the previous pass with (temporal reuse), when
+ *     history is above 0
+ *   - merges it with the reservoirs of a few random nearby pixels (spatial reuse)
+ *   - shades the pixel with the light sample that was kept, traced with one shadow ray.
+ * Reservoirs are only merged between surfaces with similar normals and depths. Only light that
+ * arrives straight from the lights is gathered, bounced light and light from the background are
+ * left out, and reuse trades a little bias for a much cleaner image at a few samples per pixel.
+ * Temporal reuse is off by default: with a still camera it makes the passes that are averaged
+ * into the image correlated, which converges slower than independent passes.
+ */
+class ReSTIRIntegrator {
+  public:
+    static const int SPATIAL_RADIUS = 16;  // largest distance in pixels to a reused neighbour
+
+    int image_width;         // width of the image in pixels
+    int image_height;        // height of the image in pixels
+    int passes;              // number of progressive passes, one camera ray per pixel each
+    int max_depth;           // maximum number of specular bounces before the shaded surface
+    Color background;        // color of rays that escape the scene
+    uint64_t seed;           // seed of the per pixel random number generators
+    SamplerType sampler_type = SamplerType::Independent;  // how the camera rays and light candidates are placed
+    int candidates = 4;      // lights streamed through each reservoir per pass
+    int neighbors = 5;       // nearby reservoirs merged into each pixel per pass
+    int history = 0;         // passes worth of candidates carried over from the previous pass, 0 disables it
+    const LightSampler* lights = nullptr;  // lights to sample, null to only show emission
+    RenderTelemetry* telemetry = nullptr;  // progress of the render, null to not report it
+
+    /*
+     * Renders the world into the given image buffer. camera_ray(col, row, sampler) must return a
+     * sampled camera ray through the given pixel. Returns the number of rays traced.
+     */
+    template <typename CameraRay>
+    uint64_t render(const Entity& world, ImageBuffer& image_buffer, CameraRay camera_ray) {
+      const size_t count = size_t(image_width) * image_height;
+      ReservoirBuffer previous(image_width, image_height);
+      ReservoirBuffer current(image_width, image_height);
+      ReservoirBuffer reused(image_width, image_height);
+      std::vector<ShadingPoint> points(count);
+      std::vector<ShadingPoint> previous_points(count);
+      std::vector<Color> pixel_colors(count, Color(0, 0, 0));
+      std::vector<Sampler> samplers(count);
+
+      for (size_t i = 0; i < count; i++) {
+        samplers[i] = Sampler(sampler_type, seed, passes, i);
+      }
+
+      uint64_t segments = 0;
+
+      for (int pass = 0; pass < passes; pass++) {
+        const uint64_t pass_start = segments;
+
+        // initial candidates and temporal reuse
+        #pragma omp parallel for schedule(dynamic, 1) reduction(+:segments)
+        for (int row = 0; row < image_height; row++) {
+          for (int col = 0; col < image_width; col++) {
+            const size_t i = size_t(row) * image_width + col;
+            // the reservoirs resample with the plain generator, only the rays follow the sampler
+            Sampler& sampler = samplers[i];
+            Rng& rng = sampler.rng;
+            ShadingPoint& point = points[i];
+
+            sampler.start_sample(pass);
+            pixel_colors[i] += trace_camera_path(world, camera_ray(col, row, sampler), point, sampler, segments);
+
+            Reservoir& reservoir = current[i];
+            reservoir = Reservoir();
+            if (!point.valid || !lights) {
+              continue;
+            }
+
+            reservoir = sample_candidates(point, sampler);
+
+            if (history > 0 && pass > 0 && similar(point, previous_points[i])) {
+              Reservoir history_reservoir = previous[i];
+              history_reservoir.count = std::min(history_reservoir.count, double(history) * candidates);
+              Reservoir merged;
+              merge(merged, reservoir, point, rng);
+              merge(merged, history_reservoir, point, rng);
+              merged.finalize(target(point, merged.sample));
+              reservoir = merged;
+            }
+          }
+        }
+
+        // spatial reuse and shading
+        #pragma omp parallel for schedule(dynamic, 1) reduction(+:segments)
+        for (int row = 0; row < image_height; row++) {
+          for (int col = 0; col < image_width; col++) {
+            const size_t i = size_t(row) * image_width + col;
+            Rng& rng = samplers[i].rng;
+            const ShadingPoint& point = points[i];
+
+            Reservoir& reservoir = reused[i];
+            reservoir = current[i];
+            if (!point.valid || !lights) {
+              continue;
+            }
+
+            Reservoir merged;
+            merge(merged, current[i], point, rng);
+            for (int k = 0; k < neighbors; k++) {
+              const int neighbor_row = std::clamp(row + random_int(rng, -SPATIAL_RADIUS, SPATIAL_RADIUS), 0, image_height - 1);
+              const int neighbor_col = std::clamp(col + random_int(rng, -SPATIAL_RADIUS, SPATIAL_RADIUS), 0, image_width - 1);
+              const size_t j = size_t(neighbor_row) * image_width + neighbor_col;
+              if (j != i && similar(point, points[j])) {
+                merge(merged, current[j], point, rng);
+              }
+            }
+            merged.finalize(target(point, merged.sample));
+            reservoir = merged;
+
+            if (reservoir.sample.light && reservoir.W > 0) {
+              segments++;
+              if (visible(world, point, reservoir.sample)) {
+                pixel_colors[i] += point.throughput * contribution(point, reservoir.sample) * reservoir.W;
+              }
+            }
+          }
+        }
+
+        previous.swap(reused);
+        previous_points.swap(points);
+
+        if (telemetry) {
+          telemetry->record(0, count, segments - pass_start, count);
+        }
+      }
+
+      const double scale = 1.0 / passes;
+      for (size_t i = 0; i < count; i++) {
+        image_buffer.get(i / image_width, i % image_width) = pixel_colors[i] * scale;
+      }
+
+      return segments;
+    }
+
+  private:
+    /*
+     * Follows the camera ray through specular bounces to the first surface that light can be
+     * sampled at and stores it in point. Returns the emission and background seen on the way.
+     */
+    Color trace_camera_path(const Entity& world, Ray r, ShadingPoint& point, Sampler& sampler, uint64_t& segments) const {
+      Color radiance(0, 0, 0);
+      point.throughput = Color(1, 1, 1);
+      point.valid = false;
+
+      for (int depth = 1; depth <= max_depth; depth++) {
+        segments++;
+
+        HitRecord rec;
+        if (!world.hit(r, Interval(0.001, infinity), rec)) {
+          radiance += point.throughput * background;
+          break;
+        }
+
+        if (depth == 1) {
+          point.depth = rec.t * r.direction().length();
+        }
+        radiance += point.throughput * rec.mat->emitted(rec.u, rec.v, rec.p);
+
+        if (!rec.mat->is_specular()) {
+          point.r_in = r;
+          point.rec = rec;
+          point.valid = true;
+          break;
+        }
+
+        ScatterRecord srec;
+        if (!rec.mat->sample(r, rec, srec, sampler)) {
+          break;
+        }
+        point.throughput = point.throughput * srec.attenuation;
+        r = srec.scattered;
+      }
+
+      return radiance;
+    }
+
+    /*
+     * Streams the candidate lights of one pass through a new reservoir for the given point.
+     * Each candidate is weighed by its target density over the density of picking it.
+     */
+    Reservoir sample_candidates(const ShadingPoint& point, Sampler& sampler) const {
+      Reservoir reservoir;
+      const HitRecord& rec = point.rec;
+
+      for (int c = 0; c < candidates; c++) {
+        double pick_pmf = 0;
+        const Entity* light = lights->sample(rec.p, rec.normal, random_double(sampler), pick_pmf);
+        if (!light) {
+          reservoir.count++;
+          continue;
+        }
+
+        const Vector3 direction = light->random(rec.p, sampler);
+        HitRecord light_rec;
+        if (!light->hit(Ray(rec.p, direction, point.r_in.time()), Interval(0.001, infinity), light_rec)) {
+          reservoir.count++;
+          continue;
+        }
+
+        LightSample candidate;
+        candidate.p = light_rec.p;
+        candidate.normal = light_rec.normal;
+        candidate.emission = light_rec.mat->emitted(light_rec.u, light_rec.v, light_rec.p);
+        candidate.light = light;
+
+        // densities are converted from solid angle to area on the light so that neighbours can share samples
+        const double area_pdf = pick_pmf * light->pdf_value(rec.p, direction) * geometry(rec.p, candidate);
+        const double weight = area_pdf > 0 ? target(point, candidate) / area_pdf : 0;
+        reservoir.update(candidate, weight, 1, sampler.rng);
+      }
+
+      reservoir.finalize(target(point, reservoir.sample));
+      return reservoir;
+    }
+
+    /*
+     * Offers the sample of other, which stands for other.count candidates, to the reservoir of
+     * the given point, weighted by its target density at that point.
+     */
+    void merge(Reservoir& reservoir, const Reservoir& other, const ShadingPoint& point, Rng& rng) const {
+      const double weight = other.sample.light ? target(point, other.sample) * other.W * other.count : 0;
+      reservoir.update(other.sample, weight, other.count, rng);
+    }
+
+    /*
+     * Returns the light that the sample sends to the shading point, ignoring occlusion, per unit
+     * of area on the light.
+     */
+    Color contribution(const ShadingPoint& point, const LightSample& sample) const {
+      if (!sample.light) {
+        return Color(0, 0, 0);
+      }
+
+      const Vector3 direction = sample.p - point.rec.p;
+      return point.rec.mat->eval(point.r_in, point.rec, direction) * sample.emission
+        * geometry(point.rec.p, sample);
+    }
+
+    /*
+     * Target density that reservoirs resample towards, the brightness of the contribution.
+     */
+    double target(const ShadingPoint& point, const LightSample& sample) const {
+      return luminance(contribution(point, sample));
+    }
+
+    /*
+     * Returns the change of variables from solid angle at p to area on the light at the sample.
+     */
+    static double geometry(const Point3& p, const LightSample& sample) {
+      const Vector3 to_light = sample.p - p;
+      const double distance_squared = to_light.length_squared();
+      if (distance_squared <= 0) {
+        return 0;
+      }
+
+      return std::fabs(dot(sample.normal, to_light)) / (distance_squared * std::sqrt(distance_squared));
+    }
+
+    /*
+     * Returns true if nothing lies between the shading point and the light sample.
+     */
+    static bool visible(const Entity& world, const ShadingPoint& point, const LightSample& sample) {
+      HitRecord rec;
+      return !world.hit(Ray(point.rec.p, sample.p - point.rec.p, point.r_in.time()), Interval(0.001, 0.999), rec);
+    }
+
+    /*
+     * Returns true if reservoirs can be shared between the given shading points, whose surfaces
+     * must face the same way at about the same distance from the camera.
+     */
+    static bool similar(const ShadingPoint& a, const ShadingPoint& b) {
+      return a.valid && b.valid
+        && dot(a.rec.normal, b.rec.normal) > 0.9
+        && std::fabs(a.depth - b.depth) < 0.1 * a.depth;
+    }
+};
+
+#endif //!RESTIR_H_
@@ -0,0 +1,71 @@
+#ifndef RNG_H_
+#define RNG_H_
+
+#include <cstdint>
+
+// ==============================
+// Rng class
+// PCG32 random number generator
+// ==============================
+
+class Rng {
+  public:
+    /*
+     * Constructs the generator with seed 0 on stream 0.
+     */
+    Rng() :
+      Rng(0, 0) {
+      }
+
+    /*
+     * Constructs the generator with the given seed on the given stream.
+     * Two generators with the same seed and stream always produce the same sequence, so seeding
+     * one generator per pixel makes the output independent of which thread renders the pixel.
+     */
+    Rng(uint64_t seed, uint64_t stream) {
+      // hash the seed and stream so neighbouring streams do not start out correlated
+      state = 0;
+      inc = (mix(stream) << 1u) | 1u;
+      next_uint();
+      state += mix(seed ^ mix(stream + 0x9e3779b97f4a7c15ull));
+      next_uint();
+    }
+
+    /*
+     * Returns the next uniformly distributed 32 bit unsigned integer.
+     */
+    uint32_t next_uint() {
+      uint64_t old_state = state;
+      state = old_state * 6364136223846793005ull + inc;
+
+      uint32_t xorshifted = uint32_t(((old_state >> 18u) ^ old_state) >> 27u);
+      uint32_t rot = uint32_t(old_state >> 59u);
+
+      return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+    }
+
+    /*
+     * Returns the next uniformly distributed double in the range [0, 1).
+     */
+    double next_double() {
+      return next_uint() * 0x1p-32;
+    }
+
+    /*
+     * SplitMix64 finalizer used to scramble seeds and stream indices.
+     */
+    static uint64_t mix(uint64_t x) {
+      x ^= x >> 30;
+      x *= 0xbf58476d1ce4e5b9ull;
+      x ^= x >> 27;
+      x *= 0x94d049bb133111ebull;
+      x ^= x >> 31;
+      return x;
+    }
+
+  private:
+    uint64_t state;  // current state of the generator
+    uint64_t inc;    // odd increment that selects the stream
+};
+
+#endif //!RNG_H_
@@ -0,0 +1,282 @@
+#ifndef SAMPLER_H_
+#define SAMPLER_H_
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <array>
+
+#include "raymond.h"
+#include "rng.h"
+#include "vector3.h"
+
+// ==============================
+// SamplerType enum
+// ==============================
+
+/*
+ * Strategy used to place the samples of a pixel.
+ */
+enum class SamplerType {
+  Independent,  // every sample value is drawn on its own from the pixel's generator
+  Stratified,   // the samples of a pixel are jittered in a grid of strata in every dimension
+  Sobol,        // the samples of a pixel follow the Owen scrambled Sobol sequence
+};
+
+// ==============================
+// Low discrepancy helper functions
+// ==============================
+
+/*
+ * Returns the bits of x in reverse order.
+ */
+inline uint32_t reverse_bits(uint32_t x) {
+  x = (x << 16) | (x >> 16);
+  x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+  x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+  x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+  x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+  return x;
+}
+
+/*
+ * Returns x after a random nested uniform scramble chosen by seed: every bit is flipped or not
+ * depending on the bits above it, which Owen scrambles a number in [0, 1) given as 32 bits of
+ * fixed point (Burley, Practical Hash-based Owen Scrambling).
+ */
+inline uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) {
+  x = reverse_bits(x);
+
+  // Laine-Karras permutation, every bit only depends on the bits below it
+  x += seed;
+  x ^= x * 0x6c50b47cu;
+  x ^= x * 0xb82f1e52u;
+  x ^= x * 0xc7afe638u;
+  x ^= x * 0x8d22f6e6u;
+
+  return reverse_bits(x);
+}
+
+/*
+ * Returns the second dimension of the point of the Sobol sequence with the given index as 32 bits
+ * of fixed point. The first dimension is the van der Corput sequence, reverse_bits(index).
+ */
+inline uint32_t sobol_second_dimension(uint32_t index) {
+  // the direction numbers of the dimension, whose primitive polynomial is x + 1, combined for
+  // every value of each byte of the index
+  static const std::array<uint32_t, 4 * 256> table = [] {
+    std::array<uint32_t, 4 * 256> table{};
+    uint32_t directions[32];
+    directions[0] = 1u << 31;
+    for (int bit = 1; bit < 32; bit++) {
+      directions[bit] = directions[bit - 1] ^ (directions[bit - 1] >> 1);
+    }
+
+    for (int byte = 0; byte < 4; byte++) {
+      for (uint32_t value = 0; value < 256; value++) {
+        for (int bit = 0; bit < 8; bit++) {
+          if (value & (1u << bit)) {
+            table[byte * 256 + value] ^= directions[byte * 8 + bit];
+          }
+        }
+      }
+    }
+    return table;
+  }();
+
+  return table[index & 0xff] ^ table[256 + ((index >> 8) & 0xff)]
+    ^ table[512 + ((index >> 16) & 0xff)] ^ table[768 + (index >> 24)];
+}
+
+/*
+ * Returns the element at index i of a random permutation of [0, l) chosen by p, without storing
+ * the permutation (Kensler, Correlated Multi-Jittered Sampling).
+ */
+inline uint32_t permutation_element(uint32_t i, uint32_t l, uint32_t p) {
+  uint32_t w = l - 1;
+  w |= w >> 1;
+  w |= w >> 2;
+  w |= w >> 4;
+  w |= w >> 8;
+  w |= w >> 16;
+
+  do {
+    i ^= p;
+    i *= 0xe170893d;
+    i ^= p >> 16;
+    i ^= (i & w) >> 4;
+    i ^= p >> 8;
+    i *= 0x0929eb3f;
+    i ^= p >> 23;
+    i ^= (i & w) >> 1;
+    i *= 1 | p >> 27;
+    i *= 0x6935fa69;
+    i ^= (i & w) >> 11;
+    i *= 0x74dcb303;
+    i ^= (i & w) >> 2;
+    i *= 0x9e501cc3;
+    i ^= (i & w) >> 2;
+    i *= 0xc860a3df;
+    i &= w;
+    i ^= i >> 5;
+  } while (i >= l);
+
+  return (i + p) % l;
+}
+
+// ==============================
+// Sampler class
+// ==============================
+
+/*
+ * Source of the random numbers of the samples of one pixel. Every sample starts at dimension 0
+ * and every value it draws uses the next dimension, so the n-th value of each sample of a pixel,
+ * for example the pixel jitter or the direction of the first bounce, comes from the same
+ * dimension. The stratified and Sobol samplers spread the values of each dimension evenly over
+ * the samples of the pixel, and decorrelate the dimensions from each other and the pixels from
+ * their neighbours with a hash of the pixel and the dimension.
+ * The independent sampler draws every value from the pixel's generator in order, like a plain Rng.
+ */
+class Sampler {
+  public:
+    SamplerType type = SamplerType::Independent;  // strategy used to place the samples
+    Rng rng;                // generator of the pixel, also used for jitter and for non sample choices
+    int samples_per_pixel;  // number of samples the pixel will take, the strata of stratified samples
+    int sample_index;       // index of the current sample of the pixel
+    uint32_t dimension;     // dimension of the next value of the current sample
+
+    /*
+     * Constructs an independent sampler with seed 0 for pixel 0.
+     */
+    Sampler() :
+      Sampler(SamplerType::Independent, 0, 1, 0) {
+      }
+
+    /*
+     * Constructs the sampler of the given pixel index for an image rendered with the given seed and
+     * number of samples per pixel. The sampler starts at sample 0.
+     */
+    Sampler(SamplerType type, uint64_t seed, int samples_per_pixel, uint64_t pixel) :
+      type(type),
+      rng(seed, pixel),
+      samples_per_pixel(std::max(1, samples_per_pixel)),
+      sample_index(0),
+      dimension(0),
+      pixel_hash(Rng::mix(seed ^ Rng::mix(pixel + 0x9e3779b97f4a7c15ull))) {
+      }
+
+    /*
+     * Starts the sample of the pixel with the given index from dimension 0.
+     */
+    void start_sample(int index) {
+      sample_index = index;
+      dimension = 0;
+    }
+
+    /*
+     * Returns the value of the next dimension of the current sample in [0, 1).
+     */
+    double get_1d() {
+      const uint32_t hash = dimension_hash();
+
+      if (type == SamplerType::Stratified && sample_index < samples_per_pixel) {
+        const uint32_t stratum = permutation_element(sample_index, samples_per_pixel, hash);
+        return std::min((stratum + rng.next_double()) / samples_per_pixel, ONE_MINUS_EPSILON);
+      }
+
+      if (type == SamplerType::Sobol) {
+        const uint32_t index = nested_uniform_scramble(sample_index, hash);
+        return nested_uniform_scramble(reverse_bits(index), hash ^ 0x5bd1e995u) * 0x1p-32;
+      }
+
+      return rng.next_double();
+    }
+
+    /*
+     * Returns the values of the next two dimensions of the current sample in [0, 1) as the x and y
+     * components of a vector.
+     */
+    Vector3 get_2d() {
+      const uint32_t hash = dimension_hash();
+
+      if (type == SamplerType::Stratified && sample_index < samples_per_pixel) {
+        // jitter within the cells of a square grid with at least one cell per sample
+        const int n = int(std::ceil(std::sqrt(double(samples_per_pixel))));
+        const uint32_t cell = permutation_element(sample_index, n * n, hash);
+        const double x = (cell % n + rng.next_double()) / n;
+        const double y = (cell / n + rng.next_double()) / n;
+        return Vector3(std::min(x, ONE_MINUS_EPSILON), std::min(y, ONE_MINUS_EPSILON), 0);
+      }
+
+      if (type == SamplerType::Sobol) {
+        const uint32_t index = nested_uniform_scramble(sample_index, hash);
+        return Vector3(nested_uniform_scramble(reverse_bits(index), hash ^ 0x5bd1e995u) * 0x1p-32,
+            nested_uniform_scramble(sobol_second_dimension(index), hash ^ 0x68e31da4u) * 0x1p-32, 0);
+      }
+
+      const double x = rng.next_double();
+      return Vector3(x, rng.next_double(), 0);
+    }
+
+  private:
+    static constexpr double ONE_MINUS_EPSILON = 0x1.fffffffffffffp-1;  // largest double below 1
+
+    uint64_t pixel_hash;  // hash of the seed and the pixel
+
+    /*
+     * Returns a hash of the pixel and the current dimension, and moves on to the next dimension.
+     */
+    uint32_t dimension_hash() {
+      return uint32_t(Rng::mix(pixel_hash + dimension++));
+    }
+};
+
+// ==============================
+// Sample functions
+// ==============================
+
+/*
+ * Returns the next sample value of the given sampler in [0, 1).
+ */
+inline double random_double(Sampler& sampler) {
+  return sampler.get_1d();
+}
+
+/*
+ * Returns a unit vector with a random direction, mapped from two sample dimensions.
+ */
+inline Vector3 random_unit_vector(Sampler& sampler) {
+  const Vector3 u = sampler.get_2d();
+  const double z = 1 - 2 * u.x();
+  const double r = std::sqrt(std::fmax(0.0, 1 - z * z));
+  const double phi = 2 * pi * u.y();
+
+  return Vector3(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+/*
+ * Returns a random point inside the unit disk, mapped from two sample dimensions by the
+ * concentric mapping of Shirley and Chiu, which keeps neighbouring samples close together.
+ */
+inline Vector3 random_in_unit_disk(Sampler& sampler) {
+  const Vector3 u = sampler.get_2d();
+  const double a = 2 * u.x() - 1;
+  const double b = 2 * u.y() - 1;
+  if (a == 0 && b == 0) {
+    return Vector3(0, 0, 0);
+  }
+
+  double r, theta;
+  if (std::fabs(a) > std::fabs(b)) {
+    r = a;
+    theta = (pi / 4) * (b / a);
+  }
+  else {
+    r = b;
+    theta = (pi / 2) - (pi / 4) * (a / b);
+  }
+
+  return Vector3(r * std::cos(theta), r * std::sin(theta), 0);
+}
+
+#endif //!SAMPLER_H_
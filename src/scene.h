@@ -4,6 +4,8 @@
 #include <string>
 #include <unordered_map>
 #include <iostream>
+#include <memory>
+#include <vector>
 
 #include "raymond.h"
 #include "parser.h"
@@ -14,11 +16,16 @@
 #include "material.h"
 #include "sphere.h"
 #include "quad.h"
-#include "bvh.h"
+#include "box.h"
+#include "triangle_mesh.h"
+#include "instance.h"
+#include "linear_bvh.h"
+#include "light_sampler.h"
+#include "light_bvh.h"
+#include "scene_cache.h"
 
 using TextureMap = std::unordered_map<std::string, shared_ptr<Texture>>;
 using MaterialMap = std::unordered_map<std::string, shared_ptr<Material>>;
-using EntityMap = std::unordered_map<std::string, shared_ptr<Entity>>;
 
 // ==============================
 // Scene class
@@ -27,34 +34,96 @@ using EntityMap = std::unordered_map<std::string, shared_ptr<Entity>>;
 class Scene {
   public:
     /*
-     * Construct the scene object with the path to the scene file
+     * Construct the scene object with the path to the scene file, or to a scene cache compiled from
+     * one. A cache that is out of date with its scene file is ignored and the scene file is parsed.
      */
     Scene(const std::string& scene_file_path) :
-      parser(scene_file_path) {
+      parser(open_parser(scene_file_path, cache)) {
 
-        parser.parse_camera(camera);
+        parser.parse_scene(camera, bvh_options, texture_map, material_map, world, lights);
         std::clog << "[INFO]: Parsed camera settings\n";
-
-        parser.parse_textures(texture_map);
         std::clog << "[INFO]: Parsed " << texture_map.size() << " textures\n";
-
-        parser.parse_materials(material_map, texture_map);
         std::clog << "[INFO]: Parsed " << material_map.size() << " materials\n";
+        std::clog << "[INFO]: Parsed " << world.list.size() << " entities ("
+          << lights.list.size() << " lights)\n";
+    }
 
-        parser.parse_entities(entity_map, material_map);
-        std::clog << "[INFO]: Parsed " << entity_map.size() << " entities\n";
+    /*
+     * Build the BVH over the entities and the light sampler of the scene, unless already built
+     */
+    void build() {
+      if (light_sampler) {
+        return;
+      }
 
-        for (const auto& [_, value] : entity_map) {
-          world.add(value);
+      if (cache && cache->world_node_count() > 0) {
+        // entities in the leaf order of the cached BVH, which is traced from the mapped nodes
+        const uint32_t* order = cache->get_world_order();
+        std::vector<shared_ptr<Entity>> leaf_entities(world.list.size());
+        for (size_t i = 0; i < world.list.size(); i++) {
+          leaf_entities[i] = world.list[order[i]];
         }
+        world_bvh = make_shared<LinearBVH>(leaf_entities, cache->get_world_nodes(), cache->world_node_count(),
+            bvh_options, cache);
+      }
+      else {
+        world_bvh = make_shared<LinearBVH>(world, bvh_options);
+      }
+      log_bvh_stats(world_bvh->stats());
+
+      entities = world;
+      world = EntityList(world_bvh);
+
+      if (camera.light_sampler == LightSamplerType::BVH) {
+        light_sampler = std::make_unique<LightBVH>(lights.list);
+      }
+      else {
+        light_sampler = std::make_unique<UniformLightSampler>(lights.list);
+      }
+    }
+
+    /*
+     * Build the scene and write it to a scene cache at the given path, which can then be rendered
+     * in place of the scene file until the scene file or its assets change
+     */
+    void compile(const std::string& cache_path) {
+      if (cache) {
+        throw std::runtime_error("Compiled scenes can not be compiled again, compile " + parser.get_path() + " instead");
+      }
+
+      build();
+
+      SceneCacheWriter writer(cache_path);
+      writer.set_source(parser.get_path(), parser.get_assets());
+      writer.add_records(parser.get_records());
+
+      // leaves of the world BVH as indices into the entity records
+      std::unordered_map<const Entity*, uint32_t> index_of;
+      for (size_t i = 0; i < entities.list.size(); i++) {
+        index_of[entities.list[i].get()] = uint32_t(i);
+      }
+      std::vector<uint32_t> order;
+      for (const shared_ptr<Entity>& entity : world_bvh->leaf_entities()) {
+        order.push_back(index_of[entity.get()]);
+      }
+      writer.set_world(order, world_bvh->binary_tree());
+
+      writer.finish();
     }
 
     /*
      * Render the scene to an output image file
      */
     void render(const std::string& output_file_path) {
-      world = EntityList(make_shared<BVH_Node>(world));
-      camera.render(world, output_file_path);
+      build();
+      camera.render(world, output_file_path, light_sampler.get());
+    }
+
+    /*
+     * Return the light sampler of the scene, null until the scene is built
+     */
+    const LightSampler* get_light_sampler() const {
+      return light_sampler.get();
     }
 
     /*
@@ -64,13 +133,47 @@ class Scene {
       return world;
     }
 
+    /*
+     * Return the camera of the scene
+     */
+    Camera& get_camera() {
+      return camera;
+    }
+
   private:
+    shared_ptr<SceneCache> cache;  // compiled scene the scene was loaded from, null if none
     Parser parser;               // parser to parse the scene json file
     Camera camera;               // scene's camera
+    BVHBuildOptions bvh_options; // settings for building the scene's BVH
     EntityList world;            // scene's world
+    EntityList lights;           // scene's emissive entities
     TextureMap texture_map;      // scene's textures
     MaterialMap material_map;    // scene's materials
-    EntityMap entity_map;        // scene's entities
+    EntityList entities;         // scene's entities in the order of their records, set by build()
+    std::unique_ptr<LightSampler> light_sampler;  // picks the lights sampled at diffuse bounces, built by build()
+    shared_ptr<LinearBVH> world_bvh;      // BVH over the entities, built by build()
+
+    /*
+     * Open the parser of the given file. Scene caches that are current are parsed from the cache,
+     * which is stored in cache, and ones that are out of date from their scene file.
+     */
+    static Parser open_parser(const std::string& file_path, shared_ptr<SceneCache>& cache) {
+      cache = SceneCache::open(file_path);
+      if (!cache) {
+        return Parser(file_path);
+      }
+
+      if (cache->is_current()) {
+        std::clog << "[INFO]: Loading compiled scene " << file_path << "\n";
+        return Parser(cache);
+      }
+
+      std::clog << "[INFO]: " << file_path << " is out of date with " << cache->get_source_path()
+        << ", parsing the scene file instead\n";
+      const std::string source_path = cache->get_source_path();
+      cache.reset();
+      return Parser(source_path);
+    }
 };
 
 #endif //!SCENE_H_
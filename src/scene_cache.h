@@ -0,0 +1,838 @@
+#ifndef SCENE_CACHE_H_
+#define SCENE_CACHE_H_
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
+
+#include "raymond.h"
+#include "entity.h"
+#include "texture.h"
+#include "mesh.h"
+#include "triangle_mesh.h"
+#include "bvh_builder.h"
+#include "linear_bvh.h"
+
+// ==============================
+// Scene cache layout
+// ==============================
+
+static const char SCENE_CACHE_MAGIC[8] = "RAYMOND";  // first bytes of every scene cache
+static const uint32_t SCENE_CACHE_VERSION = 3;         // bumped whenever the layout below changes
+static const uint64_t SCENE_CACHE_ALIGNMENT = 64;      // every section starts at a multiple of this
+static const uint32_t CACHE_NONE = UINT32_MAX;         // index of a record that is absent
+
+/*
+ * Offset and size in bytes of a section of the cache.
+ */
+class CachedSection {
+  public:
+    uint64_t offset = 0;  // start of the section from the start of the file, 0 if absent
+    uint64_t size = 0;    // bytes in the section
+};
+
+/*
+ * First bytes of a scene cache. Tables are arrays of the records below, strings are raw bytes.
+ */
+class SceneCacheHeader {
+  public:
+    char magic[8] = {};              // SCENE_CACHE_MAGIC
+    uint32_t version = 0;            // SCENE_CACHE_VERSION
+    uint32_t node_size = 0;          // size of a LinearBVHNode, which is stored as is
+    uint64_t content_hash = 0;       // hash of the source scene and its assets when compiled
+    CachedSection source_path;       // path of the source scene file
+    CachedSection settings;          // json of the camera and bvh sections of the source scene file
+    CachedSection assets;            // table of CachedSection, paths of the meshes and images used
+    CachedSection stamps;            // table of CachedFileStamp, of the source scene file then of every asset
+    CachedSection textures;          // table of CachedTextureRecord
+    CachedSection images;            // table of CachedImageRecord
+    CachedSection materials;         // table of CachedMaterialRecord
+    CachedSection meshes;            // table of CachedMeshRecord
+    CachedSection prototypes;        // table of CachedPrototypeRecord
+    CachedSection prototype_members; // table of CachedEntityRecord, the members of every prototype in turn
+    CachedSection world_entities;    // table of CachedEntityRecord, the entities of the world in order
+    CachedSection world_nodes;       // LinearBVHNode array of the BVH over the world
+    CachedSection world_order;       // uint32_t per leaf entity, its index in world_entities
+};
+
+/*
+ * Types of the texture, material and entity records.
+ */
+enum class CachedTextureType : uint32_t { SolidColor, Image, Noise, Checker };
+enum class CachedMaterialType : uint32_t { Lambertian, Metal, Dielectric, DiffuseLight };
+enum class CachedEntityType : uint32_t { Sphere, Quad, Box, TriangleMesh, Instance };
+
+/*
+ * Record of one texture. Checker textures refer to textures stored before them.
+ */
+class CachedTextureRecord {
+  public:
+    CachedSection key;                                       // name of the texture
+    CachedTextureType type = CachedTextureType::SolidColor;  // kind of texture
+    uint32_t image = CACHE_NONE;                             // record of the pixels of an image texture
+    uint32_t even = CACHE_NONE;                              // even texture of a checker texture
+    uint32_t odd = CACHE_NONE;                               // odd texture of a checker texture
+    double albedo[3] = {};                                   // color of a solid color texture
+    double scale = 0;                                        // scale of a noise or checker texture
+};
+
+/*
+ * Record of one material.
+ */
+class CachedMaterialRecord {
+  public:
+    CachedSection key;                                         // name of the material
+    CachedMaterialType type = CachedMaterialType::Lambertian;  // kind of material
+    uint32_t texture = CACHE_NONE;  // texture of a Lambertian or DiffuseLight, CACHE_NONE to use color
+    double color[3] = {};           // albedo, or emitted color of a DiffuseLight
+    double value = 0;               // fuzz of a Metal, refractive index of a Dielectric
+};
+
+/*
+ * Record of one entity, holding the values its scene file gives it:
+ * Sphere: center, radius. Quad: center, horizontal, vertical. Box: center, dimensions, rotations.
+ * Instance: center, rotations, scale. A TriangleMesh is placed in its mesh record already.
+ */
+class CachedEntityRecord {
+  public:
+    CachedEntityType type = CachedEntityType::Sphere;  // kind of entity
+    uint32_t material = CACHE_NONE;  // material of the entity, unused for instances
+    uint32_t index = CACHE_NONE;     // mesh record of a TriangleMesh, prototype record of an Instance
+    uint32_t pad = 0;                // padding to a multiple of 8 bytes
+    double values[9] = {};           // values of the entity, as listed above
+};
+
+/*
+ * Record of one prototype, a range of prototype_members.
+ */
+class CachedPrototypeRecord {
+  public:
+    uint64_t first = 0;  // first member of the prototype
+    uint64_t count = 0;  // number of members
+};
+
+/*
+ * Record of the mesh of one TriangleMesh entity. Entities sharing a mesh share its sections.
+ */
+class CachedMeshRecord {
+  public:
+    uint64_t vertex_count = 0;                     // number of vertices
+    uint64_t triangle_count = 0;                   // number of triangles
+    uint64_t node_count = 0;                       // number of BVH nodes
+    double area = 0;                               // surface area of the mesh
+    CachedSection px, py, pz, nx, ny, nz, tu, tv;  // double per vertex, normals and uvs may be absent
+    CachedSection indices;                         // uint32_t three per triangle
+    CachedSection triangles;                       // uint32_t per triangle, in leaf order
+    CachedSection area_cdf;                        // double per triangle
+    CachedSection nodes;                           // LinearBVHNode array
+};
+
+/*
+ * Record of the decoded pixels of one ImageTexture.
+ */
+class CachedImageRecord {
+  public:
+    uint64_t width = 0;     // width of the image in pixels
+    uint64_t height = 0;    // height of the image in pixels
+    CachedSection pixels;   // 3 bytes per pixel, row by row
+};
+
+/*
+ * Size and modification time of a file when the cache was written. While they are unchanged the
+ * file is taken to be unchanged without hashing it.
+ */
+class CachedFileStamp {
+  public:
+    uint64_t size = 0;   // size of the file in bytes
+    int64_t mtime = 0;   // modification time of the file in nanoseconds since the epoch
+};
+
+/*
+ * Pixels of a cached image.
+ */
+class CachedImage {
+  public:
+    const unsigned char* pixels = nullptr;  // 3 bytes per pixel, row by row
+    int width = 0;                          // width in pixels
+    int height = 0;                         // height in pixels
+};
+
+// ==============================
+// SceneRecords class
+// ==============================
+
+/*
+ * Flat description of a parsed scene in the form a scene cache stores it. Entities refer to their
+ * material, mesh or prototype, and materials and textures to their textures, by index. The keys
+ * of the records are filled in when they are written.
+ */
+class SceneRecords {
+  public:
+    std::string settings;                                // json of the camera and bvh sections
+    std::vector<std::string> texture_keys;               // name of every texture record
+    std::vector<CachedTextureRecord> textures;           // textures in the order they were created
+    std::vector<shared_ptr<const ImageTexture>> images;  // texture of every image record
+    std::vector<std::string> material_keys;              // name of every material record
+    std::vector<CachedMaterialRecord> materials;         // materials
+    std::vector<shared_ptr<const TriangleMesh>> meshes;  // entity of every mesh record
+    std::vector<CachedPrototypeRecord> prototypes;       // prototypes
+    std::vector<CachedEntityRecord> prototype_members;   // members of every prototype in turn
+    std::vector<CachedEntityRecord> entities;            // entities of the world in order
+};
+
+// ==============================
+// Content hash functions
+// ==============================
+
+/*
+ * Adds the given bytes to a 64 bit FNV-1a style hash, taking them 8 at a time and the bytes left
+ * over one at a time.
+ */
+inline uint64_t hash_bytes(uint64_t hash, const void* data, size_t size) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+    uint64_t word;
+    std::memcpy(&word, bytes + i, sizeof(word));
+    hash = (hash ^ word) * 0x100000001b3ull;
+  }
+  for (; i < size; i++) {
+    hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+/*
+ * Adds the path and the contents of the given file to the hash.
+ * Returns false if the file can not be read.
+ */
+inline bool hash_file(uint64_t& hash, const std::string& file_path) {
+  std::ifstream input(file_path, std::ios::binary);
+  if (!input.good()) {
+    return false;
+  }
+
+  hash = hash_bytes(hash, file_path.data(), file_path.size());
+  std::vector<char> buffer(1 << 20);
+  while (input.read(buffer.data(), buffer.size()) || input.gcount() > 0) {
+    hash = hash_bytes(hash, buffer.data(), size_t(input.gcount()));
+  }
+  return true;
+}
+
+/*
+ * Returns the hash of the given scene file and of the assets it uses, or 0 if any of them can not
+ * be read.
+ */
+inline uint64_t scene_content_hash(const std::string& source_path, const std::vector<std::string>& assets) {
+  uint64_t hash = 0xcbf29ce484222325ull;
+  if (!hash_file(hash, source_path)) {
+    return 0;
+  }
+  for (const std::string& asset : assets) {
+    if (!hash_file(hash, asset)) {
+      return 0;
+    }
+  }
+  return hash;
+}
+
+/*
+ * Returns the stamps of the given scene file and of the assets it uses, or none if any of them can
+ * not be found.
+ */
+inline std::vector<CachedFileStamp> scene_file_stamps(const std::string& source_path, const std::vector<std::string>& assets) {
+  std::vector<CachedFileStamp> stamps;
+  for (size_t i = 0; i <= assets.size(); i++) {
+    struct stat info;
+    if (stat((i == 0 ? source_path : assets[i - 1]).c_str(), &info) != 0) {
+      return {};
+    }
+
+    CachedFileStamp stamp;
+    stamp.size = uint64_t(info.st_size);
+    stamp.mtime = int64_t(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+    stamps.push_back(stamp);
+  }
+  return stamps;
+}
+
+// ==============================
+// MappedFile class
+// ==============================
+
+/*
+ * Read only memory mapping of a whole file.
+ */
+class MappedFile {
+  public:
+    /*
+     * Maps the given file. Throws if it can not be opened or mapped.
+     */
+    MappedFile(const std::string& file_path) {
+      const int fd = open(file_path.c_str(), O_RDONLY);
+      if (fd < 0) {
+        throw std::runtime_error(file_path + ": File not found");
+      }
+
+      struct stat info;
+      if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        throw std::runtime_error(file_path + ": Could not read the file");
+      }
+
+      size = size_t(info.st_size);
+      void* address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      close(fd);
+      if (address == MAP_FAILED) {
+        throw std::runtime_error(file_path + ": Could not map the file");
+      }
+      data = static_cast<const unsigned char*>(address);
+    }
+
+    ~MappedFile() {
+      munmap(const_cast<unsigned char*>(data), size);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const unsigned char* data = nullptr;  // first byte of the mapping
+    size_t size = 0;                      // bytes mapped
+};
+
+
+// ==============================
+// SceneCacheWriter class
+// ==============================
+
+/*
+ * Writes a scene cache: the hash of a scene file and its assets, the records of its textures,
+ * materials, prototypes and entities, the buffers and BVHs of its meshes, the pixels of its images
+ * and the BVH over its entities. The parts are added one by one and the header is written by
+ * finish().
+ */
+class SceneCacheWriter {
+  public:
+    /*
+     * Starts writing the cache at the given path. Throws if the file can not be created.
+     */
+    SceneCacheWriter(const std::string& cache_path) :
+      cache_path(cache_path),
+      output(cache_path, std::ios::binary | std::ios::trunc) {
+        if (!output.good()) {
+          throw std::runtime_error(cache_path + ": Could not create the file");
+        }
+
+        std::memcpy(header.magic, SCENE_CACHE_MAGIC, sizeof(header.magic));
+        header.version = SCENE_CACHE_VERSION;
+        header.node_size = sizeof(LinearBVHNode);
+        append(&header, sizeof(header));
+      }
+
+    /*
+     * Adds the path of the scene file and of the assets it uses, and hashes them. Throws if any
+     * can not be read.
+     */
+    void set_source(const std::string& source_path, const std::vector<std::string>& assets) {
+      header.content_hash = scene_content_hash(source_path, assets);
+      if (header.content_hash == 0) {
+        throw std::runtime_error(source_path + ": Could not read the scene or one of its assets");
+      }
+
+      header.source_path = append(source_path.data(), source_path.size());
+      const std::vector<CachedFileStamp> stamps = scene_file_stamps(source_path, assets);
+      header.stamps = append(stamps.data(), stamps.size() * sizeof(CachedFileStamp));
+
+      std::vector<CachedSection> paths;
+      for (const std::string& asset : assets) {
+        paths.push_back(append(asset.data(), asset.size()));
+      }
+      header.assets = append(paths.data(), paths.size() * sizeof(CachedSection));
+    }
+
+    /*
+     * Adds the settings and the records of the given scene, with the pixels of its images and the
+     * buffers of its meshes. Meshes sharing buffers are written once.
+     */
+    void add_records(const SceneRecords& records) {
+      header.settings = append(records.settings.data(), records.settings.size());
+
+      std::vector<CachedTextureRecord> textures = records.textures;
+      for (size_t i = 0; i < textures.size(); i++) {
+        textures[i].key = append(records.texture_keys[i].data(), records.texture_keys[i].size());
+      }
+      header.textures = append(textures.data(), textures.size() * sizeof(CachedTextureRecord));
+
+      std::vector<CachedImageRecord> images;
+      for (const shared_ptr<const ImageTexture>& texture : records.images) {
+        const Image& image = texture->get_image();
+        CachedImageRecord record;
+        record.width = image.width();
+        record.height = image.height();
+        record.pixels = append(image.data(), record.width * record.height * 3);
+        images.push_back(record);
+      }
+      header.images = append(images.data(), images.size() * sizeof(CachedImageRecord));
+
+      std::vector<CachedMaterialRecord> materials = records.materials;
+      for (size_t i = 0; i < materials.size(); i++) {
+        materials[i].key = append(records.material_keys[i].data(), records.material_keys[i].size());
+      }
+      header.materials = append(materials.data(), materials.size() * sizeof(CachedMaterialRecord));
+
+      std::vector<CachedMeshRecord> meshes;
+      for (const shared_ptr<const TriangleMesh>& mesh : records.meshes) {
+        meshes.push_back(add_mesh(*mesh));
+      }
+      header.meshes = append(meshes.data(), meshes.size() * sizeof(CachedMeshRecord));
+
+      header.prototypes = append(records.prototypes.data(), records.prototypes.size() * sizeof(CachedPrototypeRecord));
+      header.prototype_members = append(records.prototype_members.data(),
+          records.prototype_members.size() * sizeof(CachedEntityRecord));
+      header.world_entities = append(records.entities.data(), records.entities.size() * sizeof(CachedEntityRecord));
+
+      std::clog << "[INFO]: Cached " << textures.size() << " textures, " << materials.size() << " materials, "
+        << records.prototypes.size() << " prototypes and " << records.entities.size() << " entities\n";
+    }
+
+    /*
+     * Adds the BVH built over the entities of the world, whose leaves hold the entities at the
+     * given indices of the world entity records.
+     */
+    void set_world(const std::vector<uint32_t>& order, const LinearBVHTree& tree) {
+      header.world_order = append(order.data(), order.size() * sizeof(uint32_t));
+      header.world_nodes = append(tree.node_data(), tree.size() * sizeof(LinearBVHNode));
+    }
+
+    /*
+     * Writes the header. Throws if the file could not be written.
+     */
+    void finish() {
+      const uint64_t total = uint64_t(output.tellp());
+      output.seekp(0);
+      output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+      output.close();
+      if (!output.good()) {
+        throw std::runtime_error(cache_path + ": Could not write the file");
+      }
+
+      std::clog << "[INFO]: Wrote " << cache_path << " (" << total / (1024.0 * 1024.0) << " MiB, "
+        << written_meshes.size() << " meshes)\n";
+    }
+
+  private:
+    std::string cache_path;                               // path of the cache
+    std::ofstream output;                                 // cache being written
+    SceneCacheHeader header;                              // header, written last
+    std::unordered_map<const double*, CachedMeshRecord> written_meshes;  // record of the buffers already added
+
+    /*
+     * Writes the buffers and BVH of the given TriangleMesh entity, unless they were written for
+     * another entity, and returns their record.
+     */
+    CachedMeshRecord add_mesh(const TriangleMesh& entity) {
+      const TriangleMeshData& data = entity.get_data();
+
+      auto it = written_meshes.find(data.mesh.px);
+      if (it != written_meshes.end()) {
+        return it->second;
+      }
+
+      const MeshView& mesh = data.mesh;
+      const size_t vertex_bytes = mesh.vertex_count * sizeof(double);
+      CachedMeshRecord record;
+      record.vertex_count = mesh.vertex_count;
+      record.triangle_count = mesh.triangle_count;
+      record.node_count = data.node_count;
+      record.area = data.area;
+      record.px = append(mesh.px, vertex_bytes);
+      record.py = append(mesh.py, vertex_bytes);
+      record.pz = append(mesh.pz, vertex_bytes);
+      if (mesh.has_normals()) {
+        record.nx = append(mesh.nx, vertex_bytes);
+        record.ny = append(mesh.ny, vertex_bytes);
+        record.nz = append(mesh.nz, vertex_bytes);
+      }
+      if (mesh.has_uvs()) {
+        record.tu = append(mesh.tu, vertex_bytes);
+        record.tv = append(mesh.tv, vertex_bytes);
+      }
+      record.indices = append(mesh.indices, 3 * mesh.triangle_count * sizeof(uint32_t));
+      record.triangles = append(data.triangles, mesh.triangle_count * sizeof(uint32_t));
+      record.area_cdf = append(data.area_cdf, mesh.triangle_count * sizeof(double));
+      record.nodes = append(data.nodes, data.node_count * sizeof(LinearBVHNode));
+      written_meshes[data.mesh.px] = record;
+      return record;
+    }
+
+    /*
+     * Writes the given bytes at the next aligned offset and returns where they are.
+     */
+    CachedSection append(const void* data, size_t size) {
+      uint64_t offset = uint64_t(output.tellp());
+      const uint64_t padding = (SCENE_CACHE_ALIGNMENT - offset % SCENE_CACHE_ALIGNMENT) % SCENE_CACHE_ALIGNMENT;
+      static const char zeros[SCENE_CACHE_ALIGNMENT] = {};
+      output.write(zeros, padding);
+      offset += padding;
+
+      output.write(static_cast<const char*>(data), size);
+
+      CachedSection section;
+      section.offset = offset;
+      section.size = size;
+      return section;
+    }
+};
+
+// ==============================
+// SceneCache class
+// ==============================
+
+/*
+ * Scene cache mapped into memory. The scene is created straight from its flat records, its meshes
+ * and images are used from the mapped pages, so they are neither parsed, decoded nor copied, and
+ * neither its BVH nor the ones of its meshes are rebuilt. Analytic entities, materials and
+ * textures are still created as one object per record.
+ * The cache is current only while the hash of its scene file and assets still matches, which is
+ * only computed again when their size or modification time changed.
+ */
+class SceneCache {
+  public:
+    /*
+     * Returns the cache in the given file, or null if the file is not a scene cache.
+     * Throws if the file is a scene cache that is damaged or of another version.
+     */
+    static shared_ptr<SceneCache> open(const std::string& file_path) {
+      std::ifstream input(file_path, std::ios::binary);
+      char magic[sizeof(SCENE_CACHE_MAGIC)] = {};
+      if (!input.read(magic, sizeof(magic)) || std::memcmp(magic, SCENE_CACHE_MAGIC, sizeof(magic)) != 0) {
+        return nullptr;
+      }
+
+      return make_shared<SceneCache>(file_path);
+    }
+
+    /*
+     * Maps the scene cache in the given file. Throws if it is damaged or of another version.
+     * Every index into the mapped buffers and between the records is checked once here, so that a
+     * damaged cache is reported rather than followed out of bounds.
+     */
+    SceneCache(const std::string& file_path) :
+      cache_path(file_path),
+      file(file_path) {
+        if (file.size < sizeof(SceneCacheHeader)) {
+          throw std::runtime_error(cache_path + ": Scene cache is truncated");
+        }
+        std::memcpy(&header, file.data, sizeof(header));
+        if (header.version != SCENE_CACHE_VERSION || header.node_size != sizeof(LinearBVHNode)) {
+          throw std::runtime_error(cache_path + ": Scene cache was written by another version, compile it again");
+        }
+
+        source_path = string_at(header.source_path);
+        for (const CachedSection& asset : table<CachedSection>(header.assets)) {
+          assets.push_back(string_at(asset));
+        }
+
+        for (const CachedImageRecord& record : table<CachedImageRecord>(header.images)) {
+          check(record.width <= INT_MAX && record.height <= INT_MAX);
+          CachedImage image;
+          image.width = int(record.width);
+          image.height = int(record.height);
+          image.pixels = array<unsigned char>(record.pixels, record.width * record.height * 3);
+          images.push_back(image);
+        }
+
+        textures = table<CachedTextureRecord>(header.textures);
+        for (size_t i = 0; i < textures.size(); i++) {
+          const CachedTextureRecord& record = textures[i];
+          string_at(record.key);
+          check(record.type <= CachedTextureType::Checker);
+          check(record.type != CachedTextureType::Image || record.image < images.size());
+          check(record.type != CachedTextureType::Checker || (record.even < i && record.odd < i));
+        }
+
+        materials = table<CachedMaterialRecord>(header.materials);
+        for (const CachedMaterialRecord& record : materials) {
+          string_at(record.key);
+          check(record.type <= CachedMaterialType::DiffuseLight);
+          check(record.texture == CACHE_NONE || record.texture < textures.size());
+        }
+
+        for (const CachedMeshRecord& record : table<CachedMeshRecord>(header.meshes)) {
+          meshes.push_back(map_mesh(record));
+        }
+
+        prototypes = table<CachedPrototypeRecord>(header.prototypes);
+        const size_t member_count = header.prototype_members.size / sizeof(CachedEntityRecord);
+        prototype_members = array<CachedEntityRecord>(header.prototype_members, member_count);
+        for (const CachedPrototypeRecord& record : prototypes) {
+          check(record.count > 0 && record.first <= member_count && record.count <= member_count - record.first);
+        }
+        for (size_t i = 0; i < member_count; i++) {
+          check(prototype_members[i].type != CachedEntityType::Instance);
+          check_entity(prototype_members[i]);
+        }
+
+        entity_count = header.world_entities.size / sizeof(CachedEntityRecord);
+        world_entities = array<CachedEntityRecord>(header.world_entities, entity_count);
+        for (size_t i = 0; i < entity_count; i++) {
+          check_entity(world_entities[i]);
+        }
+
+        // the world BVH refers to the entities by their index in world_entities
+        world_order = array<uint32_t>(header.world_order, entity_count);
+        for (size_t i = 0; i < entity_count; i++) {
+          check(world_order[i] < entity_count);
+        }
+        node_count = header.world_nodes.size / sizeof(LinearBVHNode);
+        world_nodes = array<LinearBVHNode>(header.world_nodes, node_count);
+        check(LinearBVHTree::is_valid(world_nodes, node_count, entity_count));
+
+        // the files are only hashed when their size or modification time changed
+        const std::vector<CachedFileStamp> stamps = table<CachedFileStamp>(header.stamps);
+        const std::vector<CachedFileStamp> file_stamps = scene_file_stamps(source_path, assets);
+        const bool stamps_match = !stamps.empty() && stamps.size() == file_stamps.size()
+          && std::equal(stamps.begin(), stamps.end(), file_stamps.begin(), [](const CachedFileStamp& a, const CachedFileStamp& b) {
+            return a.size == b.size && a.mtime == b.mtime;
+          });
+        current = stamps_match || scene_content_hash(source_path, assets) == header.content_hash;
+      }
+
+    /*
+     * Returns true if the scene file and assets are unchanged since the cache was written.
+     */
+    bool is_current() const {
+      return current;
+    }
+
+    /*
+     * Returns the path of the scene file the cache was compiled from.
+     */
+    const std::string& get_source_path() const {
+      return source_path;
+    }
+
+    /*
+     * Returns the paths of the meshes and images the scene uses.
+     */
+    const std::vector<std::string>& get_assets() const {
+      return assets;
+    }
+
+    /*
+     * Returns the json of the camera and bvh sections of the scene file.
+     */
+    std::string get_settings() const {
+      return string_at(header.settings);
+    }
+
+    /*
+     * Returns the name stored in the given section of a record.
+     */
+    std::string get_key(const CachedSection& key) const {
+      return string_at(key);
+    }
+
+    /*
+     * Returns the texture records, in the order they are created.
+     */
+    const std::vector<CachedTextureRecord>& get_textures() const {
+      return textures;
+    }
+
+    /*
+     * Returns the pixels of the image with the given record index.
+     */
+    const CachedImage& get_image(uint32_t index) const {
+      return images[index];
+    }
+
+    /*
+     * Returns the material records.
+     */
+    const std::vector<CachedMaterialRecord>& get_materials() const {
+      return materials;
+    }
+
+    /*
+     * Returns the buffers and BVH of the mesh with the given record index.
+     */
+    const TriangleMeshData& get_mesh(uint32_t index) const {
+      return meshes[index];
+    }
+
+    /*
+     * Returns the prototype records.
+     */
+    const std::vector<CachedPrototypeRecord>& get_prototypes() const {
+      return prototypes;
+    }
+
+    /*
+     * Returns the records of the members of the prototypes.
+     */
+    const CachedEntityRecord* get_prototype_members() const {
+      return prototype_members;
+    }
+
+    /*
+     * Returns the records of the entities of the world, in the order the world BVH refers to them.
+     */
+    const CachedEntityRecord* get_world_entities() const {
+      return world_entities;
+    }
+
+    /*
+     * Returns the number of entities of the world.
+     */
+    size_t world_entity_count() const {
+      return entity_count;
+    }
+
+    /*
+     * Returns for every leaf entity of the world BVH its index in get_world_entities().
+     */
+    const uint32_t* get_world_order() const {
+      return world_order;
+    }
+
+    /*
+     * Returns the nodes of the world BVH.
+     */
+    const LinearBVHNode* get_world_nodes() const {
+      return world_nodes;
+    }
+
+    /*
+     * Returns the number of nodes of the world BVH.
+     */
+    size_t world_node_count() const {
+      return node_count;
+    }
+
+  private:
+    std::string cache_path;                               // path of the cache
+    MappedFile file;                                      // mapping of the cache
+    SceneCacheHeader header;                              // copy of the header
+    std::string source_path;                              // path of the source scene
+    std::vector<std::string> assets;                      // paths of the assets of the scene
+    std::vector<CachedImage> images;                      // images by record
+    std::vector<CachedTextureRecord> textures;            // texture records
+    std::vector<CachedMaterialRecord> materials;          // material records
+    std::vector<TriangleMeshData> meshes;                 // meshes by record
+    std::vector<CachedPrototypeRecord> prototypes;        // prototype records
+    const CachedEntityRecord* prototype_members = nullptr;  // member records of the prototypes, mapped
+    const CachedEntityRecord* world_entities = nullptr;   // entity records of the world, mapped
+    size_t entity_count = 0;                              // number of entities of the world
+    const uint32_t* world_order = nullptr;                // entity of every leaf of the world BVH, mapped
+    const LinearBVHNode* world_nodes = nullptr;           // nodes of the world BVH, mapped
+    size_t node_count = 0;                                // number of nodes of the world BVH
+    bool current = false;                                 // whether the hash still matches
+
+    /*
+     * Returns the buffers and BVH of the given mesh record.
+     */
+    TriangleMeshData map_mesh(const CachedMeshRecord& record) const {
+      TriangleMeshData data;
+      data.mesh.vertex_count = record.vertex_count;
+      data.mesh.triangle_count = record.triangle_count;
+      data.mesh.px = array<double>(record.px, record.vertex_count);
+      data.mesh.py = array<double>(record.py, record.vertex_count);
+      data.mesh.pz = array<double>(record.pz, record.vertex_count);
+      if (record.nx.offset) {
+        data.mesh.nx = array<double>(record.nx, record.vertex_count);
+        data.mesh.ny = array<double>(record.ny, record.vertex_count);
+        data.mesh.nz = array<double>(record.nz, record.vertex_count);
+      }
+      if (record.tu.offset) {
+        data.mesh.tu = array<double>(record.tu, record.vertex_count);
+        data.mesh.tv = array<double>(record.tv, record.vertex_count);
+      }
+      data.mesh.indices = array<uint32_t>(record.indices, 3 * record.triangle_count);
+      data.nodes = array<LinearBVHNode>(record.nodes, record.node_count);
+      data.node_count = record.node_count;
+      data.triangles = array<uint32_t>(record.triangles, record.triangle_count);
+      data.area_cdf = array<double>(record.area_cdf, record.triangle_count);
+      data.area = record.area;
+
+      // every index the traversal and the triangle tests follow stays inside the buffers
+      check(record.triangle_count <= UINT32_MAX);
+      for (uint64_t i = 0; i < 3 * record.triangle_count; i++) {
+        check(data.mesh.indices[i] < record.vertex_count);
+      }
+      for (uint64_t i = 0; i < record.triangle_count; i++) {
+        check(data.triangles[i] < record.triangle_count);
+      }
+      check(LinearBVHTree::is_valid(data.nodes, data.node_count, record.triangle_count));
+
+      return data;
+    }
+
+    /*
+     * Throws if the given entity record refers to a record that is not in the cache.
+     */
+    void check_entity(const CachedEntityRecord& record) const {
+      check(record.type <= CachedEntityType::Instance);
+      if (record.type == CachedEntityType::Instance) {
+        check(record.index < prototypes.size());
+        return;
+      }
+
+      check(record.material < materials.size());
+      check(record.type != CachedEntityType::TriangleMesh || record.index < meshes.size());
+    }
+
+    /*
+     * Throws if the given condition on the contents of the cache does not hold.
+     */
+    void check(bool condition) const {
+      if (!condition) {
+        throw std::runtime_error(cache_path + ": Scene cache is damaged");
+      }
+    }
+
+    /*
+     * Returns the given section as an array of count values of type T.
+     * Throws if the section is smaller than that or lies outside the file.
+     */
+    template <typename T>
+    const T* array(const CachedSection& section, uint64_t count) const {
+      if (count > file.size / sizeof(T) || section.size < count * sizeof(T) || section.offset > file.size
+          || section.size > file.size - section.offset || section.offset % alignof(T) != 0) {
+        throw std::runtime_error(cache_path + ": Scene cache is damaged");
+      }
+      return reinterpret_cast<const T*>(file.data + section.offset);
+    }
+
+    /*
+     * Returns the given section as a table of records of type T.
+     */
+    template <typename T>
+    std::vector<T> table(const CachedSection& section) const {
+      const size_t count = section.size / sizeof(T);
+      const T* records = array<T>(section, count);
+      return std::vector<T>(records, records + count);
+    }
+
+    /*
+     * Returns the given section as a string.
+     */
+    std::string string_at(const CachedSection& section) const {
+      return std::string(array<char>(section, section.size), section.size);
+    }
+};
+
+#endif //!SCENE_CACHE_H_
@@ -9,6 +9,9 @@
 #include "ray.h"
 #include "interval.h"
 #include "entity.h"
+#include "material.h"
+#include "color.h"
+#include "trace_stats.h"
 
 // ==============================
 // Sphere class
@@ -49,6 +52,7 @@ class Sphere : public Entity {
      * Returns true if the ray hits, else returns false.
      */
     bool hit(const Ray&r, Interval ray_t, HitRecord& rec) const override {
+      RAYMOND_STAT(sphere_tests++);
       Point3 current_center = center.at(r.time());
 
       const Vector3& d = r.direction();
@@ -82,10 +86,73 @@ class Sphere : public Entity {
       rec.set_face_normal(r, outward_normal);
       get_sphere_uv(outward_normal, rec.u, rec.v, rotation);
       rec.mat = mat;
+      rec.entity = this;
 
       return true;
     }
 
+    /*
+     * Returns the density of sampling the given direction from the cone of directions that the
+     * sphere covers as seen from the given origin. Moving spheres are sampled at their starting
+     * position. From inside the sphere every direction is equally likely.
+     */
+    double pdf_value(const Point3& origin, const Vector3& direction) const override {
+      HitRecord rec;
+      if (!hit(Ray(origin, direction), Interval(0.001, infinity), rec)) {
+        return 0;
+      }
+
+      double distance_squared = (center.at(0) - origin).length_squared();
+      if (distance_squared <= radius * radius) {
+        return 1 / (4 * pi);
+      }
+
+      double cos_theta_max = std::sqrt(1 - radius * radius / distance_squared);
+      double solid_angle = 2 * pi * (1 - cos_theta_max);
+
+      return 1 / solid_angle;
+    }
+
+    /*
+     * Returns a random direction from the given origin inside the cone of directions that the
+     * sphere covers.
+     */
+    Vector3 random(const Point3& origin, Sampler& sampler) const override {
+      Vector3 direction = center.at(0) - origin;
+      double distance_squared = direction.length_squared();
+      if (distance_squared <= radius * radius) {
+        return random_unit_vector(sampler);
+      }
+
+      // uniform direction inside the cone around the z axis
+      const Vector3 u_sample = sampler.get_2d();
+      double r1 = u_sample.x();
+      double r2 = u_sample.y();
+      double cos_theta_max = std::sqrt(1 - radius * radius / distance_squared);
+      double z = 1 + r2 * (cos_theta_max - 1);
+      double phi = 2 * pi * r1;
+      double sin_theta = std::sqrt(1 - z * z);
+      Vector3 local(std::cos(phi) * sin_theta, std::sin(phi) * sin_theta, z);
+
+      // rotate the cone onto the direction towards the sphere
+      Vector3 w = unit_vector(direction);
+      Vector3 a = (std::fabs(w.x()) > 0.9) ? Vector3(0, 1, 0) : Vector3(1, 0, 0);
+      Vector3 v = unit_vector(cross(w, a));
+      Vector3 u = cross(w, v);
+
+      return local.x() * u + local.y() * v + local.z() * w;
+    }
+
+    /*
+     * Bounds of the light of the sphere, whose normals point everywhere. Textured emission is
+     * estimated by its value at the center of the texture.
+     */
+    LightBounds light_bounds() const override {
+      const Color emission = mat->emitted(0.5, 0.5, center.at(0));
+      const double power = pi * 4 * pi * radius * radius * luminance(emission);
+      return LightBounds(bound_box, power, DirectionCone::entire_sphere(), 0, false);
+    }
+
     /*
      * Maps a given 3d point in space to a 2d surface and stores the coordinates in u and v.
      */
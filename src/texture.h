@@ -113,6 +113,21 @@ class ImageTexture : public Texture {
       image(filepath) {
       }
 
+    /*
+     * Constructs the image texture over width x height pixels of 3 bytes each that are owned
+     * elsewhere and must outlive the texture
+     */
+    ImageTexture(const unsigned char* data, int width, int height) :
+      image(data, width, height) {
+      }
+
+    /*
+     * Returns the image of the texture
+     */
+    const Image& get_image() const {
+      return image;
+    }
+
     /*
      * Maps the 3d entity to a 2d surface and returns the color on the image for a given 3d point
      */
@@ -146,9 +161,10 @@ class ImageTexture : public Texture {
 class NoiseTexture : public Texture {
   public:
     /*
-     * Constructs the image texture with the given scale of the noise
+     * Constructs the image texture with the given scale of the noise, drawn from the given stream
      */
-    NoiseTexture(double scale) :
+    NoiseTexture(double scale, uint64_t stream = 0) :
+      noise(stream),
       scale(scale) {
     }
 
@@ -0,0 +1,198 @@
+#ifndef TILE_SCHEDULER_H_
+#define TILE_SCHEDULER_H_
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <algorithm>
+
+// ==============================
+// Tile class
+// ==============================
+
+/*
+ * Rectangle of pixels [first_row, last_row) x [first_col, last_col) rendered as one task.
+ */
+class Tile {
+  public:
+    int first_row;  // first row of the tile
+    int last_row;   // row after the last row of the tile
+    int first_col;  // first column of the tile
+    int last_col;   // column after the last column of the tile
+
+    /*
+     * Returns the number of pixels in the tile.
+     */
+    int pixel_count() const {
+      return (last_row - first_row) * (last_col - first_col);
+    }
+};
+
+// ==============================
+// ThreadTileStats class
+// ==============================
+
+/*
+ * Work done by one render thread.
+ */
+class ThreadTileStats {
+  public:
+    int tiles = 0;             // tiles rendered by the thread
+    int stolen = 0;            // tiles the thread took from the queue of another thread
+    double busy_seconds = 0;   // time spent rendering tiles
+    double idle_seconds = 0;   // time between the start and the end of the render spent waiting
+};
+
+// ==============================
+// TileScheduler class
+// ==============================
+
+/*
+ * Splits an image into square tiles and hands them out to the render threads.
+ * The tiles are ordered along a Hilbert curve, so that consecutive tiles touch and share the
+ * parts of the scene they see, and every thread gets its own queue with a contiguous stretch of
+ * the curve. A thread takes tiles from the front of its queue, and once it runs dry steals from
+ * the back of the fullest queue, where the tiles are furthest from what its owner is working on.
+ */
+class TileScheduler {
+  public:
+    std::vector<ThreadTileStats> stats;  // work done by every thread
+
+    /*
+     * Constructs the scheduler of an image of the given size, split into tiles of tile_size
+     * pixels on each side, for the given number of threads.
+     */
+    TileScheduler(int image_width, int image_height, int tile_size, int thread_count) :
+      stats(thread_count),
+      queues(thread_count) {
+        const std::vector<Tile> tiles = hilbert_tiles(image_width, image_height, tile_size);
+        tile_count = tiles.size();
+
+        for (int t = 0; t < thread_count; t++) {
+          queues[t] = std::make_unique<TileQueue>();
+          const size_t begin = tiles.size() * t / thread_count;
+          const size_t end = tiles.size() * (t + 1) / thread_count;
+          queues[t]->tiles.assign(tiles.begin() + begin, tiles.begin() + end);
+        }
+      }
+
+    /*
+     * Stores the next tile for the given thread in tile. Returns false once every tile is taken.
+     */
+    bool next(int thread, Tile& tile) {
+      TileQueue& own = *queues[thread];
+      {
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tiles.empty()) {
+          tile = own.tiles.front();
+          own.tiles.pop_front();
+          return true;
+        }
+      }
+
+      // steal from the queue with the most tiles left, retrying if it is emptied in the meantime
+      while (true) {
+        int victim = -1;
+        size_t most = 0;
+        for (size_t t = 0; t < queues.size(); t++) {
+          std::lock_guard<std::mutex> lock(queues[t]->mutex);
+          if (queues[t]->tiles.size() > most) {
+            most = queues[t]->tiles.size();
+            victim = t;
+          }
+        }
+
+        if (victim < 0) {
+          return false;
+        }
+
+        std::lock_guard<std::mutex> lock(queues[victim]->mutex);
+        if (!queues[victim]->tiles.empty()) {
+          tile = queues[victim]->tiles.back();
+          queues[victim]->tiles.pop_back();
+          stats[thread].stolen++;
+          return true;
+        }
+      }
+    }
+
+    /*
+     * Returns the number of tiles of the image.
+     */
+    int size() const {
+      return tile_count;
+    }
+
+  private:
+    /*
+     * Tiles waiting for one thread, guarded by its mutex.
+     */
+    struct TileQueue {
+      std::mutex mutex;
+      std::deque<Tile> tiles;
+    };
+
+    std::vector<std::unique_ptr<TileQueue>> queues;  // queue of every thread
+    int tile_count = 0;                              // number of tiles of the image
+
+    /*
+     * Returns the tiles of the image in the order of a Hilbert curve over the grid of tiles.
+     */
+    static std::vector<Tile> hilbert_tiles(int image_width, int image_height, int tile_size) {
+      const int columns = (image_width + tile_size - 1) / tile_size;
+      const int rows = (image_height + tile_size - 1) / tile_size;
+
+      // the curve covers a square grid with a power of two side, tiles outside the image are skipped
+      int side = 1;
+      while (side < std::max(columns, rows)) {
+        side *= 2;
+      }
+
+      std::vector<Tile> tiles;
+      for (long d = 0; d < long(side) * side; d++) {
+        int x, y;
+        hilbert_point(side, d, x, y);
+        if (x >= columns || y >= rows) {
+          continue;
+        }
+
+        Tile tile;
+        tile.first_row = y * tile_size;
+        tile.last_row = std::min(tile.first_row + tile_size, image_height);
+        tile.first_col = x * tile_size;
+        tile.last_col = std::min(tile.first_col + tile_size, image_width);
+        tiles.push_back(tile);
+      }
+
+      return tiles;
+    }
+
+    /*
+     * Stores in x and y the cell at distance d along the Hilbert curve over a grid of side by
+     * side cells, where side is a power of two.
+     */
+    static void hilbert_point(int side, long d, int& x, int& y) {
+      x = 0;
+      y = 0;
+      for (int s = 1; s < side; s *= 2) {
+        const int rx = 1 & (d / 2);
+        const int ry = 1 & (d ^ rx);
+
+        // rotate the quadrant so that the curves of the sub squares join up
+        if (ry == 0) {
+          if (rx == 1) {
+            x = s - 1 - x;
+            y = s - 1 - y;
+          }
+          std::swap(x, y);
+        }
+
+        x += s * rx;
+        y += s * ry;
+        d /= 4;
+      }
+    }
+};
+
+#endif //!TILE_SCHEDULER_H_
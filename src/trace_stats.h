@@ -0,0 +1,135 @@
+#ifndef TRACE_STATS_H_
+#define TRACE_STATS_H_
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+
+// counters of the work done while tracing, compiled in with -DRAYMOND_STATS or `make stats`
+#ifdef RAYMOND_STATS
+#define RAYMOND_STAT(statement) (trace_counters().statement)
+#else
+#define RAYMOND_STAT(statement) ((void) 0)
+#endif
+
+// ==============================
+// TraceCounters class
+// ==============================
+
+/*
+ * Work done while tracing rays by one thread, or summed over threads.
+ */
+class TraceCounters {
+  public:
+    static const int MAX_DEPTH = 16;  // paths deeper than this are counted in the last depth
+
+    uint64_t bvh_nodes = 0;                   // BVH nodes visited
+    uint64_t box_tests = 0;                   // ray and bounding box intersection tests
+    uint64_t sphere_tests = 0;                // calls to Sphere::hit
+    uint64_t quad_tests = 0;                  // calls to Quad::hit
+    uint64_t obb_tests = 0;                   // calls to Box::hit
+    uint64_t triangle_tests = 0;              // triangles of meshes tested
+    uint64_t shadow_rays = 0;                 // shadow rays traced towards the lights
+    uint64_t rays_per_depth[MAX_DEPTH] = {};  // path rays traced at every depth, starting at 1
+
+    /*
+     * Counts a path ray at the given depth, starting at 1.
+     */
+    void add_ray(int depth) {
+      rays_per_depth[std::clamp(depth, 1, MAX_DEPTH) - 1]++;
+    }
+
+    /*
+     * Returns the number of primitive intersection tests.
+     */
+    uint64_t primitive_tests() const {
+      return sphere_tests + quad_tests + obb_tests + triangle_tests;
+    }
+
+    /*
+     * Adds the counters of other to these.
+     */
+    TraceCounters& operator+=(const TraceCounters& other) {
+      bvh_nodes += other.bvh_nodes;
+      box_tests += other.box_tests;
+      sphere_tests += other.sphere_tests;
+      quad_tests += other.quad_tests;
+      obb_tests += other.obb_tests;
+      triangle_tests += other.triangle_tests;
+      shadow_rays += other.shadow_rays;
+      for (int i = 0; i < MAX_DEPTH; i++) {
+        rays_per_depth[i] += other.rays_per_depth[i];
+      }
+      return *this;
+    }
+};
+
+// ==============================
+// TraceCounterRegistry class
+// ==============================
+
+/*
+ * Counters of every thread that has traced rays. The registry keeps them alive so that they can
+ * still be summed after their thread exits.
+ */
+class TraceCounterRegistry {
+  public:
+    std::mutex mutex;                                      // guards counters
+    std::vector<std::shared_ptr<TraceCounters>> counters;  // counters of every thread
+
+    /*
+     * Returns the registry of the program.
+     */
+    static TraceCounterRegistry& instance() {
+      static TraceCounterRegistry registry;
+      return registry;
+    }
+};
+
+// ==============================
+// Trace counter functions
+// ==============================
+
+/*
+ * Returns the counters of the calling thread, registering them on first use.
+ */
+inline TraceCounters& trace_counters() {
+  thread_local std::shared_ptr<TraceCounters> counters = [] {
+    TraceCounterRegistry& registry = TraceCounterRegistry::instance();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.counters.push_back(std::make_shared<TraceCounters>());
+    return registry.counters.back();
+  }();
+
+  return *counters;
+}
+
+/*
+ * Returns the counters summed over every thread. Must not be called while rays are being traced.
+ */
+inline TraceCounters total_trace_counters() {
+  TraceCounterRegistry& registry = TraceCounterRegistry::instance();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+
+  TraceCounters total;
+  for (const std::shared_ptr<TraceCounters>& counters : registry.counters) {
+    total += *counters;
+  }
+  return total;
+}
+
+/*
+ * Resets the counters of every thread. Must not be called while rays are being traced.
+ */
+inline void reset_trace_counters() {
+  TraceCounterRegistry& registry = TraceCounterRegistry::instance();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+
+  for (const std::shared_ptr<TraceCounters>& counters : registry.counters) {
+    *counters = TraceCounters();
+  }
+}
+
+#endif //!TRACE_STATS_H_
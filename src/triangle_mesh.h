@@ -0,0 +1,376 @@
+#ifndef TRIANGLE_MESH_H_
+#define TRIANGLE_MESH_H_
+
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "raymond.h"
+#include "vector3.h"
+#include "ray.h"
+#include "interval.h"
+#include "aabb.h"
+#include "entity.h"
+#include "material.h"
+#include "color.h"
+#include "mesh.h"
+#include "bvh_builder.h"
+#include "linear_bvh.h"
+#include "trace_stats.h"
+
+// ==============================
+// TriangleMeshData class
+// ==============================
+
+/*
+ * Everything a TriangleMesh traces: the buffers of its mesh, the nodes of its BVH, its triangles in
+ * leaf order and the running sum of their areas. None of it is owned, so that it can point into
+ * buffers built by the entity or into a mapped scene cache alike.
+ */
+class TriangleMeshData {
+  public:
+    MeshView mesh;                         // vertex and triangle buffers
+    const LinearBVHNode* nodes = nullptr;  // nodes of the BVH over the triangles
+    size_t node_count = 0;                 // number of nodes
+    const uint32_t* triangles = nullptr;   // triangle indices ordered by leaf
+    const double* area_cdf = nullptr;      // sum of the areas of the triangles up to and including each
+    double area = 0;                       // surface area of the mesh
+};
+
+// ==============================
+// TriangleMesh class
+// (derived from Entity class)
+// ==============================
+
+/*
+ * Triangles of a shared Mesh with one material. The mesh keeps its own BVH over the indices of its
+ * triangles, so that a mesh of any size is a single entity of the scene and its triangles are never
+ * allocated one by one.
+ */
+class TriangleMesh : public Entity {
+  public:
+    /*
+     * Constructs the entity over every triangle of the given mesh and builds its BVH with the
+     * given options.
+     */
+    TriangleMesh(shared_ptr<const Mesh> source, shared_ptr<Material> mat,
+        const BVHBuildOptions& options = BVHBuildOptions()) :
+      source(source),
+      mat(mat) {
+        data.mesh = source->view();
+        const MeshView& mesh = data.mesh;
+        const int count = int(mesh.triangle_count);
+        const bool parallel = options.parallel && size_t(count) >= BVHBuilder::PARALLEL_TASK_SIZE;
+
+        std::vector<BVHPrimitive> build_primitives(count);
+        #pragma omp parallel for if (parallel)
+        for (int i = 0; i < count; i++) {
+          const uint32_t* v = &mesh.indices[3 * size_t(i)];
+          const Aabb box(Aabb(mesh.position(v[0]), mesh.position(v[1])), Aabb(mesh.position(v[2]), mesh.position(v[2])));
+          build_primitives[i] = BVHPrimitive(box, uint32_t(i));
+        }
+
+        tree.options = options;
+        tree.build(build_primitives);
+        data.nodes = tree.nodes.data();
+        data.node_count = tree.nodes.size();
+
+        // triangles in leaf order so each leaf is a contiguous range
+        triangle_order.resize(count);
+        for (int i = 0; i < count; i++) {
+          triangle_order[i] = build_primitives[i].index;
+        }
+        data.triangles = triangle_order.data();
+
+        // running sum of the triangle areas to pick triangles by area when sampled as a light
+        area_sums.resize(count);
+        for (int i = 0; i < count; i++) {
+          data.area += 0.5 * cross(edge1(i), edge2(i)).length();
+          area_sums[i] = data.area;
+        }
+        data.area_cdf = area_sums.data();
+        bound_box = tree.bounding_box();
+      }
+
+    /*
+     * Constructs the entity over data built before, such as from a scene cache, without copying
+     * it. The source keeps the memory data points into alive.
+     */
+    TriangleMesh(const TriangleMeshData& data, shared_ptr<const void> source, shared_ptr<Material> mat) :
+      source(source),
+      mat(mat),
+      data(data) {
+        tree.attach(data.nodes, data.node_count);
+        bound_box = tree.bounding_box();
+      }
+
+    // data points into the buffers of the entity
+    TriangleMesh(const TriangleMesh&) = delete;
+    TriangleMesh& operator=(const TriangleMesh&) = delete;
+
+    /*
+     * Returns true if the given ray hits a triangle of the mesh in the given interval and records
+     * the nearest hit in the given HitRecord.
+     */
+    bool hit(const Ray& r, Interval ray_t, HitRecord& rec) const override {
+      uint32_t triangle;
+      double b1, b2;
+      if (!hit_nearest(r, ray_t, triangle, b1, b2)) {
+        return false;
+      }
+
+      set_hit_record(r, ray_t.max, triangle, b1, b2, rec);
+      return true;
+    }
+
+    /*
+     * Traces the rays together through the BVH of the mesh, see LinearBVHTree::traverse_packet.
+     */
+    uint32_t hit_packet(const Ray rays[], Interval ray_t[], HitRecord recs[], int count) const override {
+      uint32_t nearest[16];
+      double b1[16], b2[16];
+
+      auto hit_leaf = [&](uint32_t first, uint32_t primitive_count, uint32_t lanes) {
+        uint32_t hits = 0;
+        for (; lanes; lanes &= lanes - 1) {
+          int lane = __builtin_ctz(lanes);
+          for (uint32_t i = first; i < first + primitive_count; i++) {
+            if (hit_triangle(data.triangles[i], rays[lane], ray_t[lane], b1[lane], b2[lane])) {
+              nearest[lane] = data.triangles[i];
+              hits |= 1u << lane;
+            }
+          }
+        }
+        return hits;
+      };
+
+      uint32_t mask;
+      if (count <= 4) {
+        mask = tree.traverse_packet<4>(rays, ray_t, count, hit_leaf);
+      }
+      else if (count <= 8) {
+        mask = tree.traverse_packet<8>(rays, ray_t, count, hit_leaf);
+      }
+      else {
+        mask = tree.traverse_packet<16>(rays, ray_t, count, hit_leaf);
+      }
+
+      for (uint32_t lanes = mask; lanes; lanes &= lanes - 1) {
+        int lane = __builtin_ctz(lanes);
+        set_hit_record(rays[lane], ray_t[lane].max, nearest[lane], b1[lane], b2[lane], recs[lane]);
+      }
+      return mask;
+    }
+
+    /*
+     * Returns the bounding box of the mesh.
+     */
+    Aabb bounding_box() const override {
+      return bound_box;
+    }
+
+    /*
+     * Returns the density of sampling the given direction by picking a uniform point on the surface
+     * of the mesh, converted from area to solid angle at the nearest triangle along it.
+     */
+    double pdf_value(const Point3& origin, const Vector3& direction) const override {
+      uint32_t triangle;
+      double b1, b2;
+      Interval ray_t(0.001, infinity);
+      if (data.area <= 0 || !hit_nearest(Ray(origin, direction), ray_t, triangle, b1, b2)) {
+        return 0;
+      }
+
+      const Vector3 normal = unit_vector(cross(edge1(triangle), edge2(triangle)));
+      double distance_squared = ray_t.max * ray_t.max * direction.length_squared();
+      double cosine = std::fabs(dot(direction, normal) / direction.length());
+
+      return distance_squared / (cosine * data.area);
+    }
+
+    /*
+     * Returns the direction from the given origin to a uniformly chosen point on the surface of the
+     * mesh. The triangle is picked by its area and the point uniformly inside it.
+     */
+    Vector3 random(const Point3& origin, Sampler& sampler) const override {
+      const double pick = sampler.get_1d() * data.area;
+      const double* end = data.area_cdf + data.mesh.triangle_count;
+      const size_t triangle = std::min<size_t>(std::upper_bound(data.area_cdf, end, pick) - data.area_cdf,
+          data.mesh.triangle_count - 1);
+
+      const Vector3 uv = sampler.get_2d();
+      const double root = std::sqrt(uv.x());
+      const double b1 = uv.y() * root;
+      const double b2 = 1 - root;
+
+      const uint32_t* v = &data.mesh.indices[3 * triangle];
+      const Point3 p0 = data.mesh.position(v[0]);
+      Point3 p = p0 + b1 * (data.mesh.position(v[1]) - p0) + b2 * (data.mesh.position(v[2]) - p0);
+      return p - origin;
+    }
+
+    /*
+     * Bounds of the light of the mesh, whose triangles emit from both sides into the hemisphere
+     * around their normals. Textured emission is estimated by its value at the center.
+     */
+    LightBounds light_bounds() const override {
+      const Point3 center(0.5 * (bound_box.x.min + bound_box.x.max), 0.5 * (bound_box.y.min + bound_box.y.max),
+          0.5 * (bound_box.z.min + bound_box.z.max));
+      const Color emission = mat->emitted(0.5, 0.5, center);
+      const double power = 2 * pi * data.area * luminance(emission);
+      if (power <= 0) {
+        return LightBounds();
+      }
+
+      DirectionCone normals;
+      for (uint32_t i = 0; i < data.mesh.triangle_count; i++) {
+        const Vector3 n = cross(edge1(i), edge2(i));
+        if (n.length_squared() > 0) {
+          normals = DirectionCone(normals, DirectionCone(n, 1));
+        }
+      }
+      return LightBounds(bound_box, power, normals, 0, true);
+    }
+
+    /*
+     * Returns the number of triangles in the mesh.
+     */
+    size_t triangle_count() const {
+      return data.mesh.triangle_count;
+    }
+
+    /*
+     * Returns what the entity traces, valid while the entity is alive.
+     */
+    const TriangleMeshData& get_data() const {
+      return data;
+    }
+
+  private:
+    shared_ptr<const void> source;         // owner of the memory data points into, a Mesh or a scene cache
+    shared_ptr<Material> mat;              // material of every triangle
+    TriangleMeshData data;                 // buffers traced
+    LinearBVHTree tree;                    // flattened tree over the triangles, built or attached to data.nodes
+    std::vector<uint32_t> triangle_order;  // storage of data.triangles when built
+    std::vector<double> area_sums;         // storage of data.area_cdf when built
+    Aabb bound_box;                        // bounding box of the mesh
+
+    /*
+     * Returns the edge from the first to the second vertex of the given triangle.
+     */
+    Vector3 edge1(uint32_t triangle) const {
+      const uint32_t* v = &data.mesh.indices[3 * size_t(triangle)];
+      return data.mesh.position(v[1]) - data.mesh.position(v[0]);
+    }
+
+    /*
+     * Returns the edge from the first to the third vertex of the given triangle.
+     */
+    Vector3 edge2(uint32_t triangle) const {
+      const uint32_t* v = &data.mesh.indices[3 * size_t(triangle)];
+      return data.mesh.position(v[2]) - data.mesh.position(v[0]);
+    }
+
+    /*
+     * Tests the given ray against the given triangle with the Moller-Trumbore algorithm. On a hit
+     * inside ray_t, shrinks ray_t.max to it, stores the barycentric coordinates of the second and
+     * third vertices in b1 and b2 and returns true.
+     */
+    bool hit_triangle(uint32_t triangle, const Ray& r, Interval& ray_t, double& b1, double& b2) const {
+      RAYMOND_STAT(triangle_tests++);
+      const uint32_t* v = &data.mesh.indices[3 * size_t(triangle)];
+      const double* px = data.mesh.px;
+      const double* py = data.mesh.py;
+      const double* pz = data.mesh.pz;
+
+      const Vector3 p0(px[v[0]], py[v[0]], pz[v[0]]);
+      const Vector3 e1 = Vector3(px[v[1]], py[v[1]], pz[v[1]]) - p0;
+      const Vector3 e2 = Vector3(px[v[2]], py[v[2]], pz[v[2]]) - p0;
+
+      // ray is parallel to the plane of the triangle
+      const Vector3 pvec = cross(r.direction(), e2);
+      const double det = dot(e1, pvec);
+      if (std::fabs(det) < 1e-12) {
+        return false;
+      }
+
+      const double inv_det = 1 / det;
+      const Vector3 tvec = r.origin() - p0;
+      const double u = dot(tvec, pvec) * inv_det;
+      if (u < 0 || u > 1) {
+        return false;
+      }
+
+      const Vector3 qvec = cross(tvec, e1);
+      const double w = dot(r.direction(), qvec) * inv_det;
+      if (w < 0 || u + w > 1) {
+        return false;
+      }
+
+      const double t = dot(e2, qvec) * inv_det;
+      if (!ray_t.surrounds(t)) {
+        return false;
+      }
+
+      ray_t.max = t;
+      b1 = u;
+      b2 = w;
+      return true;
+    }
+
+    /*
+     * Finds the nearest triangle the given ray hits in ray_t. On a hit, shrinks ray_t.max to it,
+     * stores the triangle and its barycentric coordinates and returns true.
+     */
+    bool hit_nearest(const Ray& r, Interval& ray_t, uint32_t& triangle, double& b1, double& b2) const {
+      auto hit_leaf = [&](uint32_t first, uint32_t count, Interval& t) {
+        bool hit_anything = false;
+        for (uint32_t i = first; i < first + count; i++) {
+          if (hit_triangle(data.triangles[i], r, t, b1, b2)) {
+            triangle = data.triangles[i];
+            hit_anything = true;
+          }
+        }
+        return hit_anything;
+      };
+
+      return tree.traverse(r, ray_t, hit_leaf);
+    }
+
+    /*
+     * Fills the given HitRecord for a hit at time t of the given triangle at the given barycentric
+     * coordinates. The normal faces the ray like the geometric normal, and is interpolated from the
+     * vertex normals when the mesh has them. Texture coordinates are interpolated from the vertices,
+     * or are the barycentric coordinates when the mesh has none.
+     */
+    void set_hit_record(const Ray& r, double t, uint32_t triangle, double b1, double b2, HitRecord& rec) const {
+      const uint32_t* v = &data.mesh.indices[3 * size_t(triangle)];
+      const double b0 = 1 - b1 - b2;
+
+      rec.t = t;
+      rec.p = r.at(t);
+      rec.mat = mat;
+      rec.entity = this;
+      rec.set_face_normal(r, unit_vector(cross(edge1(triangle), edge2(triangle))));
+
+      if (data.mesh.has_normals()) {
+        const Vector3 shading = b0 * data.mesh.normal(v[0]) + b1 * data.mesh.normal(v[1]) + b2 * data.mesh.normal(v[2]);
+        if (shading.length_squared() > 0) {
+          const Vector3 n = unit_vector(shading);
+          rec.normal = dot(n, rec.normal) < 0 ? -n : n;
+        }
+      }
+
+      if (data.mesh.has_uvs()) {
+        rec.u = b0 * data.mesh.tu[v[0]] + b1 * data.mesh.tu[v[1]] + b2 * data.mesh.tu[v[2]];
+        rec.v = b0 * data.mesh.tv[v[0]] + b1 * data.mesh.tv[v[1]] + b2 * data.mesh.tv[v[2]];
+      }
+      else {
+        rec.u = b1;
+        rec.v = b2;
+      }
+    }
+};
+
+#endif //!TRIANGLE_MESH_H_
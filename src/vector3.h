@@ -163,21 +163,21 @@ class Vector3 {
      */
     bool near_zero() const {
       static double s = 1e-8;
-      return (std::fabs(e[0] < s) && std::fabs(e[1] < s) && std::fabs(e[2] < s));
+      return (std::fabs(e[0]) < s) && (std::fabs(e[1]) < s) && (std::fabs(e[2]) < s);
     }
 
     /*
      * Returnas a random vector with its components in the range of [0, 1).
      */
-    static Vector3 random() {
-      return Vector3(random_double(), random_double(), random_double());
+    static Vector3 random(Rng& rng) {
+      return Vector3(random_double(rng), random_double(rng), random_double(rng));
     }
 
     /*
      * Returns a random vector with its components in the range of given [min, max).
      */
-    static Vector3 random(double min, double max) {
-      return Vector3(random_double(min, max), random_double(min, max), random_double(min, max));
+    static Vector3 random(Rng& rng, double min, double max) {
+      return Vector3(random_double(rng, min, max), random_double(rng, min, max), random_double(rng, min, max));
     }
 };
 
@@ -269,9 +269,9 @@ inline Vector3 unit_vector(const Vector3& v) {
 /*
  * Returns a unit vector with a random direction.
  */
-inline Vector3 random_unit_vector() {
+inline Vector3 random_unit_vector(Rng& rng) {
   while (true) {
-    Vector3 p = Vector3::random(-1, 1);
+    Vector3 p = Vector3::random(rng, -1, 1);
     double lensq = p.length_squared();
     if (1e-160 < lensq && lensq <= 1) {
       return p / sqrt(lensq);
@@ -282,8 +282,8 @@ inline Vector3 random_unit_vector() {
 /*
  * Returns a unti vector that is in the same hemisphere as the given normal vector.
  */
-inline Vector3 random_on_hemisphere(const Vector3& normal) {
-  Vector3 on_unit_sphere = random_unit_vector();
+inline Vector3 random_on_hemisphere(Rng& rng, const Vector3& normal) {
+  Vector3 on_unit_sphere = random_unit_vector(rng);
   if (dot(on_unit_sphere, normal) > 0) {
     return on_unit_sphere;
   }
@@ -314,9 +314,9 @@ inline Vector3 refract(const Vector3& uv, const Vector3& n, double etai_over_eta
 /*
  * Returns a random unti vector on a 1 unit radius circle
  */
-inline Vector3 random_in_unit_disk() {
+inline Vector3 random_in_unit_disk(Rng& rng) {
   while (true) {
-    Vector3 p = Vector3(random_double(-1, 1), random_double(-1, 1), 0);
+    Vector3 p = Vector3(random_double(rng, -1, 1), random_double(rng, -1, 1), 0);
     if (p.length_squared() < 1) {
       return p;
     }
@@ -0,0 +1,298 @@
+#ifndef WAVEFRONT_H_
+#define WAVEFRONT_H_
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <iostream>
+#include <omp.h>
+
+#include "raymond.h"
+#include "vector3.h"
+#include "color.h"
+#include "ray.h"
+#include "interval.h"
+#include "entity.h"
+#include "material.h"
+#include "image_buffer.h"
+#include "light_sampler.h"
+#include "light_sampling.h"
+#include "sampler.h"
+#include "render_telemetry.h"
+
+// ==============================
+// WavefrontPaths class
+// ==============================
+
+/*
+ * State of every path in a wavefront batch, stored as one array per field.
+ * Paths are indexed by their pixel within the batch.
+ */
+class WavefrontPaths {
+  public:
+    std::vector<Point3> origins;      // origin of the current ray of each path
+    std::vector<Vector3> directions;  // direction of the current ray of each path
+    std::vector<double> times;        // time of the current ray of each path
+    std::vector<Color> throughputs;   // product of the attenuations along each path
+    std::vector<Color> radiances;     // light gathered by each path so far
+    std::vector<Color> pixel_colors;  // sum of the radiance of every finished sample of each pixel
+    std::vector<int> depths;          // bounces each path may still take
+    std::vector<double> bsdf_pdfs;    // density the lights compete with for the next emission, 0 if none
+    std::vector<Vector3> normals;     // normal at the origin of the current ray of each path
+    std::vector<Sampler> samplers;    // sampler of the pixel each path belongs to
+    std::vector<HitRecord> hits;      // nearest hit of the current ray of each path
+
+    /*
+     * Resizes every array to hold the given number of paths.
+     */
+    void resize(size_t count) {
+      origins.resize(count);
+      directions.resize(count);
+      times.resize(count);
+      throughputs.resize(count);
+      radiances.resize(count);
+      pixel_colors.resize(count);
+      depths.resize(count);
+      bsdf_pdfs.resize(count);
+      normals.resize(count);
+      samplers.resize(count);
+      hits.resize(count);
+    }
+};
+
+// ==============================
+// WavefrontIntegrator class
+// ==============================
+
+/*
+ * Path tracer that advances a whole batch of paths one stage at a time instead of following each
+ * path to its end. Every bounce runs the stages
+ *   - intersect: find the nearest hit of every live path
+ *   - sort:      group the hit paths by material
+ *   - shade:     add emission, scatter and retire the paths that end
+ * over the whole queue, so that consecutive paths shade with the same material and texture.
+ * The samples of a pixel are traced one after the other with the pixel's sampler, drawing in the
+ * same order as the recursive integrator, so both produce the same image up to rounding.
+ */
+class WavefrontIntegrator {
+  public:
+    static const int BATCH_PIXELS = 1 << 16;  // pixels whose paths are in flight at once
+
+    int image_width;        // width of the image in pixels
+    int image_height;       // height of the image in pixels
+    int samples_per_pixel;  // number of paths traced per pixel
+    int max_depth;          // maximum number of intersections along a path
+    Color background;       // color of rays that escape the scene
+    uint64_t seed;          // seed of the per pixel random number generators
+    SamplerType sampler_type = SamplerType::Independent;  // how the samples of a pixel are placed
+    int roulette_depth;     // bounces after which Russian roulette may end paths, 0 disables it
+    const LightSampler* lights = nullptr;  // lights sampled at diffuse bounces, null to disable
+    MISHeuristic mis_heuristic = MISHeuristic::Power;  // weights of light and material samples
+    RenderTelemetry* telemetry = nullptr;  // progress of the render, null to not report it
+
+    /*
+     * Renders the world into the given image buffer. camera_ray(col, row, sampler) must return a
+     * sampled camera ray through the given pixel. Returns the number of rays traced.
+     */
+    template <typename CameraRay>
+    uint64_t render(const Entity& world, ImageBuffer& image_buffer, CameraRay camera_ray) {
+      segments = 0;
+      const int batch_rows = std::max(1, BATCH_PIXELS / image_width);
+
+      for (int first_row = 0; first_row < image_height; first_row += batch_rows) {
+        const int last_row = std::min(first_row + batch_rows, image_height);
+        const uint64_t batch_start = segments;
+        render_batch(world, image_buffer, first_row, last_row, camera_ray);
+
+        if (telemetry) {
+          const uint64_t pixels = uint64_t(last_row - first_row) * image_width;
+          telemetry->record(0, pixels, segments - batch_start, pixels * samples_per_pixel);
+        }
+      }
+
+      return segments;
+    }
+
+  private:
+    WavefrontPaths paths;          // state of the paths of the current batch
+    std::vector<uint32_t> queue;   // paths still alive, ordered by material after sorting
+    std::vector<uint32_t> next;    // paths that survive the current bounce
+    std::vector<uint8_t> alive;    // whether each path of the queue survived shading
+    std::vector<std::pair<const Material*, uint32_t>> keys;  // (material, path) pairs being sorted
+    uint64_t segments = 0;         // rays traced so far
+
+    /*
+     * Traces every sample of every pixel in rows [first_row, last_row).
+     */
+    template <typename CameraRay>
+    void render_batch(const Entity& world, ImageBuffer& image_buffer, int first_row, int last_row,
+        CameraRay camera_ray) {
+      const int count = (last_row - first_row) * image_width;
+      paths.resize(count);
+
+      for (int i = 0; i < count; i++) {
+        uint64_t pixel = uint64_t(first_row) * image_width + i;
+        paths.samplers[i] = Sampler(sampler_type, seed, samples_per_pixel, pixel);
+        paths.pixel_colors[i] = Color(0, 0, 0);
+      }
+
+      for (int sample = 0; sample < samples_per_pixel; sample++) {
+        generate(count, first_row, sample, camera_ray);
+
+        while (!queue.empty()) {
+          intersect(world);
+          sort_by_material();
+          shade(world);
+        }
+
+        accumulate(count);
+      }
+
+      const double scale = 1.0 / samples_per_pixel;
+      for (int i = 0; i < count; i++) {
+        image_buffer.get(first_row + i / image_width, i % image_width) = paths.pixel_colors[i] * scale;
+      }
+    }
+
+    /*
+     * Starts one new path per pixel of the batch from a camera ray of the sample with the given index.
+     */
+    template <typename CameraRay>
+    void generate(int count, int first_row, int sample, CameraRay camera_ray) {
+      queue.clear();
+
+      for (int i = 0; i < count; i++) {
+        paths.samplers[i].start_sample(sample);
+        Ray r = camera_ray(i % image_width, first_row + i / image_width, paths.samplers[i]);
+        paths.origins[i] = r.origin();
+        paths.directions[i] = r.direction();
+        paths.times[i] = r.time();
+        paths.throughputs[i] = Color(1, 1, 1);
+        paths.radiances[i] = Color(0, 0, 0);
+        paths.depths[i] = max_depth;
+        paths.bsdf_pdfs[i] = 0;
+
+        if (max_depth > 0) {
+          queue.push_back(uint32_t(i));
+        }
+      }
+    }
+
+    /*
+     * Finds the nearest hit of every path in the queue. Paths that escape gather the background
+     * and leave the queue.
+     */
+    void intersect(const Entity& world) {
+      alive.assign(queue.size(), 0);
+      segments += queue.size();
+
+      #pragma omp parallel for schedule(dynamic, 256)
+      for (size_t q = 0; q < queue.size(); q++) {
+        const uint32_t i = queue[q];
+        const Ray r(paths.origins[i], paths.directions[i], paths.times[i]);
+
+        if (world.hit(r, Interval(0.001, infinity), paths.hits[i])) {
+          alive[q] = 1;
+        }
+        else {
+          paths.radiances[i] += paths.throughputs[i] * background;
+        }
+      }
+
+      compact();
+    }
+
+    /*
+     * Orders the queue by the material that was hit so that shading walks one material at a time.
+     */
+    void sort_by_material() {
+      keys.resize(queue.size());
+      for (size_t q = 0; q < queue.size(); q++) {
+        keys[q] = { paths.hits[queue[q]].mat.get(), queue[q] };
+      }
+
+      std::sort(keys.begin(), keys.end());
+
+      for (size_t q = 0; q < queue.size(); q++) {
+        queue[q] = keys[q].second;
+      }
+    }
+
+    /*
+     * Adds the emission of the hit material and the light sampled directly from the lights, both
+     * weighted by multiple importance sampling, to every path in the queue and scatters it. Paths
+     * that are absorbed, run out of bounces or lose at Russian roulette leave the queue.
+     */
+    void shade(const Entity& world) {
+      alive.assign(queue.size(), 0);
+
+      #pragma omp parallel for schedule(static)
+      for (size_t q = 0; q < queue.size(); q++) {
+        const uint32_t i = queue[q];
+        const HitRecord& rec = paths.hits[i];
+        const Ray r_in(paths.origins[i], paths.directions[i], paths.times[i]);
+
+        if (paths.bsdf_pdfs[i] == 0) {
+          paths.radiances[i] += paths.throughputs[i] * rec.mat->emitted(rec.u, rec.v, rec.p);
+        }
+        else if (rec.mat->is_emissive()) {
+          const double weight = emission_weight(r_in, paths.normals[i], paths.bsdf_pdfs[i], rec, *lights, mis_heuristic);
+          paths.radiances[i] += paths.throughputs[i] * rec.mat->emitted(rec.u, rec.v, rec.p) * weight;
+        }
+
+        // next event estimation, weighted against the material finding the same light
+        const bool sample_lights = lights && paths.depths[i] > 1 && !rec.mat->is_specular();
+        if (sample_lights) {
+          paths.radiances[i] += paths.throughputs[i]
+            * sample_direct_light(r_in, rec, world, *lights, mis_heuristic, paths.samplers[i]);
+        }
+
+        ScatterRecord srec;
+        if (!rec.mat->sample(r_in, rec, srec, paths.samplers[i]) || --paths.depths[i] <= 0) {
+          continue;
+        }
+        paths.bsdf_pdfs[i] = sample_lights ? srec.pdf : 0;
+        paths.normals[i] = rec.normal;
+
+        paths.throughputs[i] = paths.throughputs[i] * srec.attenuation;
+        const int bounces = max_depth - paths.depths[i];
+        if (roulette_depth > 0 && bounces >= roulette_depth
+            && !survive_russian_roulette(paths.throughputs[i], paths.samplers[i])) {
+          continue;
+        }
+
+        paths.origins[i] = srec.scattered.origin();
+        paths.directions[i] = srec.scattered.direction();
+        paths.times[i] = srec.scattered.time();
+        alive[q] = 1;
+      }
+
+      compact();
+    }
+
+    /*
+     * Adds the radiance of the finished sample to every pixel of the batch.
+     */
+    void accumulate(int count) {
+      #pragma omp parallel for schedule(static)
+      for (int i = 0; i < count; i++) {
+        paths.pixel_colors[i] += paths.radiances[i];
+      }
+    }
+
+    /*
+     * Keeps only the queue entries flagged as alive, preserving their order.
+     */
+    void compact() {
+      next.clear();
+      for (size_t q = 0; q < queue.size(); q++) {
+        if (alive[q]) {
+          next.push_back(queue[q]);
+        }
+      }
+      queue.swap(next);
+    }
+};
+
+#endif //!WAVEFRONT_H_
@@ -0,0 +1,375 @@
+#ifndef WIDE_BVH_H_
+#define WIDE_BVH_H_
+
+#include <cstdint>
+#include <vector>
+#include <limits>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "raymond.h"
+#include "ray.h"
+#include "interval.h"
+#include "aabb.h"
+#include "bvh_builder.h"
+#include "trace_stats.h"
+
+// ==============================
+// WideRay class
+// ==============================
+
+/*
+ * Single precision copy of a ray prepared for slab tests against many boxes at once.
+ */
+class WideRay {
+  public:
+    float origin[3];   // origin of the ray
+    float inv_dir[3];  // inverse of the direction of the ray
+    bool neg[3];       // true for axes along which the direction is negative
+
+    /*
+     * Prepares the given ray.
+     */
+    WideRay(const Ray& r) {
+      for (int axis = 0; axis < 3; axis++) {
+        origin[axis] = float(r.origin().e[axis]);
+        inv_dir[axis] = float(1.0 / r.direction().e[axis]);
+        neg[axis] = inv_dir[axis] < 0;
+      }
+    }
+};
+
+// ==============================
+// WideBVHNode class
+// ==============================
+
+/*
+ * Node of an N wide BVH. The bounds of all N children are stored as structure of arrays so that
+ * one SIMD slab test covers every child.
+ * A child with child_count 0 is an interior node at child_offset in the node array, otherwise it
+ * is a leaf of child_count primitives starting at child_offset. Unused slots have inverted
+ * bounds and are never hit.
+ */
+template <int N>
+class alignas(64) WideBVHNode {
+  public:
+    float bounds_min[3][N];     // lower corners of the child boxes, one row per axis
+    float bounds_max[3][N];     // upper corners of the child boxes, one row per axis
+    uint32_t child_offset[N];   // node index of interior children, first primitive of leaves
+    uint16_t child_count[N];    // primitive count of leaf children, 0 for interior children
+
+    /*
+     * Marks every slot as unused.
+     */
+    void clear() {
+      for (int i = 0; i < N; i++) {
+        for (int axis = 0; axis < 3; axis++) {
+          bounds_min[axis][i] = std::numeric_limits<float>::infinity();
+          bounds_max[axis][i] = -std::numeric_limits<float>::infinity();
+        }
+        child_offset[i] = 0;
+        child_count[i] = 0;
+      }
+    }
+
+    /*
+     * Copies the bounds of the given binary node into slot i.
+     */
+    void set_bounds(int i, const LinearBVHNode& node) {
+      for (int axis = 0; axis < 3; axis++) {
+        bounds_min[axis][i] = node.bounds_min[axis];
+        bounds_max[axis][i] = node.bounds_max[axis];
+      }
+    }
+
+    /*
+     * Slab test of the given ray against all N children for distances in [t_min, t_max].
+     * Returns a bit mask of the children that are hit and stores their entry distances in t_near.
+     */
+    int intersect(const WideRay& ray, float t_min, float t_max, float t_near[N]) const {
+#if defined(__AVX__)
+      if constexpr (N % 8 == 0) {
+        return intersect_avx(ray, t_min, t_max, t_near);
+      }
+#endif
+#if defined(__SSE2__)
+      if constexpr (N % 4 == 0) {
+        return intersect_sse(ray, t_min, t_max, t_near);
+      }
+#endif
+      return intersect_scalar(ray, t_min, t_max, t_near);
+    }
+
+    /*
+     * Portable version of intersect that tests one child at a time.
+     */
+    int intersect_scalar(const WideRay& ray, float t_min, float t_max, float t_near[N]) const {
+      int mask = 0;
+      for (int i = 0; i < N; i++) {
+        float t0 = t_min;
+        float t1 = t_max;
+        for (int axis = 0; axis < 3; axis++) {
+          const float near_plane = ray.neg[axis] ? bounds_max[axis][i] : bounds_min[axis][i];
+          const float far_plane = ray.neg[axis] ? bounds_min[axis][i] : bounds_max[axis][i];
+          const float t_enter = (near_plane - ray.origin[axis]) * ray.inv_dir[axis];
+          const float t_exit = (far_plane - ray.origin[axis]) * ray.inv_dir[axis];
+
+          // a NaN from 0 * inf fails both comparisons and leaves the interval untouched
+          t0 = t_enter > t0 ? t_enter : t0;
+          t1 = t_exit < t1 ? t_exit : t1;
+        }
+
+        t_near[i] = t0;
+        if (t0 <= t1 * ROUNDING_SLACK) {
+          mask |= 1 << i;
+        }
+      }
+
+      return mask;
+    }
+
+  private:
+    static constexpr float ROUNDING_SLACK = 1.0000004f;  // widens exit distances to absorb the
+                                                         // rounding of the single precision test
+
+#if defined(__SSE2__)
+    /*
+     * SSE version of intersect that tests four children per instruction.
+     */
+    int intersect_sse(const WideRay& ray, float t_min, float t_max, float t_near[N]) const {
+      int mask = 0;
+      for (int group = 0; group < N; group += 4) {
+        __m128 t0 = _mm_set1_ps(t_min);
+        __m128 t1 = _mm_set1_ps(t_max);
+
+        for (int axis = 0; axis < 3; axis++) {
+          const float* near_plane = ray.neg[axis] ? bounds_max[axis] : bounds_min[axis];
+          const float* far_plane = ray.neg[axis] ? bounds_min[axis] : bounds_max[axis];
+          const __m128 origin = _mm_set1_ps(ray.origin[axis]);
+          const __m128 inv_dir = _mm_set1_ps(ray.inv_dir[axis]);
+
+          const __m128 t_enter = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(near_plane + group), origin), inv_dir);
+          const __m128 t_exit = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(far_plane + group), origin), inv_dir);
+
+          // max and min return their second operand when the first is NaN
+          t0 = _mm_max_ps(t_enter, t0);
+          t1 = _mm_min_ps(t_exit, t1);
+        }
+
+        _mm_storeu_ps(t_near + group, t0);
+        const __m128 hit = _mm_cmple_ps(t0, _mm_mul_ps(t1, _mm_set1_ps(ROUNDING_SLACK)));
+        mask |= _mm_movemask_ps(hit) << group;
+      }
+
+      return mask;
+    }
+#endif
+
+#if defined(__AVX__)
+    /*
+     * AVX version of intersect that tests eight children per instruction.
+     */
+    int intersect_avx(const WideRay& ray, float t_min, float t_max, float t_near[N]) const {
+      int mask = 0;
+      for (int group = 0; group < N; group += 8) {
+        __m256 t0 = _mm256_set1_ps(t_min);
+        __m256 t1 = _mm256_set1_ps(t_max);
+
+        for (int axis = 0; axis < 3; axis++) {
+          const float* near_plane = ray.neg[axis] ? bounds_max[axis] : bounds_min[axis];
+          const float* far_plane = ray.neg[axis] ? bounds_min[axis] : bounds_max[axis];
+          const __m256 origin = _mm256_set1_ps(ray.origin[axis]);
+          const __m256 inv_dir = _mm256_set1_ps(ray.inv_dir[axis]);
+
+          const __m256 t_enter = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(near_plane + group), origin), inv_dir);
+          const __m256 t_exit = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(far_plane + group), origin), inv_dir);
+
+          // max and min return their second operand when the first is NaN
+          t0 = _mm256_max_ps(t_enter, t0);
+          t1 = _mm256_min_ps(t_exit, t1);
+        }
+
+        _mm256_storeu_ps(t_near + group, t0);
+        const __m256 hit = _mm256_cmp_ps(t0, _mm256_mul_ps(t1, _mm256_set1_ps(ROUNDING_SLACK)), _CMP_LE_OQ);
+        mask |= _mm256_movemask_ps(hit) << group;
+      }
+
+      return mask;
+    }
+#endif
+};
+
+// ==============================
+// WideBVHTree class
+// ==============================
+
+/*
+ * N wide BVH made by collapsing a binary LinearBVHTree. Every wide node pulls up the children of
+ * its largest interior descendants until it holds N children.
+ * Like LinearBVHTree it only knows primitive ranges, the owner intersects the leaves.
+ */
+template <int N>
+class WideBVHTree {
+  public:
+    static constexpr int MAX_DEPTH = 128;  // deepest binary tree that can be collapsed
+
+    std::vector<WideBVHNode<N>> nodes;  // wide nodes, root at index 0
+
+    /*
+     * Collapses the given array of count binary nodes into N wide nodes.
+     */
+    void build(const LinearBVHNode* binary, size_t count) {
+      nodes.clear();
+      root_offset = 0;
+      root_count = 0;
+
+      if (count == 0) {
+        return;
+      }
+
+      // a single leaf has no interior node to collapse
+      if (binary[0].is_leaf()) {
+        root_offset = binary[0].offset;
+        root_count = binary[0].primitive_count;
+        return;
+      }
+
+      collapse(binary, 0);
+    }
+
+    /*
+     * Walks the tree front to back: the children hit by the ray are pushed so that the nearest one
+     * is visited first, and entries farther than the closest hit so far are skipped.
+     * hit_leaf(first, count, ray_t) has the same contract as in LinearBVHTree::traverse.
+     */
+    template <typename LeafFunction>
+    bool traverse(const Ray& r, Interval& ray_t, LeafFunction hit_leaf) const {
+      if (nodes.empty()) {
+        return root_count > 0 && hit_leaf(root_offset, root_count, ray_t);
+      }
+
+      const WideRay ray(r);
+
+      StackEntry stack[MAX_DEPTH * (N - 1) + 1];
+      int stack_size = 0;
+      stack[stack_size++] = { 0, 0, -std::numeric_limits<float>::infinity() };
+      bool hit_anything = false;
+
+      while (stack_size > 0) {
+        const StackEntry entry = stack[--stack_size];
+        if (entry.t_near > ray_t.max) {
+          continue;
+        }
+
+        if (entry.count > 0) {
+          if (hit_leaf(entry.offset, entry.count, ray_t)) {
+            hit_anything = true;
+          }
+          continue;
+        }
+
+        const WideBVHNode<N>& node = nodes[entry.offset];
+        float t_near[N];
+        int mask = node.intersect(ray, float(ray_t.min), float(ray_t.max), t_near);
+        RAYMOND_STAT(bvh_nodes++);
+        RAYMOND_STAT(box_tests += N);
+
+        // insert the hit children sorted by descending distance so the nearest ends on top
+        int first = stack_size;
+        while (mask) {
+          int i = __builtin_ctz(mask);
+          mask &= mask - 1;
+
+          StackEntry child = { node.child_offset[i], node.child_count[i], t_near[i] };
+          int j = stack_size++;
+          while (j > first && stack[j - 1].t_near < child.t_near) {
+            stack[j] = stack[j - 1];
+            j--;
+          }
+          stack[j] = child;
+        }
+      }
+
+      return hit_anything;
+    }
+
+  private:
+    /*
+     * Entry of the traversal stack.
+     */
+    class StackEntry {
+      public:
+        uint32_t offset;  // node index or first primitive
+        uint32_t count;   // primitive count, 0 for interior nodes
+        float t_near;     // distance at which the ray enters the entry's box
+    };
+
+    uint32_t root_offset = 0;  // first primitive when the whole tree is a single leaf
+    uint32_t root_count = 0;   // primitive count when the whole tree is a single leaf
+
+    /*
+     * Surface area of the bounding box of the given binary node.
+     */
+    static double node_area(const LinearBVHNode& node) {
+      double dx = node.bounds_max[0] - node.bounds_min[0];
+      double dy = node.bounds_max[1] - node.bounds_min[1];
+      double dz = node.bounds_max[2] - node.bounds_min[2];
+      return 2 * (dx * dy + dy * dz + dz * dx);
+    }
+
+    /*
+     * Appends the wide node for the interior binary node at the given index, followed by the wide
+     * nodes of its interior children. Returns the index of the new wide node.
+     */
+    uint32_t collapse(const LinearBVHNode* binary, uint32_t index) {
+      uint32_t children[N];
+      int child_count = 0;
+      children[child_count++] = index + 1;
+      children[child_count++] = binary[index].offset;
+
+      // open the interior child with the largest area until the node is full
+      while (child_count < N) {
+        int largest = -1;
+        for (int i = 0; i < child_count; i++) {
+          if (!binary[children[i]].is_leaf()
+              && (largest < 0 || node_area(binary[children[i]]) > node_area(binary[children[largest]]))) {
+            largest = i;
+          }
+        }
+
+        if (largest < 0) {
+          break;
+        }
+
+        uint32_t opened = children[largest];
+        children[largest] = opened + 1;
+        children[child_count++] = binary[opened].offset;
+      }
+
+      uint32_t node_index = uint32_t(nodes.size());
+      nodes.emplace_back();
+      nodes[node_index].clear();
+
+      for (int i = 0; i < child_count; i++) {
+        const LinearBVHNode& child = binary[children[i]];
+        nodes[node_index].set_bounds(i, child);
+
+        if (child.is_leaf()) {
+          nodes[node_index].child_offset[i] = child.offset;
+          nodes[node_index].child_count[i] = child.primitive_count;
+        }
+        else {
+          // collapse may grow the node array, so index it again afterwards
+          uint32_t child_index = collapse(binary, children[i]);
+          nodes[node_index].child_offset[i] = child_index;
+          nodes[node_index].child_count[i] = 0;
+        }
+      }
+
+      return node_index;
+    }
+};
+
+#endif //!WIDE_BVH_H_